@@ -43,6 +43,75 @@
 // Include inline camera class to handle camera build and movements 
 #include "Camera.h"
 
+// Include binary mesh cache to skip geometry generation on later launches
+#include "meshcache.h"
+
+// Include parametric surface generator shared by the curved primitives
+#include "parametric.h"
+
+// Include geometry residency policy deciding which CPU copies survive upload
+#include "geometryresidency.h"
+
+// Include meshlet clustering used to cull parts of large meshes
+#include "meshlet.h"
+
+// Include compute shader generation of the parametric surfaces
+#include "gpusurface.h"
+
+// Include hardware tessellation of the curved primitives
+#include "tessellation.h"
+
+// Include the OBJ/glTF importer for external models
+#include "modelimporter.h"
+
+// Include the worker thread texture decoder
+#include "textureloader.h"
+
+// Include the flip/RGBA/premultiply kernels run on every decoded texture
+#include "textureimport.h"
+
+// Include the BC1/BC3 KTX2 cache the textures are loaded from after the first launch
+#include "texturecache.h"
+
+// Include the atlas packer that puts the box faces into one texture
+#include "textureatlas.h"
+
+// Include the residency manager that keeps the textures under a video memory budget
+#include "textureresidency.h"
+
+// Include the registry that shares one texture per image file and frees it with its last handle
+#include "textureregistry.h"
+
+// Include the persistently mapped buffer the texture workers stage mip levels in
+#include "textureuploadring.h"
+
+// Include the gamma correct mip filter the RGBA textures and the cache levels are built with
+#include "mipgenerator.h"
+
+// Include the page streaming that samples very large textures through a page table
+#include "virtualtexture.h"
+
+// Include the shared sampler objects and the texture quality tiers
+#include "texturesampler.h"
+
+// Include the cache that restores linked shader programs from their driver binaries
+#include "programcache.h"
+
+// Include the library every shader program is compiled through, with the uniform locations it reflects
+#include "shaderlibrary.h"
+
+// Include the watcher that recompiles shaders edited in shaderfiles while the scene runs
+#include "shaderreloader.h"
+
+// Include the #define permutations the object shaders are compiled in per material
+#include "shadervariants.h"
+
+// Include the GPU time queries the lighting tiers are measured with
+#include "gputimer.h"
+
+// Include the export of every program's stage sources for offline validation
+#include "shaderexport.h"
+
 using namespace std;
 
 // Shader programs macro
@@ -50,6 +119,11 @@ using namespace std;
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif // !GLSL
 
+// Shared shader functions without a version line, compiled after a GLSL() source that declares them
+#ifndef GLSL_LIBRARY
+#define GLSL_LIBRARY(Source) #Source
+#endif // !GLSL_LIBRARY
+
 const char* const SCR_TITLE = "Project Milestone - Matt Bandyk";
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -77,13 +151,11 @@ struct Cylinder {
     GLuint cylinderSidesVAO;
     GLuint cylinderTopTexture;
     GLuint cylinderBottomTexture;
-    GLuint cylinderSideTexture;
     GLuint cylinderTopVBO;
     GLuint cylinderBottomVBO;
-    GLuint cylinderSideVBO;
+    GLuint cylinderSideVBO;    // Interleaved SurfaceVertex data for the sides
     GLuint cylinderTopNormalsVBO;
     GLuint cylinderBottomNormalsVBO;
-    GLuint cylinderSideNormalsVBO;
     GLuint cylinderTopEBO;
     GLuint cylinderBottomEBO;
     GLuint cylinderSidesEBO;
@@ -95,7 +167,10 @@ struct Cylinder {
     GLuint sideTextureID;      // Texture ID for the sides
 
     Material cylMaterial;
+    SurfaceBounds bounds;
+    SurfacePatches sidePatches; // Coarse patches of the sides, only created when tessellation is on
 
+    // CPU copies, only filled when GeometryResidency has a consumer for them
     vector<glm::vec3> verticesTop;
     vector<glm::vec3> verticesBottom;
     vector<glm::vec3> verticesSides;
@@ -108,16 +183,17 @@ struct Cylinder {
 // Struct to hold torus data
 struct Torus {
     GLuint torusVAO;
-    GLuint torusTextureVBO;
-    GLuint torusNormalVBO;
-    GLuint torusVBO;
+    GLuint torusVBO;           // Interleaved SurfaceVertex data
     GLuint torusEBO;
     unsigned int torusIndices;
     Material torusMaterial;
+    SurfaceBounds bounds;
 
     GLuint torusTextureID;         // Texture ID for the torus
     vector<glm::mat4> torusMatrices;
-    vector<glm::vec3> normals;
+    vector<Meshlet> meshlets;      // Clusters of the index buffer, culled every frame
+    SurfacePatches patches;        // Coarse patches, only created when tessellation is on
+    vector<glm::vec3> normals;     // CPU copy, only filled when GeometryResidency has a consumer for it
 };
 
 // Struct to hold plane data
@@ -131,8 +207,8 @@ struct Plane {
     Material planeMaterial;
 
     GLuint planeTextureID;        // Texture ID for the plane
+    int virtualTexture = -1;      // index in virtualTextures sampled instead of planeTextureID, -1 for none
     vector<glm::mat4> planeMatrices;
-    vector<glm::vec3> normals;
 };
 
 // Struct to hold the Cube data
@@ -143,6 +219,7 @@ struct Cube {
     glm::mat4 translation;
     glm::mat4 rotation;
     GLuint textures[6];
+    int virtualTexture = -1; // index in virtualTextures sampled instead of textures, -1 for none
     Material cubeMaterial;
 };
 
@@ -155,6 +232,9 @@ struct Sphere {
     GLuint texture;
     Material sphereMaterial;
     unsigned int sphereIndices;
+    SurfaceBounds bounds;
+    vector<Meshlet> meshlets; // Clusters of the index buffer, culled every frame
+    SurfacePatches patches;   // Coarse patches, only created when tessellation is on
 };
 
 // Struct to hold light cube data
@@ -174,14 +254,17 @@ struct PointLight {
     float highlightSize;
 };
 
-PointLight pointLights[3];
+// Every lit shader variant shades with all of the scene's point lights
+const int SCENE_LIGHT_COUNT = 3;
+PointLight pointLights[SCENE_LIGHT_COUNT];
 
 Torus torus;
 Plane plane;
 Sphere sphere;
 
-// This map stores texture paths and their IDs
-map<std::string, GLuint> textures; 
+// This map stores the scene textures by name, names using the same image share one texture
+// The handles free their texture when the map is cleared
+map<std::string, TextureHandle> textures;
 
 // Texture
 GLuint textureId;
@@ -190,14 +273,105 @@ glm::vec2 uvScale(1.0f, 1.0f);
 
 GLint gTexWrapMode = GL_REPEAT;
 
+// Wrap and filter state of every scene texture on unit 0, switched between quality tiers with T
+TextureSamplers textureSamplers;
+
 // shader programs
-GLuint objectProgramId;
-GLuint lightProgramId;
+// Every program is created and deleted through the shader library, which also looks up their uniforms
+ShaderLibrary& shaderLibrary = ShaderLibrary::Get();
+// The objects and light cubes draw with variants of vertexShaderSource and fragmentShaderSource,
+// each material with the one that has only the features it uses, see UseSceneVariant
+ShaderVariants sceneVariants;
+GLuint surfaceComputeProgramId;
+GLuint tessellationProgramId;
+
+// Optional compute shader path for the sphere, torus, and cylinder sides
+bool gpuGeometry = false;
+GpuSurfaceGenerator gpuSurfaces;
+
+// Optional hardware tessellation of the sphere, torus, and cylinder sides
+bool tessellateSurfaces = false;
+SurfaceTessellator surfaceTessellator;
+const float TESS_PIXELS_PER_EDGE = 12.0f; // target on screen length of a tessellated edge
+
+// Variant of fragmentShaderSource the tessellated surfaces shade with, built once with the starting lighting tier
+uint32_t tessellationShaderFeatures = SHADER_TEXTURED | SHADER_SPECULAR;
+
+// Lighting model of every lit variant, an index into LIGHTING_TIERS cycled with L
+int lightingTier = DEFAULT_LIGHTING_TIER;
+
+// GPU time of Render per lighting tier, reported at exit
+GpuTimer lightingTimer;
+
+// Frame being drawn and its camera, a scene variant gets them the first time it is used in a frame
+unsigned int sceneFrame = 0;
+glm::mat4 sceneView;
+glm::mat4 sceneProjection;
+
+// Decoded textures uploaded per frame while the texture loader is still busy
+const size_t TEXTURE_UPLOADS_PER_FRAME = 4;
+
+// Pixel unpack buffer the texture workers copy mip levels into, large enough for the uncompressed box atlas
+const size_t TEXTURE_UPLOAD_RING_BYTES = 64 * 1024 * 1024;
+PixelUploadRing textureUploadRing;
+
+// Import settings for every scene texture; the object shader writes alpha 1 and samples without
+// sRGB decoding, so both stay off to keep the scene looking as authored
+TextureImportOptions textureImportOptions;
+
+// Load textures through the compressed texture cache, turned off when the GPU lacks S3TC
+bool compressTextures = true;
+size_t textureMemoryBytes = 0; // bytes allocated by UploadTexture, mip chains included
+
+// Scene textures: the name the meshes look them up by and the image file each is loaded from
+struct SceneTexture {
+    const char* name;
+    const char* file;
+    bool boxFace;        // packed into boxAtlas instead of getting its own texture
+    bool virtualTexture = false; // streamed through virtualTextures with --virtual-textures
+};
+
+const SceneTexture sceneTextures[] = {
+    { "cylTopLargeTexture", "cylTopLarge.png", false },
+    { "cylTopSmallTexture", "cylTopSmall.png", false },
+    { "cylSidesLongTexture", "cylLongSide.png", false },
+    { "cylSidesTexture", "cylSide.png", false },
+    { "Torus", "torus.png", false },
+    { "Plane", "plane.png", false, true },
+    { "Sphere", "marble.png", false },
+    { "smallLeftSide", "left_face.png", true },
+    { "smallRightSide", "right_face.png", true },
+    { "smallFrontSide", "front_face.png", true },
+    { "smallBackSide", "back_face.png", true },
+    { "smallTopSide", "top_face.png", true },
+    { "largeLeftSide", "Lleft_face.png", true },
+    { "largeRightSide", "Lright_face.png", true },
+    { "largeFrontSide", "Lfront_face.png", true },
+    { "largeBackSide", "Lback_face.png", true },
+    { "largeTopSide", "Ltop_face.png", true }
+};
+
+// One texture holding every box face, so each box draws with a single bind and draw call
+TextureAtlas boxAtlas;
+
+// Keeps the loaded textures under a video memory budget, set from --texture-budget or the driver's memory info
+TextureResidency textureResidency;
+
+// Loader of the scene textures, whose keys BindSceneTexture resolves to the current GL textures
+AsyncTextureLoader* sceneTextureLoader = nullptr;
+
+// Optional virtual texturing of the plane and the box atlas, only the pages in view stay resident
+bool virtualTexturing = false;
+VirtualTextureSystem virtualTextures;
+GLuint virtualFeedbackProgramId;
+
+// Recompiles the programs from shaderfiles with --hot-reload-shaders
+bool hotReloadShaders = false;
+ShaderReloader shaderReloader;
 
 GLFWwindow* window = nullptr;
 
 // Declare functions
-void flipImageVertically(unsigned char* image, int width, int height, int channels);
 bool Initialize(int, char* [], GLFWwindow** window);
 void ResizeWindow(GLFWwindow* window, int width, int height);
 void ProcessInput(GLFWwindow* window);
@@ -207,13 +381,125 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
 void CreateTorusMesh(float innerRadius, float outerRadius, int sides, int rings, GLuint torusTexture, float shininess, const glm::vec3& specularColor, const glm::vec3& translation);
 void CreatePlane(float width, float height, GLuint planeTexture, float shininess, const glm::vec3& specularColor, const glm::vec3& translation);
 void CreateCubeMesh(float width, float height, float depth, GLuint leftSideTexture, GLuint rightSideTexture, GLuint frontTexture, GLuint backTexture, GLuint topTexture, GLuint bottomTexture,
-    float shininess, const glm::vec3& specularColor, const glm::vec3& translation, float rotation, vector<Cube>& cubes);
+    float shininess, const glm::vec3& specularColor, const glm::vec3& translation, float rotation, vector<Cube>& cubes, const AtlasRegion* faceRegions = nullptr);
 void CreateSphereMesh(float radius, GLuint sphereTextureID, float shininess, const glm::vec3& specularColor, const glm::vec3& translation);
 GLuint LoadTexture(const std::string& texturePath);
-void DestroyTexture(GLuint textureId);
+bool DecodeTexture(DecodedImage& image);
+bool DecodeBoxAtlas(DecodedImage& image);
+bool ComposeBoxAtlas(DecodedImage& image);
+bool DecodeVirtualTexturePixels(DecodedImage& image);
+bool DecodeTexturePixels(const string& path, DecodedImage& image);
+bool LoadCachedTexture(const TextureCacheKey& key, DecodedImage& image);
+void CompressTexture(const TextureCacheKey& key, DecodedImage& image);
+bool DropTextureLevels(DecodedImage& image);
+void StageTexture(DecodedImage& image);
+bool PlanBoxAtlas();
+void UploadTexture(DecodedImage& image);
+void FreeTexturePixels(DecodedImage& image);
+void BindSceneTexture(GLuint textureId);
+void RenderVirtualFeedback(const vector<Cube>& cubes, const glm::mat4& view, const glm::mat4& projection);
 void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const vector<LightCube>& lCubes);
 bool CreateShaders(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool CreateComputeShader(const char* computeShaderSource, GLuint& programId);
+bool CreateTessellationShaders(const char* vtxShaderSource, const char* tcsShaderSource, const char* tesShaderSource, const char* fragShaderSource, GLuint& programId);
 void DestroyShaders(GLuint programId);
+void SetSceneUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection);
+void SetSamplerUniforms(GLuint programId);
+uint32_t MaterialFeatures(const Material& material, int virtualTexture = -1);
+GLuint UseSceneVariant(uint32_t features, int lightCount);
+uint32_t TessellationShaderFeatures(int tier);
+vector<ReloadableStage> SceneVariantStages(const std::string& header);
+vector<ReloadableStage> VirtualFeedbackStages();
+vector<ReloadableStage> TessellationStages(uint32_t fragmentFeatures);
+void WatchSceneVariant(ShaderVariant& variant, const std::string& name, const std::string& header);
+void WatchShaderFiles();
+bool ExportShaders(const char* directory);
+void CreateSceneGeometry(vector<Cylinder>& cylinders, vector<Cube>& cubes, vector<LightCube>& lCubes);
+void DestroySceneGeometry(vector<Cylinder>& cylinders, vector<Cube>& cubes, vector<LightCube>& lCubes);
+void BenchmarkMeshCache();
+void BenchmarkTextureImport();
+void BenchmarkTextureCache();
+void BenchmarkProgramCache();
+void BenchmarkLighting(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const vector<LightCube>& lCubes);
+bool ValidateGpuGeometry();
+
+// Lighting shared by the object vertex and fragment shaders
+// ShaderVariants inserts it after the defines of both stages, the lighting tier's features pick the model
+const GLchar* lightingFunctionsSource = GLSL_LIBRARY(
+    // Point light properties
+    struct PointLight {
+        vec3 position;
+        vec3 color;
+        float intensity;
+        float ambientStrength;
+        float specularIntensity;
+        float highlightSize;
+    };
+
+    struct Material {
+        float shininess; // How shiny the material is, higher values give tighter, smaller highlights
+        vec3 specularColor; // Color of the specular reflection
+    };
+
+    // Features of this variant, defined by ShaderVariants; they are constants, so unused paths compile away
+    const bool specularLighting = SPECULAR != 0;      // adds the specular highlights
+    const bool blinnPhong = BLINN_PHONG != 0;         // Blinn-Phong with the per light invariants hoisted, otherwise the reference Phong loop
+    const bool vertexLighting = VERTEX_LIGHTING != 0; // lit per vertex by the vertex shader, the fragments interpolate the result
+
+    // Define an array of point lights, an unlit variant still declares one so the array is valid
+    uniform PointLight pointLights[max(LIGHT_COUNT, 1)];
+    uniform Material material;
+    uniform vec3 viewPosition;
+    uniform vec3 ambientLight; // ambient term of every light summed on the CPU, the same for every point
+
+    // Light reaching a surface point from every point light, to be multiplied with its color
+    vec3 Lighting(vec3 position, vec3 normal) {
+        // Initialize the components to 0
+        vec3 ambient = vec3(0.0f);
+        vec3 diffuse = vec3(0.0f);
+        vec3 specular = vec3(0.0f);
+
+        if (blinnPhong) {
+            // The normal and view direction are the same for every light
+            vec3 norm = normalize(normal);
+            vec3 viewDir = normalize(viewPosition - position);
+            float exponent = material.shininess * 4.0; // gives about the highlight size of the Phong exponent
+
+            for (int i = 0; i < LIGHT_COUNT; i++) {
+                vec3 lightDirection = normalize(pointLights[i].position - position);
+                vec3 radiance = pointLights[i].color * pointLights[i].intensity;
+                diffuse += max(dot(norm, lightDirection), 0.0) * radiance;
+                if (specularLighting)
+                    specular += pow(max(dot(norm, normalize(lightDirection + viewDir)), 0.0), exponent) * radiance;
+            }
+            return ambientLight + diffuse + specular * material.specularColor;
+        }
+
+        // Iterate over the lights
+        for (int i = 0; i < LIGHT_COUNT; i++) {
+
+            /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+
+            //Calculate Ambient lighting
+            ambient += pointLights[i].ambientStrength * pointLights[i].color * pointLights[i].intensity; // Generate ambient light color
+
+            //Calculate Diffuse lighting
+            vec3 norm = normalize(normal); // Normalize vectors to 1 unit
+            vec3 lightDirection = normalize(pointLights[i].position - position); // Calculate distance (light direction) between light source and fragments/pixels on cube
+            float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+            diffuse += impact * pointLights[i].color * pointLights[i].intensity; // Generate diffuse light color
+
+            //Calculate Specular lighting
+            if (specularLighting) {
+                vec3 viewDir = normalize(viewPosition - position); // Calculate view direction
+                vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+                vec3 spec = pointLights[i].color * material.specularColor * pointLights[i].intensity;
+                specular += spec * pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+            }
+        }
+        return ambient + diffuse + specular;
+    }
+);
 
 // Vertex Shader Source Code
 const GLchar* vertexShaderSource = GLSL(440,
@@ -224,6 +510,7 @@ const GLchar* vertexShaderSource = GLSL(440,
     out vec3 FragPos;        
     out vec3 Normal;      
     out vec2 vertexTextureCoordinate;
+    out vec3 VertexLight; // lighting of the vertex lighting tier, white in the others
 
     uniform mat4 model;
     uniform mat4 view;
@@ -233,6 +520,7 @@ const GLchar* vertexShaderSource = GLSL(440,
         FragPos = vec3(model * vec4(position, 1.0));
         Normal = mat3(transpose(inverse(model))) * normal;
         vertexTextureCoordinate = textureCoordinate;
+        VertexLight = vertexLighting && LIGHT_COUNT > 0 ? Lighting(FragPos, Normal) : vec3(1.0);
         gl_Position = projection * view * model * vec4(position, 1.0);
     }
 );
@@ -242,112 +530,318 @@ const GLchar* fragmentShaderSource = GLSL(440,
     in vec3 FragPos;
     in vec3 Normal;
     in vec2 vertexTextureCoordinate;
+    in vec3 VertexLight;
 
     out vec4 fragmentColor;
 
     uniform sampler2D uTexture;
     uniform vec2 uvScale;
-    uniform vec3 viewPosition;
 
-    // Point light properties
-    struct PointLight {
-        vec3 position;
-        vec3 color;
-        float intensity;
-        float ambientStrength;
-        float specularIntensity;
-        float highlightSize;
-    };
+    // Features of this variant, defined by ShaderVariants; the lighting ones are in lightingFunctionsSource
+    const bool textured = TEXTURED != 0;               // the surface samples a texture, otherwise it is baseColor
+    const bool virtualTextured = VIRTUAL_TEXTURE != 0; // samples the virtual texture instead of uTexture, see VirtualTextureSystem
+    uniform vec4 baseColor;
+
+    // Virtual texture
+    uniform sampler2D pageTable;     // per page and level: physical page x, y and the level it holds, alpha 0 while unmapped
+    uniform sampler2D physicalPages; // resident pages, each with a border of its neighbours
+    uniform vec2 virtualSize;        // texels of level 0
+    uniform int virtualLevels;       // 0 until the texture file is open
+    uniform vec4 pageLayout;         // page size, border, page size with border, physical cache size, all in texels
+
+    // Looks the page up in the page table and samples it in the physical cache
+    vec4 SampleVirtual(vec2 uv) {
+        const vec4 placeholder = vec4(0.5, 0.5, 0.5, 1.0); // same grey as the texture loader's placeholder
+        if (virtualLevels == 0)
+            return placeholder;
+
+        // Same level as the feedback pass asks for
+        vec2 texels = uv * virtualSize;
+        float lod = 0.5 * log2(max(max(dot(dFdx(texels), dFdx(texels)), dot(dFdy(texels), dFdy(texels))), 1e-8));
+        int level = clamp(int(floor(lod)), 0, virtualLevels - 1);
+        vec2 wrapped = fract(uv);
+        vec2 levelSize = max(vec2(1.0), floor(virtualSize / exp2(float(level))));
+        vec4 entry = texelFetch(pageTable, ivec2(wrapped * levelSize / pageLayout.x), level) * 255.0;
+        if (entry.a < 0.5)
+            return placeholder;
+
+        // The entry holds a coarser level while the page itself streams in
+        vec2 mappedSize = max(vec2(1.0), floor(virtualSize / exp2(floor(entry.b + 0.5))));
+        vec2 position = wrapped * mappedSize;
+        vec2 inPage = position - floor(position / pageLayout.x) * pageLayout.x;
+        vec2 physical = (floor(entry.rg + 0.5) * pageLayout.z + pageLayout.y + inPage) / pageLayout.w;
+        return textureLod(physicalPages, physical, 0.0);
+    }
 
-    struct Material {
-        float shininess; // How shiny the material is, higher values give tighter, smaller highlights
-        vec3 specularColor; // Color of the specular reflection
-    };
+    void main() {
+        vec2 scaledTextureCoordinate = vertexTextureCoordinate * uvScale;
 
-    // Define an array of point lights
-    const int NUM_POINT_LIGHTS = 3;
-    uniform PointLight pointLights[NUM_POINT_LIGHTS];
-    uniform Material material;
+        // Texture holds the color to be used for all three components, baseColor in untextured variants
+        vec4 textureColor = !textured ? baseColor : virtualTextured ? SampleVirtual(scaledTextureCoordinate) : texture(uTexture, scaledTextureCoordinate);
+
+        // Light reaching the fragment, interpolated between the vertices by the vertex lighting tier
+        // Variants without lights show the color unlit
+        vec3 lighting = LIGHT_COUNT == 0 ? vec3(1.0) : vertexLighting ? VertexLight : Lighting(FragPos, Normal);
+
+        fragmentColor = vec4(lighting * textureColor.xyz, 1.0); // Send lighting results to GPU
+    }
+);
 
+// Virtual texture feedback fragment shader, drawn with vertexShaderSource into the small feedback target
+// Writes the page and level each pixel samples: page x, page y, level, texture index + 1 (0 where nothing was drawn)
+const GLchar* virtualFeedbackFragmentShaderSource = GLSL(440,
+    in vec3 FragPos;
+    in vec3 Normal;
+    in vec2 vertexTextureCoordinate;
+
+    out vec4 feedback;
+
+    uniform vec2 uvScale;
+    uniform vec2 virtualSize;
+    uniform int virtualLevels;
+    uniform int virtualTextureIndex;
+    uniform float pageSize;
+    uniform float feedbackBias; // log2 of how much smaller the feedback target is than the window
 
     void main() {
-        // Initialize the components to 0
-        vec3 ambient = vec3(0.0f);
-        vec3 diffuse = vec3(0.0f);
-        vec3 specular = vec3(0.0f);
+        if (virtualLevels == 0)
+            discard;
+
+        // Same level as SampleVirtual, the target's larger pixels are corrected by feedbackBias
+        vec2 uv = vertexTextureCoordinate * uvScale;
+        vec2 texels = uv * virtualSize;
+        float lod = 0.5 * log2(max(max(dot(dFdx(texels), dFdx(texels)), dot(dFdy(texels), dFdy(texels))), 1e-8)) - feedbackBias;
+        int level = clamp(int(floor(lod)), 0, virtualLevels - 1);
+        vec2 levelSize = max(vec2(1.0), floor(virtualSize / exp2(float(level))));
+        vec2 page = floor(fract(uv) * levelSize / pageSize);
+        feedback = vec4(page, float(level), float(virtualTextureIndex + 1)) / 255.0;
+    }
+);
 
-        vec2 scaledTextureCoordinate = vertexTextureCoordinate * uvScale;
+// Surface functions shared by the compute and tessellation shaders
+// Same mappings as SphereSurface, TorusSurface, and CylinderSurface in parametric.h
+// The stage they are compiled with must declare surfaceKind and surfaceParams
+const GLchar* surfaceFunctionsSource = GLSL_LIBRARY(
+    const float PI = 3.14159265358979;
+    const float TWO_PI = 6.28318530717959;
+
+    void Evaluate(vec2 uv, out vec3 position, out vec3 normal, out vec2 texCoord) {
+        if (surfaceKind == 0) {
+            // Sphere, v runs from the top pole to the bottom pole
+            float theta = uv.y * PI;
+            float phi = uv.x * TWO_PI;
+            normal = vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+            position = surfaceParams.x * normal;
+            texCoord = vec2(uv.x, 1.0 - uv.y);
+        }
+        else if (surfaceKind == 1) {
+            // Torus, u goes around the tube and v goes around the ring
+            float theta = uv.y * TWO_PI;
+            float phi = uv.x * TWO_PI;
+            float ring = surfaceParams.y + surfaceParams.x * cos(phi);
+            position = vec3(ring * cos(theta), surfaceParams.x * sin(phi), ring * sin(theta));
+            normal = vec3(cos(phi) * cos(theta), sin(phi), cos(phi) * sin(theta));
+            texCoord = uv.yx;
+        }
+        else {
+            // Open cylinder around the Y axis
+            float angle = uv.x * TWO_PI;
+            position = vec3(surfaceParams.x * cos(angle), -surfaceParams.y * 0.5 + uv.y * surfaceParams.y, surfaceParams.x * sin(angle));
+            normal = vec3(cos(angle), 0.0, sin(angle));
+            texCoord = uv;
+        }
+    }
 
-        // Iterate over the lights
-        for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
+    // Tangent along increasing texture u, the continuous form of ComputeTangentFrames
+    vec4 Tangent(vec2 uv, vec3 normal) {
+        const float h = 0.0005;
+        vec3 pu0; vec3 pu1; vec3 pv0; vec3 pv1; vec3 n;
+        vec2 tu0; vec2 tu1; vec2 tv0; vec2 tv1;
+        Evaluate(uv - vec2(h, 0.0), pu0, n, tu0);
+        Evaluate(uv + vec2(h, 0.0), pu1, n, tu1);
+        Evaluate(uv - vec2(0.0, h), pv0, n, tv0);
+        Evaluate(uv + vec2(0.0, h), pv1, n, tv1);
+
+        vec3 dPdu = pu1 - pu0;
+        vec3 dPdv = pv1 - pv0;
+        vec2 dTdu = tu1 - tu0;
+        vec2 dTdv = tv1 - tv0;
+
+        vec3 t = vec3(0.0);
+        vec3 b = vec3(0.0);
+        float det = dTdu.x * dTdv.y - dTdv.x * dTdu.y;
+        if (abs(det) > 1e-12) {
+            t = (dPdu * dTdv.y - dPdv * dTdu.y) / det;
+            b = (dPdv * dTdu.x - dPdu * dTdv.x) / det;
+        }
 
-            /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+        t -= normal * dot(normal, t);
+        if (dot(t, t) < 1e-12) {
+            vec3 axis = abs(normal.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+            t = cross(axis, normal);
+        }
+        t = normalize(t);
+        return vec4(t, dot(cross(normal, t), b) < 0.0 ? -1.0 : 1.0);
+    }
+);
 
-            //Calculate Ambient lighting
-            ambient += pointLights[i].ambientStrength * pointLights[i].color * pointLights[i].intensity; // Generate ambient light color
+// Surface Compute Shader Source Code
+const GLchar* surfaceComputeShaderSource = GLSL(440,
+    layout(local_size_x = 64) in;
 
-            //Calculate Diffuse lighting
-            vec3 norm = normalize(Normal); // Normalize vectors to 1 unit
-            vec3 lightDirection = normalize(pointLights[i].position - FragPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-            float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-            diffuse += impact * pointLights[i].color * pointLights[i].intensity; // Generate diffuse light color
+    // Interleaved SurfaceVertex data, 12 floats: position, normal, texture coords, tangent
+    layout(std430, binding = 0) writeonly buffer SurfaceVertices { float vertexData[]; };
+    layout(std430, binding = 1) writeonly buffer SurfaceIndices { uint indexData[]; };
 
-            //Calculate Specular lighting
-            vec3 viewDir = normalize(viewPosition - FragPos); // Calculate view direction
-            vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-            //Calculate specular component
-            float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), pointLights[i].highlightSize);
-            vec3 spec = pointLights[i].color * material.specularColor * pointLights[i].intensity;
-            specular += spec * pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    uniform int surfaceKind;   // GpuSurfaceKind
+    uniform vec4 surfaceParams;
+    uniform ivec2 segments;    // quads along u and v
+
+    void Evaluate(vec2 uv, out vec3 position, out vec3 normal, out vec2 texCoord);
+    vec4 Tangent(vec2 uv, vec3 normal);
+
+    void main() {
+        uint id = gl_GlobalInvocationID.x;
+        uint columns = uint(segments.x) + 1u;
+
+        // One vertex per invocation
+        if (id < columns * uint(segments.y + 1)) {
+            vec2 uv = vec2(float(id % columns) / float(segments.x), float(id / columns) / float(segments.y));
+            vec3 position;
+            vec3 normal;
+            vec2 texCoord;
+            Evaluate(uv, position, normal, texCoord);
+            vec4 tangent = Tangent(uv, normal);
+
+            uint base = id * 12u;
+            vertexData[base + 0u] = position.x;
+            vertexData[base + 1u] = position.y;
+            vertexData[base + 2u] = position.z;
+            vertexData[base + 3u] = normal.x;
+            vertexData[base + 4u] = normal.y;
+            vertexData[base + 5u] = normal.z;
+            vertexData[base + 6u] = texCoord.x;
+            vertexData[base + 7u] = texCoord.y;
+            vertexData[base + 8u] = tangent.x;
+            vertexData[base + 9u] = tangent.y;
+            vertexData[base + 10u] = tangent.z;
+            vertexData[base + 11u] = tangent.w;
         }
 
-        // Texture holds the color to be used for all three components
-        vec4 textureColor = texture(uTexture, scaledTextureCoordinate);
+        // Two triangles per quad; a/b are on row i, c/d are on row i + 1
+        if (id < uint(segments.x * segments.y)) {
+            uint a = (id / uint(segments.x)) * columns + id % uint(segments.x);
+            uint c = a + columns;
+            uint base = id * 6u;
+            indexData[base + 0u] = a;
+            indexData[base + 1u] = c;
+            indexData[base + 2u] = a + 1u;
+            indexData[base + 3u] = c;
+            indexData[base + 4u] = c + 1u;
+            indexData[base + 5u] = a + 1u;
+        }
+    }
+);
+
+// Vertex shader for tessellated surfaces, the patch corners are only surface coordinates
+const GLchar* surfaceTessVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec2 patchCorner;
 
-        // Calculate phong result
-        vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
+    out vec2 surfaceCoordinate;
 
-        fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+    void main() {
+        surfaceCoordinate = patchCorner;
     }
 );
 
-// vertex shader code for light cubes
-const GLchar* lightVertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position;
+// Tessellation control shader, picks the levels of each patch from its projected edge lengths
+const GLchar* surfaceTessControlShaderSource = GLSL(440,
+    layout(vertices = 4) out;
+
+    in vec2 surfaceCoordinate[];
+    out vec2 patchCoordinate[];
 
     uniform mat4 model;
     uniform mat4 view;
     uniform mat4 projection;
+    uniform int surfaceKind;     // GpuSurfaceKind
+    uniform vec4 surfaceParams;
+    uniform vec2 viewportSize;   // framebuffer size in pixels
+    uniform float pixelsPerEdge; // target on screen length of a generated edge
+    uniform float maxTessLevel;
 
-    void main() {
-        gl_Position = projection * view * model * vec4(position, 1.0);
+    void Evaluate(vec2 uv, out vec3 position, out vec3 normal, out vec2 texCoord);
+
+    // Pixel position of a surface point, points behind the eye are clamped to a tiny w and get the maximum level
+    vec2 ScreenPosition(vec2 uv) {
+        vec3 position;
+        vec3 normal;
+        vec2 texCoord;
+        Evaluate(uv, position, normal, texCoord);
+        vec4 clip = projection * view * model * vec4(position, 1.0);
+        return clip.xy / max(clip.w, 0.001) * 0.5 * viewportSize;
     }
-);
 
-// fragment shader code for light cubes
-const GLchar* lightFragmentShaderSource = GLSL(440,
-    out vec4 fragmentColor;
+    // Level of the edge between two corners, measured through its midpoint so the curvature counts
+    // Swapping a and b gives the same result, so both patches sharing the edge agree
+    float EdgeLevel(vec2 a, vec2 b) {
+        vec2 p0 = ScreenPosition(a);
+        vec2 p1 = ScreenPosition((a + b) * 0.5);
+        vec2 p2 = ScreenPosition(b);
+        return clamp((distance(p0, p1) + distance(p1, p2)) / pixelsPerEdge, 1.0, maxTessLevel);
+    }
 
     void main() {
-        fragmentColor = vec4(1.0); // Set the color of the light representation (e.g., white)
+        patchCoordinate[gl_InvocationID] = surfaceCoordinate[gl_InvocationID];
+
+        if (gl_InvocationID == 0) {
+            // Outer levels follow the domain edges u = 0, v = 0, u = 1, v = 1
+            gl_TessLevelOuter[0] = EdgeLevel(surfaceCoordinate[0], surfaceCoordinate[3]);
+            gl_TessLevelOuter[1] = EdgeLevel(surfaceCoordinate[0], surfaceCoordinate[1]);
+            gl_TessLevelOuter[2] = EdgeLevel(surfaceCoordinate[1], surfaceCoordinate[2]);
+            gl_TessLevelOuter[3] = EdgeLevel(surfaceCoordinate[3], surfaceCoordinate[2]);
+            gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+            gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+        }
     }
 );
 
-// Flips loaded texture images to assign Y-axis going down instead of up
-void flipImageVertically(unsigned char* image, int width, int height, int channels) {
-    for (int j = 0; j < height / 2; ++j) {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i) {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
+// Tessellation evaluation shader, places every generated point exactly on the surface
+// Writes the same outputs as the object vertex shader so the object fragment shader is reused
+const GLchar* surfaceTessEvaluationShaderSource = GLSL(440,
+    layout(quads, fractional_odd_spacing, ccw) in;
+
+    in vec2 patchCoordinate[];
+
+    out vec3 FragPos;
+    out vec3 Normal;
+    out vec2 vertexTextureCoordinate;
+    out vec3 VertexLight; // always lit per fragment here
+
+    uniform mat4 model;
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform int surfaceKind;
+    uniform vec4 surfaceParams;
+
+    void Evaluate(vec2 uv, out vec3 position, out vec3 normal, out vec2 texCoord);
+
+    void main() {
+        vec2 bottom = mix(patchCoordinate[0], patchCoordinate[1], gl_TessCoord.x);
+        vec2 top = mix(patchCoordinate[3], patchCoordinate[2], gl_TessCoord.x);
+
+        vec3 position;
+        vec3 normal;
+        vec2 texCoord;
+        Evaluate(mix(bottom, top, gl_TessCoord.y), position, normal, texCoord);
+
+        FragPos = vec3(model * vec4(position, 1.0));
+        Normal = mat3(transpose(inverse(model))) * normal;
+        vertexTextureCoordinate = texCoord;
+        VertexLight = vec3(1.0);
+        gl_Position = projection * view * vec4(FragPos, 1.0);
     }
-}
+);
 
 /*
 * Initialize the GLFW library and create a window
@@ -406,6 +900,8 @@ void ResizeWindow(GLFWwindow* window, int width, int height) {
 * WSAD to navigate forward, backward, left and right
 * QE to navigate up and down
 * P to switch between Ortho and Perspective
+* T to cycle the texture quality tiers
+* L to cycle the lighting tiers
 */
 // Processes the keyboard inputs
 void ProcessInput(GLFWwindow* window) {
@@ -427,6 +923,24 @@ void ProcessInput(GLFWwindow* window) {
         camera.ProcessKeyboard(DOWNWARDS, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
         camera.ToggleViewMode();
+
+    // One tier per press, the textures are not touched
+    static bool qualityKeyDown = false;
+    bool qualityKeyPressed = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (qualityKeyPressed && !qualityKeyDown) {
+        textureSamplers.SetTier((textureSamplers.Tier() + 1) % TEXTURE_QUALITY_TIER_COUNT);
+        cout << "Texture quality: " << textureSamplers.TierName() << endl;
+    }
+    qualityKeyDown = qualityKeyPressed;
+
+    // The variants of a tier compile the first time it is drawn
+    static bool lightingKeyDown = false;
+    bool lightingKeyPressed = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (lightingKeyPressed && !lightingKeyDown) {
+        lightingTier = (lightingTier + 1) % LIGHTING_TIER_COUNT;
+        cout << "Lighting: " << LIGHTING_TIERS[lightingTier].name << endl;
+    }
+    lightingKeyDown = lightingKeyPressed;
 }
 
 // callback function when mouse moves
@@ -452,9 +966,79 @@ void MouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
 
+// Describes interleaved SurfaceVertex data (position, normal, texture coords, tangent) for the mesh cache
+MeshStreamView SurfaceVertexStream(uint32_t part, const vector<SurfaceVertex>& vertices) {
+    return VertexStream(part, vertices.data(), vertices.size(), sizeof(SurfaceVertex), {
+        { 0, 3, offsetof(SurfaceVertex, Position) },
+        { 1, 3, offsetof(SurfaceVertex, Normal) },
+        { 2, 2, offsetof(SurfaceVertex, TexCoords) },
+        { 3, 4, offsetof(SurfaceVertex, Tangent) }
+    });
+}
+
+// Bounds of an interleaved SurfaceVertex stream, either freshly generated or read from the mesh cache
+SurfaceBounds SurfaceStreamBounds(const MeshStreamView& stream) {
+    return ComputeBounds(static_cast<const SurfaceVertex*>(stream.data), stream.Count());
+}
+
+// True when the sphere, torus, and cylinder sides should be generated by the compute shader
+// CPU consumers of the geometry need the CPU generators, so they switch the GPU path off
+bool UseGpuGeometry() {
+    return gpuGeometry && gpuSurfaces.IsReady() && !GeometryResidency::Get().RetainsCpuCopies();
+}
+
+/*
+* Creates the VAO, VBO, and EBO of a parametric surface and fills them with the compute shader
+* The vertex layout matches SurfaceVertexStream so both paths draw the same way
+* @return the number of indices to draw
+*/
+unsigned int CreateGpuSurface(GpuSurfaceKind kind, const glm::vec4& params, int uSegments, int vSegments, GLuint& vao, GLuint& vbo, GLuint& ebo) {
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    unsigned int indexCount = gpuSurfaces.Generate(kind, params, uSegments, vSegments, vbo, ebo);
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, Position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, TexCoords));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, Tangent));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return indexCount;
+}
+
+// True when the sphere, torus, and cylinder sides are drawn as tessellated patches
+bool UseTessellation() {
+    return tessellateSurfaces && surfaceTessellator.IsReady();
+}
+
+// Clusters a generated surface into meshlets, meshletIndices receives the index buffer in meshlet order
+void BuildSurfaceMeshlets(const vector<SurfaceVertex>& vertices, const vector<GLuint>& indices, vector<GLuint>& meshletIndices, vector<Meshlet>& meshlets) {
+    BuildMeshlets(vertices.data(), vertices.size(), sizeof(SurfaceVertex), offsetof(SurfaceVertex, Position), offsetof(SurfaceVertex, Normal),
+        indices.data(), indices.size(), meshletIndices, meshlets);
+}
+
+// Copies one attribute of an uploaded stream to the CPU only if the geometry residency policy asks for it
+template <typename T>
+void RetainStream(GeometryCategory category, const MeshStreamView* stream, vector<T>& out, size_t offset = 0) {
+    GeometryResidency& residency = GeometryResidency::Get();
+    residency.Account(category, size_t(stream->Count()) * sizeof(T), residency.RetainsCpuCopies());
+    if (residency.RetainsCpuCopies())
+        CopyStream(stream, out, offset);
+}
+
 /*
 * Method to create the mesh for a cylinder
 * Creates vertices for the sides and top/bottom circles separately 
+* The sides are a CylinderSurface generated by ParametricSurface
 * Creates indices for sides and top/bottom circles separately
 * Creates VAO's, VBO's, and EBO's objects and binds them
 * Store the VAO's, VBO's, index count, Texture ID's and model matrix for later use
@@ -470,162 +1054,138 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
     // Vectors to hold data
     vector<glm::vec3> verticesTop;
     vector<glm::vec3> verticesBottom;
-    vector<glm::vec3> verticesSides;
+    vector<SurfaceVertex> verticesSides;
     vector<glm::vec2> texCoordsTop;
     vector<glm::vec2> texCoordsBottom;
-    vector<glm::vec2> texCoordsSides;
     vector<glm::vec3> normalsTop;
     vector<glm::vec3> normalsBottom;
-    vector<glm::vec3> normalsSides;
     vector<unsigned int> cylinderTopIndices;
     vector<unsigned int> cylinderBottomIndices;
     vector<unsigned int> cylinderSidesIndices;
 
     Cylinder cylinder;
 
-    // Variables to hold data
-    float sectorStep = 2 * glm::pi<float>() / sectors;
-    float stackStep = height / stacks;
-    float sectorAngle, x, y, z;
-
-    // Create vertices for the top circle of the cylinder
-    for (int j = 0; j <= sectors; ++j) {
-        sectorAngle = j * sectorStep;
-        x = radius * glm::cos(sectorAngle);
-        y = height / 2.0f;
-        z = radius * glm::sin(sectorAngle);
-        verticesTop.push_back(glm::vec3(x, y, z));
-
-        // Calculate the texture coordinates based on normalized polar coordinates
-        float u = (glm::cos(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
-        float v = (glm::sin(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
-        texCoordsTop.push_back(glm::vec2(u, v));
-    }
-
-    // Create normals for the top circle of the cylinder
-    for (int j = 0; j <= sectors; ++j) {
-        // All normals for the top circle point straight up (0, 1, 0)
-        normalsTop.push_back(glm::vec3(0, 1, 0));
-    }
-
-    // Create vertices for the bottom circle of the cylinder
-    for (int j = 0; j <= sectors; ++j) {
-        sectorAngle = j * sectorStep;
-        x = radius * glm::cos(sectorAngle);
-        y = -height / 2.0f;
-        z = radius * glm::sin(sectorAngle);
-        verticesBottom.push_back(glm::vec3(x, y, z));
-
-        // Calculate the texture coordinates based on normalized polar coordinates
-        float u = (glm::cos(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
-        float v = (-glm::sin(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
-        texCoordsBottom.push_back(glm::vec2(u, v));
-    }
+    // Parts of the cylinder stored in the mesh cache
+    const uint32_t SIDES = 0, TOP = 1, BOTTOM = 2;
 
-    // Create normals for the bottom circle of the cylinder
-    for (int j = 0; j <= sectors; ++j) {
-        normalsBottom.push_back(glm::vec3(0, -1, 0));
-    }
+    // On the GPU path the compute shader makes the sides, so they are neither generated nor cached here
+    bool gpuSides = UseGpuGeometry();
 
-    // Create vertices for the side surfaces of the cylinder and texture coordinates
-    for (int i = 0; i <= stacks; ++i) {
-        float stackHeight = -height / 2.0f + i * stackStep;
+    // Reuse the cached geometry if this cylinder was generated on an earlier launch
+    MeshCacheKey cacheKey(gpuSides ? "cylindercaps" : "cylinder", 2);
+    cacheKey.Add(radius).Add(height).Add(sectors).Add(stacks);
+    MeshCache cache;
+    if (!cache.Load(cacheKey)) {
+        // Variables to hold data
+        float sectorStep = 2 * glm::pi<float>() / sectors;
+        float sectorAngle, x, y, z;
 
+        // Create vertices for the top circle of the cylinder
         for (int j = 0; j <= sectors; ++j) {
             sectorAngle = j * sectorStep;
             x = radius * glm::cos(sectorAngle);
-            y = stackHeight;
+            y = height / 2.0f;
             z = radius * glm::sin(sectorAngle);
+            verticesTop.push_back(glm::vec3(x, y, z));
 
-            verticesSides.push_back(glm::vec3(x, y, z));
+            // Calculate the texture coordinates based on normalized polar coordinates
+            float u = (glm::cos(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
+            float v = (glm::sin(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
+            texCoordsTop.push_back(glm::vec2(u, v));
+        }
 
-            // Calculate the texture coordinates for sides based on normalized polar coordinates
-            float u = static_cast<float>(j) / sectors;
-            float v = (y + height / 2.0f) / height;
-            texCoordsSides.push_back(glm::vec2(u, v));
+        // Create normals for the top circle of the cylinder
+        for (int j = 0; j <= sectors; ++j) {
+            // All normals for the top circle point straight up (0, 1, 0)
+            normalsTop.push_back(glm::vec3(0, 1, 0));
         }
-    }
 
-    // Create normals for the side surfaces of the cylinder
-    for (int i = 0; i <= stacks; ++i) {
+        // Create vertices for the bottom circle of the cylinder
         for (int j = 0; j <= sectors; ++j) {
             sectorAngle = j * sectorStep;
             x = radius * glm::cos(sectorAngle);
-            y = 0;
+            y = -height / 2.0f;
             z = radius * glm::sin(sectorAngle);
+            verticesBottom.push_back(glm::vec3(x, y, z));
 
-            // Normalizing the vector to get the normal
-            glm::vec3 normal = glm::normalize(glm::vec3(x, y, z));
-            normalsSides.push_back(normal);
+            // Calculate the texture coordinates based on normalized polar coordinates
+            float u = (glm::cos(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
+            float v = (-glm::sin(sectorAngle) + 1.0f) * 0.5f; // Range: [0, 1]
+            texCoordsBottom.push_back(glm::vec2(u, v));
         }
-    }
-
-    // Create indices for the bottom circle
-    int bottomCenterIndex = verticesBottom.size() - 1; // Index of the center of the bottom circle
-    int bottomOffset = bottomCenterIndex - sectors; // Offset for the bottom circle vertices
 
-    for (int j = 0; j < sectors; ++j) {
-        cylinderBottomIndices.push_back(bottomCenterIndex);
-        cylinderBottomIndices.push_back(bottomOffset + j);
-        cylinderBottomIndices.push_back(bottomOffset + (j + 1) % sectors);
-    }
+        // Create normals for the bottom circle of the cylinder
+        for (int j = 0; j <= sectors; ++j) {
+            normalsBottom.push_back(glm::vec3(0, -1, 0));
+        }
 
-    // Create indices for the top circle
-    int topCenterIndex = verticesTop.size() - 1; // Index of the center of the top circle
-    int topOffset = topCenterIndex - sectors; // Offset for the top circle vertices
+        // Create indices for the bottom circle
+        int bottomCenterIndex = verticesBottom.size() - 1; // Index of the center of the bottom circle
+        int bottomOffset = bottomCenterIndex - sectors; // Offset for the bottom circle vertices
 
-    for (int j = 0; j < sectors; ++j) {
-        cylinderTopIndices.push_back(topCenterIndex);
-        cylinderTopIndices.push_back(topOffset + (j + 1) % sectors);
-        cylinderTopIndices.push_back(topOffset + j);
-    }
+        for (int j = 0; j < sectors; ++j) {
+            cylinderBottomIndices.push_back(bottomCenterIndex);
+            cylinderBottomIndices.push_back(bottomOffset + j);
+            cylinderBottomIndices.push_back(bottomOffset + (j + 1) % sectors);
+        }
 
-    // Create indices for the side surface
-    int k1, k2;
-    for (int i = 0; i < stacks; ++i) {
-        k1 = i * (sectors + 1);
-        k2 = k1 + sectors + 1;
+        // Create indices for the top circle
+        int topCenterIndex = verticesTop.size() - 1; // Index of the center of the top circle
+        int topOffset = topCenterIndex - sectors; // Offset for the top circle vertices
 
-        for (int j = 0; j < sectors; ++j, ++k1, ++k2) {
-            cylinderSidesIndices.push_back(k1);
-            cylinderSidesIndices.push_back(k1 + 1);
-            cylinderSidesIndices.push_back(k2);
+        for (int j = 0; j < sectors; ++j) {
+            cylinderTopIndices.push_back(topCenterIndex);
+            cylinderTopIndices.push_back(topOffset + (j + 1) % sectors);
+            cylinderTopIndices.push_back(topOffset + j);
+        }
 
-            cylinderSidesIndices.push_back(k2);
-            cylinderSidesIndices.push_back(k1 + 1);
-            cylinderSidesIndices.push_back(k2 + 1);
+        // Write the generated geometry to the cache for the next launch
+        vector<MeshStreamView> streams = {
+            VertexStream(TOP, verticesTop.data(), verticesTop.size(), sizeof(glm::vec3), { { 0, 3, 0 } }),
+            VertexStream(TOP, normalsTop.data(), normalsTop.size(), sizeof(glm::vec3), { { 1, 3, 0 } }),
+            VertexStream(TOP, texCoordsTop.data(), texCoordsTop.size(), sizeof(glm::vec2), { { 2, 2, 0 } }),
+            IndexStream(TOP, cylinderTopIndices.data(), cylinderTopIndices.size()),
+            VertexStream(BOTTOM, verticesBottom.data(), verticesBottom.size(), sizeof(glm::vec3), { { 0, 3, 0 } }),
+            VertexStream(BOTTOM, normalsBottom.data(), normalsBottom.size(), sizeof(glm::vec3), { { 1, 3, 0 } }),
+            VertexStream(BOTTOM, texCoordsBottom.data(), texCoordsBottom.size(), sizeof(glm::vec2), { { 2, 2, 0 } }),
+            IndexStream(BOTTOM, cylinderBottomIndices.data(), cylinderBottomIndices.size())
+        };
+        if (!gpuSides) {
+            // Create vertices, normals, texture coordinates, and indices for the side surface
+            ParametricSurface<CylinderSurface> sides({ radius, height }, sectors, stacks);
+            sides.Generate(verticesSides, cylinderSidesIndices);
+            streams.push_back(SurfaceVertexStream(SIDES, verticesSides));
+            streams.push_back(IndexStream(SIDES, cylinderSidesIndices.data(), cylinderSidesIndices.size()));
         }
+        cache.Store(cacheKey, streams);
     }
 
-    // Create and bind vertex array object for the sides (VAO)
-    glGenVertexArrays(1, &cylinder.cylinderSidesVAO);
-    glBindVertexArray(cylinder.cylinderSidesVAO);
-
-    // Create vertex buffer object (VBO) for sides vertices
-    glGenBuffers(1, &cylinder.cylinderSideVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideVBO);
-    glBufferData(GL_ARRAY_BUFFER, verticesSides.size() * sizeof(glm::vec3), verticesSides.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-    // Create vertex buffer object (VBO) for side normals
-    glGenBuffers(1, &cylinder.cylinderSideNormalsVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideNormalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, normalsSides.size() * sizeof(glm::vec3), normalsSides.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-    // Create vertex buffer object (VBO) for texture coordinates of the sides
-    glGenBuffers(1, &cylinder.cylinderSideTexture);
-    glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideTexture);
-    glBufferData(GL_ARRAY_BUFFER, texCoordsSides.size() * sizeof(glm::vec2), texCoordsSides.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-    // Create element buffer object (EBO) for indices of sides
-    glGenBuffers(1, &cylinder.cylinderSidesEBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinder.cylinderSidesEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinderSidesIndices.size() * sizeof(unsigned int), cylinderSidesIndices.data(), GL_STATIC_DRAW);
+    if (gpuSides) {
+        // Generate the sides straight into their GPU buffers with the compute shader, the caps still come from the cache
+        cylinder.cylinderSidesIndices = CreateGpuSurface(GPU_SURFACE_CYLINDER, glm::vec4(radius, height, 0.0f, 0.0f), sectors, stacks,
+            cylinder.cylinderSidesVAO, cylinder.cylinderSideVBO, cylinder.cylinderSidesEBO);
+        cylinder.bounds = CylinderSurface{ radius, height }.Bounds();
+    }
+    else {
+        // Create and bind vertex array object for the sides (VAO)
+        glGenVertexArrays(1, &cylinder.cylinderSidesVAO);
+        glBindVertexArray(cylinder.cylinderSidesVAO);
+
+        // Create vertex buffer object (VBO) for the interleaved side vertices, normals, and texture coordinates
+        glGenBuffers(1, &cylinder.cylinderSideVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideVBO);
+        UploadStream(*cache.Vertices(SIDES, 0));
+
+        // Create element buffer object (EBO) for indices of sides
+        glGenBuffers(1, &cylinder.cylinderSidesEBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinder.cylinderSidesEBO);
+        UploadStream(*cache.Indices(SIDES));
+        cylinder.cylinderSidesIndices = cache.Indices(SIDES)->Count();
+
+        RetainStream(GEOMETRY_CYLINDER, cache.Vertices(SIDES, 0), cylinder.verticesSides, offsetof(SurfaceVertex, Position));
+        RetainStream(GEOMETRY_CYLINDER, cache.Vertices(SIDES, 0), cylinder.normalsSides, offsetof(SurfaceVertex, Normal));
+        cylinder.bounds = SurfaceStreamBounds(*cache.Vertices(SIDES, 0));
+    }
 
     // Create and bind vertex array object for the top circle (VAO)
     glGenVertexArrays(1, &cylinder.cylinderTopVAO);
@@ -634,28 +1194,22 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
     // Create vertex buffer object (VBO) for top vertices
     glGenBuffers(1, &cylinder.cylinderTopVBO);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderTopVBO);
-    glBufferData(GL_ARRAY_BUFFER, verticesTop.size() * sizeof(glm::vec3), verticesTop.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(TOP, 0));
 
     // Create vertex buffer object (VBO) for top normals
     glGenBuffers(1, &cylinder.cylinderTopNormalsVBO);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderTopNormalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, normalsTop.size() * sizeof(glm::vec3), normalsTop.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(TOP, 1));
 
     // Create vertex buffer object (VBO) for texture coordinates of the top circle
     glGenBuffers(1, &cylinder.cylinderTopTexture);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderTopTexture);
-    glBufferData(GL_ARRAY_BUFFER, texCoordsTop.size() * sizeof(glm::vec2), texCoordsTop.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(TOP, 2));
 
     // Create element buffer object (EBO) for indices of the top circle
     glGenBuffers(1, &cylinder.cylinderTopEBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinder.cylinderTopEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinderTopIndices.size() * sizeof(unsigned int), cylinderTopIndices.data(), GL_STATIC_DRAW);
+    UploadStream(*cache.Indices(TOP));
 
     // Create and bind vertex array object for the bottom circle (VAO)
     glGenVertexArrays(1, &cylinder.cylinderBottomVAO);
@@ -664,28 +1218,22 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
     // Create vertex buffer object (VBO) for bottom vertices
     glGenBuffers(1, &cylinder.cylinderBottomVBO);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderBottomVBO);
-    glBufferData(GL_ARRAY_BUFFER, verticesBottom.size() * sizeof(glm::vec3), verticesBottom.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(BOTTOM, 0));
 
     // Create vertex buffer object (VBO) for bottom normals
     glGenBuffers(1, &cylinder.cylinderBottomNormalsVBO);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderBottomNormalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, normalsBottom.size() * sizeof(glm::vec3), normalsBottom.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(BOTTOM, 1));
 
     // Create vertex buffer object (VBO) for texture coordinates of the bottom circle
     glGenBuffers(1, &cylinder.cylinderBottomTexture);
     glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderBottomTexture);
-    glBufferData(GL_ARRAY_BUFFER, texCoordsBottom.size() * sizeof(glm::vec2), texCoordsBottom.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    UploadStream(*cache.Vertices(BOTTOM, 2));
 
     // Create element buffer object (EBO) for indices of the bottom circle
     glGenBuffers(1, &cylinder.cylinderBottomEBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinder.cylinderBottomEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinderBottomIndices.size() * sizeof(unsigned int), cylinderBottomIndices.data(), GL_STATIC_DRAW);
+    UploadStream(*cache.Indices(BOTTOM));
 
     // Unbind VAO
     glBindVertexArray(0);
@@ -695,27 +1243,27 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
     cylinder.CylinderMatrices.push_back(modelMatrix);
 
     // Store all coords and push to cylinders Struct Object for later use
-    cylinder.verticesTop = verticesTop;
-    cylinder.verticesBottom = verticesBottom;
-    cylinder.verticesSides = verticesSides;
-    cylinder.cylinderTopIndices = cylinderTopIndices.size();
-    cylinder.cylinderBottomIndices = cylinderBottomIndices.size();
-    cylinder.cylinderSidesIndices = cylinderSidesIndices.size();
+    RetainStream(GEOMETRY_CYLINDER, cache.Vertices(TOP, 0), cylinder.verticesTop);
+    RetainStream(GEOMETRY_CYLINDER, cache.Vertices(BOTTOM, 0), cylinder.verticesBottom);
+    cylinder.cylinderTopIndices = cache.Indices(TOP)->Count();
+    cylinder.cylinderBottomIndices = cache.Indices(BOTTOM)->Count();
     cylinder.sideTextureID = sideTexture;
     cylinder.topBottomTextureID = topBottomCircleTexture;
-    cylinder.normalsTop = normalsTop;
-    cylinder.normalsBottom = normalsBottom;
-    cylinder.normalsSides = normalsSides;
+    RetainStream(GEOMETRY_CYLINDER, cache.Vertices(TOP, 1), cylinder.normalsTop);
+    RetainStream(GEOMETRY_CYLINDER, cache.Vertices(BOTTOM, 1), cylinder.normalsBottom);
     cylinder.cylMaterial.shininess = shininess;
     cylinder.cylMaterial.specularColor = specularColor;
 
+    // Coarse patches for the tessellated sides, the shader adds the detail
+    if (UseTessellation())
+        cylinder.sidePatches = CreateSurfacePatches(GPU_SURFACE_CYLINDER, glm::vec4(radius, height, 0.0f, 0.0f), 16, 1);
+
     cylinders.push_back(cylinder);
 }
 
 /*
 * Method to create the mesh for a torus
-* Creates vertices, normals, and UV coords
-* Calculates the vertex
+* Creates vertices, normals, and UV coords from a TorusSurface
 * Creates indices
 * Creates VAO, VBO, and EBO objects and binds them
 * Store the VAO, VBOs, index count, and model matrix for later use
@@ -727,107 +1275,75 @@ void CreateCylinderMesh(float radius, float height, int sectors, int stacks, GLu
           transformation: the translation that should be applied to the object
 */
 void CreateTorusMesh(float innerRadius, float outerRadius, int sides, int rings, GLuint torusTextureID, float shininess, const glm::vec3& specularColor, const glm::vec3& translation) {
-    // Calculate the necessary values    
-    float thetaStep = 2.0f * glm::pi<float>() / rings;
-    float phiStep = 2.0f * glm::pi<float>() / sides;
-
     // Data containers for vertices and indices
-    vector<glm::vec3> vertices;
-    vector<glm::vec2> texCoords;
+    vector<SurfaceVertex> vertices;
     vector<unsigned int> indices;
-    vector<glm::vec3> normals;
-
-    // Create vertices, normals, and texture coordinates
-    for (int i = 0; i <= rings; ++i) {
-        float theta = i * thetaStep;
-
-        for (int j = 0; j <= sides; ++j) {
-            float phi = j * phiStep;
-
-            // Calculate the coordinates of each vertex
-            float x = (outerRadius + innerRadius * glm::cos(phi)) * glm::cos(theta);
-            float y = innerRadius * glm::sin(phi);
-            float z = (outerRadius + innerRadius * glm::cos(phi)) * glm::sin(theta);
-
-            vertices.push_back(glm::vec3(x, y, z));
-
-            // Calculate the normals
-            glm::vec3 tubeCenter = glm::vec3(outerRadius * glm::cos(theta), 0, outerRadius * glm::sin(theta));
-            glm::vec3 normal = glm::normalize(glm::vec3(x, y, z) - tubeCenter);
-            normals.push_back(normal);
-
-            // Calculate the texture coordinates
-            float u = static_cast<float>(i) / rings;
-            float v = static_cast<float>(j) / sides;
-            texCoords.push_back(glm::vec2(u, v));
-        }
+    vector<GLuint> meshletIndices;
+    vector<Meshlet> meshlets;
+
+    if (UseGpuGeometry()) {
+        // Generate the torus straight into its GPU buffers with the compute shader
+        torus.torusIndices = CreateGpuSurface(GPU_SURFACE_TORUS, glm::vec4(innerRadius, outerRadius, 0.0f, 0.0f), sides, rings, torus.torusVAO, torus.torusVBO, torus.torusEBO);
+        torus.bounds = TorusSurface{ innerRadius, outerRadius }.Bounds();
+        torus.meshlets = { WholeMeshMeshlet(torus.torusIndices, torus.bounds.center, torus.bounds.radius) };
     }
-
-    // Create indices
-    for (int i = 0; i < rings; ++i) {
-        for (int j = 0; j < sides; ++j) {
-            int first = i * (sides + 1) + j;
-            int second = first + sides + 1;
-
-            indices.push_back(first);
-            indices.push_back(second);
-            indices.push_back(first + 1);
-
-            indices.push_back(second);
-            indices.push_back(second + 1);
-            indices.push_back(first + 1);
+    else {
+        // Reuse the cached geometry if this torus was generated on an earlier launch
+        MeshCacheKey cacheKey("torus", 3);
+        cacheKey.Add(innerRadius).Add(outerRadius).Add(sides).Add(rings);
+        MeshCache cache;
+        if (!cache.Load(cacheKey)) {
+            // Create vertices, normals, texture coordinates, and indices
+            ParametricSurface<TorusSurface> surface({ innerRadius, outerRadius }, sides, rings);
+            surface.Generate(vertices, indices);
+
+            // Split the torus into meshlets and store the indices in meshlet order
+            BuildSurfaceMeshlets(vertices, indices, meshletIndices, meshlets);
+
+            // Write the generated geometry to the cache for the next launch
+            cache.Store(cacheKey, {
+                SurfaceVertexStream(0, vertices),
+                IndexStream(0, meshletIndices.data(), meshletIndices.size()),
+                RecordStream(0, meshlets.data(), meshlets.size(), sizeof(Meshlet))
+            });
         }
-    }
 
-    // Create and bind vertex array object (VAO)
-    glGenVertexArrays(1, &torus.torusVAO);
-    glBindVertexArray(torus.torusVAO);
+        // Create and bind vertex array object (VAO)
+        glGenVertexArrays(1, &torus.torusVAO);
+        glBindVertexArray(torus.torusVAO);
 
-    // Create vertex buffer object (VBO) for vertices
-    glGenBuffers(1, &torus.torusVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, torus.torusVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-    // Create vertex buffer object (VBO) for normals
-    glGenBuffers(1, &torus.torusNormalVBO); 
-    glBindBuffer(GL_ARRAY_BUFFER, torus.torusNormalVBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1); 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-    // Create vertex buffer object (VBO) for texture coordinates
-    glGenBuffers(1, &torus.torusTextureVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, torus.torusTextureVBO);
-    glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(glm::vec2), texCoords.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        // Create vertex buffer object (VBO) for the interleaved vertices, normals, and texture coordinates
+        glGenBuffers(1, &torus.torusVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, torus.torusVBO);
+        UploadStream(*cache.Vertices(0, 0));
 
-    // Create element buffer object (EBO) for indices
-    glGenBuffers(1, &torus.torusEBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, torus.torusEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        // Create element buffer object (EBO) for indices
+        glGenBuffers(1, &torus.torusEBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, torus.torusEBO);
+        UploadStream(*cache.Indices(0));
 
-    // Unbind VAO
-    glBindVertexArray(0);
+        // Unbind VAO
+        glBindVertexArray(0);
 
-    // Store the index count for later use
-    torus.torusIndices = indices.size();
+        torus.torusIndices = cache.Indices(0)->Count();
+        RetainStream(GEOMETRY_TORUS, cache.Vertices(0, 0), torus.normals, offsetof(SurfaceVertex, Normal));
+        torus.bounds = SurfaceStreamBounds(*cache.Vertices(0, 0));
+        CopyStream(cache.Records(0), torus.meshlets);
+    }
 
     // Store the model matrix for transformation
     glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), translation);
     torus.torusMatrices.push_back(modelMatrix);
 
     // Store the data for later use in torus object
-    torus.torusIndices = indices.size();
-    torus.torusIndices = indices.size();
     torus.torusTextureID = torusTextureID;
-    torus.normals = normals;
     torus.torusMaterial.shininess = shininess;
     torus.torusMaterial.specularColor = specularColor;
-}
 
+    // Coarse patches for tessellation, 8 around the tube and 16 around the ring
+    if (UseTessellation())
+        torus.patches = CreateSurfacePatches(GPU_SURFACE_TORUS, glm::vec4(innerRadius, outerRadius, 0.0f, 0.0f), 8, 16);
+}
 
 /*
 * Method to create the mesh for a plane
@@ -908,9 +1424,11 @@ void CreatePlane(float width, float height, GLuint planeTextureID, float shinine
 *         translation: the translation to be applied to the object
 *         rotation: the rotation to be applied to the object
 *         vector: vector to store all the cube objects
+*         faceRegions: optional atlas regions in the same order as the face textures (left, right, front, back, top, bottom),
+*                      each face's texture coords are mapped into its region
 */
 void CreateCubeMesh(float width, float height, float depth, GLuint leftSideTexture, GLuint rightSideTexture, GLuint frontTexture, GLuint backTexture, GLuint topTexture, GLuint bottomTexture,
-    float shininess, const glm::vec3& specularColor, const glm::vec3& translation, float rotation, vector<Cube>& cubes) {
+    float shininess, const glm::vec3& specularColor, const glm::vec3& translation, float rotation, vector<Cube>& cubes, const AtlasRegion* faceRegions) {
 
     Cube newCube;
 
@@ -958,6 +1476,20 @@ void CreateCubeMesh(float width, float height, float depth, GLuint leftSideTextu
          -halfW,  halfH, -halfD,  0.0f,  1.0f,  0.0f,   0.0f, 1.0f
     };
 
+    // Move each face's texture coords into its atlas region, faces are stored front, back, left, right, bottom, top
+    if (faceRegions) {
+        const int regionOfFace[6] = { 2, 3, 0, 1, 5, 4 };
+        for (int face = 0; face < 6; ++face) {
+            const AtlasRegion& region = faceRegions[regionOfFace[face]];
+            for (int corner = 0; corner < 4; ++corner) {
+                GLfloat* uv = &vertices[(face * 4 + corner) * 8 + 6];
+                glm::vec2 mapped = region.Map(glm::vec2(uv[0], uv[1]));
+                uv[0] = mapped.x;
+                uv[1] = mapped.y;
+            }
+        }
+    }
+
     // indices for all the faces
     GLuint indices[] = {
         // Front face
@@ -1025,7 +1557,7 @@ void CreateCubeMesh(float width, float height, float depth, GLuint leftSideTextu
 
 /*
 * Method to create the mesh for a sphere
-* Creates vertices, which include normals and texture coords, and also creates indices
+* Creates vertices, which include normals and texture coords, and also creates indices from a SphereSurface
 * Creates VAO, VBO, and EBO objects and binds them
 * Store the VAO, VBOs, index count, and model matrix
 * push cube object into cubes vector for rendering later
@@ -1034,89 +1566,73 @@ void CreateCubeMesh(float width, float height, float depth, GLuint leftSideTextu
 *         translation: the translation that should be applied to the object
 */
 void CreateSphereMesh(float radius, GLuint sphereTextureID, float shininess, const glm::vec3& specularColor, const glm::vec3& translation) {
-    vector<GLfloat> vertices;
+    vector<SurfaceVertex> vertices;
     vector<GLuint> indices;
+    vector<GLuint> meshletIndices;
+    vector<Meshlet> meshlets;
 
     int precision = 50; // adjust this for more or fewer triangles
 
-    // Calculate the vertexs, normals, and texture coords
-    for (int i = 0; i <= precision; i++) {
-        float theta = float(i) * glm::pi<float>() / precision;
-        for (int j = 0; j <= precision; j++) {
-            float phi = float(j) * 2 * glm::pi<float>() / precision;
+    if (UseGpuGeometry()) {
+        // Generate the sphere straight into its GPU buffers with the compute shader
+        sphere.sphereIndices = CreateGpuSurface(GPU_SURFACE_SPHERE, glm::vec4(radius, 0.0f, 0.0f, 0.0f), precision, precision, sphere.sphereVAO, sphere.sphereVBO, sphere.sphereEBO);
+        sphere.bounds = SphereSurface{ radius }.Bounds();
+        sphere.meshlets = { WholeMeshMeshlet(sphere.sphereIndices, sphere.bounds.center, sphere.bounds.radius) };
+    }
+    else {
+        // Reuse the cached geometry if this sphere was generated on an earlier launch
+        MeshCacheKey cacheKey("sphere", 3);
+        cacheKey.Add(radius).Add(precision);
+        MeshCache cache;
+        if (!cache.Load(cacheKey)) {
+            // Calculate the vertexs, normals, texture coords, and indices
+            ParametricSurface<SphereSurface> surface({ radius }, precision, precision);
+            surface.Generate(vertices, indices);
+
+            // Split the sphere into meshlets and store the indices in meshlet order
+            BuildSurfaceMeshlets(vertices, indices, meshletIndices, meshlets);
+
+            // Write the generated geometry to the cache for the next launch
+            cache.Store(cacheKey, {
+                SurfaceVertexStream(0, vertices),
+                IndexStream(0, meshletIndices.data(), meshletIndices.size()),
+                RecordStream(0, meshlets.data(), meshlets.size(), sizeof(Meshlet))
+            });
+        }
 
-            // Vertex position
-            float x = radius * sin(theta) * cos(phi);
-            float y = radius * cos(theta);
-            float z = radius * sin(theta) * sin(phi);
+        // Set up the VAO/VBO
+        glGenVertexArrays(1, &sphere.sphereVAO);
+        glBindVertexArray(sphere.sphereVAO);
 
-            // Vertex normal
-            glm::vec3 normal = glm::normalize(glm::vec3(x, y, z));
+        // Upload the interleaved vertices and set the vertex attribute pointers
+        glGenBuffers(1, &sphere.sphereVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, sphere.sphereVBO);
+        UploadStream(*cache.Vertices(0, 0));
 
-            // Texture coordinates
-            float u = float(j) / precision;
-            float v = 1.0f - float(i) / precision; // Flip so 0 is at the top
+        // Create and bind Element Buffer Object (EBO)
+        glGenBuffers(1, &sphere.sphereEBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.sphereEBO);
+        UploadStream(*cache.Indices(0));
 
-            vertices.insert(vertices.end(), { x, y, z, normal.x, normal.y, normal.z, u, v });
-        }
-    }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
 
-    // calculate indices
-    for (int i = 0; i < precision; i++) {
-        for (int j = 0; j < precision; j++) {
-            // Vertex indices for the quad forming two triangles
-            GLuint bottomLeft = i * (precision + 1) + j;
-            GLuint bottomRight = i * (precision + 1) + j + 1;
-            GLuint topLeft = (i + 1) * (precision + 1) + j;
-            GLuint topRight = (i + 1) * (precision + 1) + j + 1;
-
-            // First triangle
-            indices.push_back(topLeft);
-            indices.push_back(bottomRight);
-            indices.push_back(bottomLeft);
-
-            // Second triangle
-            indices.push_back(topLeft);
-            indices.push_back(topRight);
-            indices.push_back(bottomRight);
-        }
+        sphere.sphereIndices = cache.Indices(0)->Count();
+        sphere.bounds = SurfaceStreamBounds(*cache.Vertices(0, 0));
+        CopyStream(cache.Records(0), sphere.meshlets);
     }
 
-    // Set up the VAO/VBO
-    glGenVertexArrays(1, &sphere.sphereVAO);
-    glBindVertexArray(sphere.sphereVAO);
-
-    glGenBuffers(1, &sphere.sphereVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, sphere.sphereVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW);
-
-    // Set vertex attribute pointers
-    GLint posAttrib = 0, normAttrib = 1, texAttrib = 2;
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(posAttrib);
-
-    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(normAttrib);
-
-    glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(texAttrib);
-
-    // Create and bind Element Buffer Object (EBO)
-    glGenBuffers(1, &sphere.sphereEBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.sphereEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
     // Store the transform
     sphere.translation = glm::translate(glm::mat4(1.0f), translation);
 
     // Store texture ID
     sphere.texture = sphereTextureID;
-    sphere.sphereIndices = indices.size();
     sphere.sphereMaterial.shininess = shininess;
     sphere.sphereMaterial.specularColor = specularColor;
+
+    // Coarse patches for tessellation, 16 around the equator and 8 from pole to pole
+    if (UseTessellation())
+        sphere.patches = CreateSurfacePatches(GPU_SURFACE_SPHERE, glm::vec4(radius, 0.0f, 0.0f, 0.0f), 16, 8);
 }
 
 /*
@@ -1173,49 +1689,342 @@ void CreateLightCubes(vector<LightCube>& lCubes) {
     lCubes.push_back(cubes);
 }
 
+/*
+* Method to decode a texture image file
+* Loads the file in its own channel layout and runs the texture import stage on it,
+* which flips it vertically and converts it to RGBA in a single pass
+* With compressTextures set, the compressed cache is mapped instead when it is current,
+* otherwise the imported pixels are transcoded and written to it for the next launch
+* image.skipLevels top mip levels are left out, for textures the residency manager shrank
+* The mip chain is then staged for upload, see StageTexture
+* Only touches CPU memory, so it is safe to run on the texture loader's worker threads
+* @params image: image.path is the file to load, receives RGBA pixels or compressed levels and their size
+* @return true if the file was decoded
+*/
+bool DecodeTexture(DecodedImage& image) {
+    TextureCacheKey cacheKey(image.path, textureImportOptions);
+    if (!(compressTextures && LoadCachedTexture(cacheKey, image))) {
+        if (!DecodeTexturePixels(image.path, image))
+            return false;
+
+        // First launch for this image: compress it and keep the blocks instead of the pixels
+        if (compressTextures)
+            CompressTexture(cacheKey, image);
+    }
+    if (!DropTextureLevels(image))
+        return false;
+    StageTexture(image);
+    return true;
+}
+
+/*
+* Method to decode the box atlas planned by PlanBoxAtlas
+* Decodes every box face and copies it into its place in one RGBA image,
+* going through the compressed cache like DecodeTexture
+* Runs on a texture loader worker thread, see AsyncTextureLoader::Load(path, decode)
+* @params image: receives the atlas pixels or compressed levels
+* @return true if every face was decoded
+*/
+bool DecodeBoxAtlas(DecodedImage& image) {
+    vector<string> sources;
+    for (const AtlasEntry& entry : boxAtlas.Entries())
+        sources.push_back(entry.path);
+    TextureCacheKey cacheKey(image.path, sources, boxAtlas.LayoutHash(), textureImportOptions);
+    image.maxLevel = std::max(0, TextureAtlas::MAX_MIP_LEVEL - image.skipLevels); // the gutter shrinks with every dropped level
+    if (compressTextures && LoadCachedTexture(cacheKey, image)) {
+        if (!DropTextureLevels(image))
+            return false;
+        StageTexture(image);
+        return true;
+    }
+
+    if (!ComposeBoxAtlas(image))
+        return false;
+    if (compressTextures)
+        CompressTexture(cacheKey, image);
+    if (!DropTextureLevels(image))
+        return false;
+    StageTexture(image);
+    return true;
+}
+
+/*
+* Method to decode every box face into its place in one RGBA image, without the cache or mips
+* @params image: receives the atlas pixels and their size
+* @return true if every face was decoded
+*/
+bool ComposeBoxAtlas(DecodedImage& image) {
+    // Gutters around the faces are filled by Blit, the unused space is opaque black so the atlas compresses as BC1
+    size_t atlasPixels = size_t(boxAtlas.Width()) * size_t(boxAtlas.Height());
+    image.pixels = static_cast<unsigned char*>(malloc(atlasPixels * 4)); // released with stbi_image_free, i.e. free
+    if (!image.pixels)
+        return false;
+    const unsigned char opaqueBlack[4] = { 0, 0, 0, 255 };
+    for (size_t i = 0; i < atlasPixels; ++i)
+        memcpy(image.pixels + i * 4, opaqueBlack, 4);
+    image.width = boxAtlas.Width();
+    image.height = boxAtlas.Height();
+    image.channels = 4;
+    image.internalFormat = textureImportOptions.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+    for (const AtlasEntry& entry : boxAtlas.Entries()) {
+        DecodedImage face;
+        if (!DecodeTexturePixels(entry.path, face) || face.width != entry.width || face.height != entry.height) {
+            std::cerr << "Failed to build texture atlas: " << entry.path << " is missing or changed size" << std::endl;
+            FreeTexturePixels(face);
+            FreeTexturePixels(image);
+            return false;
+        }
+        boxAtlas.Blit(entry, face.pixels, image.pixels);
+        FreeTexturePixels(face);
+    }
+    return true;
+}
+
+// Decodes the source image of a virtual texture into RGBA pixels, run by the page loader when the tiled file is built
+bool DecodeVirtualTexturePixels(DecodedImage& image) {
+    return DecodeTexturePixels(image.path, image);
+}
+
+/*
+* Method to read an image file into RGBA pixels through the texture import stage
+* Loads the file in its own channel layout, then flips it vertically and converts it to RGBA in a single pass
+* @params path: the file to load
+*         image: receives the pixels and their size
+* @return true if the file was decoded
+*/
+bool DecodeTexturePixels(const string& path, DecodedImage& image) {
+    int fileChannels = 0;
+    image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &fileChannels, 0);
+    if (!image.pixels) {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        return false;
+    }
+
+    if (!ImportTexturePixels(image.pixels, image.width, image.height, fileChannels, textureImportOptions)) {
+        std::cerr << "Failed to import texture: " << path << " (" << fileChannels << " channels)" << std::endl;
+        FreeTexturePixels(image);
+        return false;
+    }
+    image.channels = 4;
+    image.internalFormat = textureImportOptions.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    return true;
+}
+
+// Maps the cached compressed levels for key into image, false on a miss
+bool LoadCachedTexture(const TextureCacheKey& key, DecodedImage& image) {
+    CompressedTexture* compressed = new CompressedTexture;
+    if (!TextureCache::Load(key, *compressed)) {
+        delete compressed;
+        return false;
+    }
+    image.compressed = compressed;
+    image.width = compressed->levels.front().width;
+    image.height = compressed->levels.front().height;
+    return true;
+}
+
+// Replaces the RGBA pixels of image with compressed levels and writes them to the cache for the next launch
+void CompressTexture(const TextureCacheKey& key, DecodedImage& image) {
+    CompressedTexture* compressed = new CompressedTexture;
+    TextureCache::Transcode(image.pixels, image.width, image.height, textureImportOptions, *compressed);
+    TextureCache::Store(key, *compressed);
+    FreeTexturePixels(image);
+    image.compressed = compressed;
+}
+
+/*
+* Method to leave out the image.skipLevels largest mip levels of a decoded image
+* Compressed images drop their first levels, RGBA pixels are filtered down by MipGenerator
+* Always keeps the 1x1 level, and the image size afterwards is that of the new level 0
+* @params image: decoded image, its pixels or compressed levels are replaced
+* @return false if the smaller image could not be allocated, image is freed then
+*/
+bool DropTextureLevels(DecodedImage& image) {
+    if (image.skipLevels <= 0)
+        return true;
+
+    if (image.compressed) {
+        vector<CompressedLevel>& levels = image.compressed->levels;
+        size_t dropped = std::min(size_t(image.skipLevels), levels.size() - 1);
+        levels.erase(levels.begin(), levels.begin() + dropped);
+        image.width = levels.front().width;
+        image.height = levels.front().height;
+        return true;
+    }
+
+    vector<MipLevel> mips;
+    MipGenerator::Generate(image.pixels, image.width, image.height, image.skipLevels, MipOptions::For(textureImportOptions), mips);
+    if (mips.empty())
+        return true; // already 1x1
+    FreeTexturePixels(image);
+
+    const MipLevel& level = mips.back();
+    image.width = level.width;
+    image.height = level.height;
+    image.pixels = static_cast<unsigned char*>(malloc(level.pixels.size())); // released with stbi_image_free, i.e. free
+    if (!image.pixels)
+        return false;
+    memcpy(image.pixels, level.pixels.data(), level.pixels.size());
+    return true;
+}
+
+/*
+* Method to lay out every mip level of a decoded image the way UploadTexture copies them
+* Compressed images keep their levels, RGBA images get theirs computed here by MipGenerator,
+* so the upload does not need glGenerateMipmap. Both stop at image.maxLevel when it is set
+* The levels go into textureUploadRing when it has room, otherwise into client memory
+* Runs on the texture loader's worker threads, textureUploadRing is written without GL calls
+* @params image: decoded pixels or compressed levels, replaced by image.staged
+*/
+void StageTexture(DecodedImage& image) {
+    StagedTexture* staged = new StagedTexture;
+    size_t levelCount = image.maxLevel >= 0 ? size_t(image.maxLevel) + 1 : SIZE_MAX;
+
+    // Lay out the levels first, so the whole chain can go into one ring region
+    if (image.compressed) {
+        staged->internalFormat = image.compressed->format;
+        staged->compressed = true;
+        levelCount = std::min(levelCount, image.compressed->levels.size());
+        for (size_t level = 0; level < levelCount; ++level) {
+            const CompressedLevel& mip = image.compressed->levels[level];
+            staged->levels.push_back({ mip.width, mip.height, staged->Size(), mip.size });
+        }
+    }
+    else {
+        staged->internalFormat = image.internalFormat;
+        for (int w = image.width, h = image.height; staged->levels.size() < levelCount; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+            staged->levels.push_back({ w, h, staged->Size(), size_t(w) * size_t(h) * 4 });
+            if (w == 1 && h == 1)
+                break;
+        }
+    }
+
+    unsigned char* destination;
+    if (textureUploadRing.Allocate(staged->Size(), staged->ringOffset)) {
+        staged->ring = &textureUploadRing;
+        destination = textureUploadRing.Data(staged->ringOffset);
+    }
+    else {
+        staged->memory.resize(staged->Size());
+        destination = staged->memory.data();
+    }
+
+    if (image.compressed) {
+        for (size_t level = 0; level < staged->levels.size(); ++level)
+            memcpy(destination + staged->levels[level].offset, image.compressed->levels[level].data, staged->levels[level].size);
+    }
+    else {
+        // The levels are filtered in client memory, the ring is only written
+        memcpy(destination, image.pixels, staged->levels[0].size);
+        vector<MipLevel> mips;
+        MipGenerator::Generate(image.pixels, image.width, image.height, int(staged->levels.size()) - 1, MipOptions::For(textureImportOptions), mips);
+        for (size_t level = 1; level < staged->levels.size(); ++level)
+            memcpy(destination + staged->levels[level].offset, mips[level - 1].pixels.data(), staged->levels[level].size);
+    }
+
+    FreeTexturePixels(image);
+    image.staged = staged;
+}
+
+/*
+* Method to lay out the box faces in boxAtlas
+* Only reads the image headers, so the cube texture coords can be mapped before any face is decoded
+* @return true if every face was found and the atlas fits in a texture
+*/
+bool PlanBoxAtlas() {
+    for (const SceneTexture& texture : sceneTextures) {
+        int width, height, channels;
+        if (!texture.boxFace)
+            continue;
+        if (!stbi_info(texture.file, &width, &height, &channels)) {
+            cout << "Box atlas disabled, cannot read " << texture.file << endl;
+            return false;
+        }
+        boxAtlas.Add(texture.name, texture.file, width, height);
+    }
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (!boxAtlas.Plan(maxSize)) {
+        cout << "Box atlas disabled, the faces do not fit in a " << maxSize << " texture" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+* Method to upload a decoded image into the bound texture object
+* Allocates immutable storage for the staged mip chain and copies every level into it,
+* from textureUploadRing when the levels were staged there, then frees the decoded image
+* Images that were not staged by the decode function are staged here first
+* Reports the texture's memory to textureResidency
+* @params image: the decoded image after DecodeTexture, the bound texture must not have storage yet
+*/
+void UploadTexture(DecodedImage& image) {
+    if (!image.staged)
+        StageTexture(image);
+    StagedTexture& staged = *image.staged;
+    textureUploadRing.Reclaim();
+
+    const StagedLevel& base = staged.levels.front();
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(staged.levels.size()), staged.internalFormat, base.width, base.height);
+    if (staged.ring)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staged.ring->Buffer());
+    for (size_t level = 0; level < staged.levels.size(); ++level) {
+        const StagedLevel& mip = staged.levels[level];
+        if (staged.compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(level), 0, 0, mip.width, mip.height, staged.internalFormat, GLsizei(mip.size), staged.Source(mip));
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, GLint(level), 0, 0, mip.width, mip.height, GL_RGBA, GL_UNSIGNED_BYTE, staged.Source(mip));
+    }
+
+    // The ring region is reused once the GPU has finished reading it
+    if (staged.ring) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        staged.ring->Release(staged.ringOffset, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        staged.ring = nullptr;
+    }
+
+    size_t bytes = staged.Size();
+    if (!image.reload)
+        textureMemoryBytes += bytes;
+    textureResidency.Uploaded(image.textureId, image.width, image.height, bytes, image.skipLevels);
+
+    // Free the image data
+    FreeTexturePixels(image);
+}
+
+// Frees decoded pixels, compressed or staged levels that are no longer needed
+void FreeTexturePixels(DecodedImage& image) {
+    stbi_image_free(image.pixels);
+    image.pixels = nullptr;
+    delete image.compressed;
+    image.compressed = nullptr;
+    if (image.staged && image.staged->ring)
+        image.staged->ring->Release(image.staged->ringOffset, nullptr);
+    delete image.staged;
+    image.staged = nullptr;
+}
+
 /*
 * Method to load a texture from an image file and create a texture object
-* takes file name input and loads that file and flips it vertically
+* Decodes and uploads synchronously, see AsyncTextureLoader for loading in the background
 * It then generates an OpenGL texture object and binds the loaded image data to it.
-* The function sets the texture wrapping and filtering parameters and generates mipmaps.
+* The function uploads the mipmaps, wrapping and filtering come from the sampler bound to the texture unit.
 * @params texturePath: The path to the texture that should be loaded
 */
 GLuint LoadTexture(const std::string& texturePath) {
-    int width, height, channels;
-    unsigned char* image = stbi_load(texturePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-    if (!image) {
-        std::cerr << "Failed to load texture: " << texturePath << std::endl;
+    DecodedImage image;
+    image.path = texturePath;
+    if (!DecodeTexture(image))
         return 0;
-    }
-
-    // call function to flip image
-    flipImageVertically(image, width, height, channels);
 
     GLuint textureId;
     glGenTextures(1, &textureId);
     glBindTexture(GL_TEXTURE_2D, textureId);
 
-    // Set texture wrapping and filtering options (optional)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    if (channels == 3)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    else if (channels == 4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    else
-    {
-        cout << "Not implemented to handle image with " << channels << " channels" << endl;
-        return false;
-    }
-
-    // Generate mipmaps (optional, but recommended)
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // Free the image data
-    stbi_image_free(image);
+    UploadTexture(image);
 
     // Unbind the texture
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -1223,15 +2032,158 @@ GLuint LoadTexture(const std::string& texturePath) {
     return textureId;
 }
 
-// Method to destroy texture program
-void DestroyTexture(GLuint textureId) {
-    glDeleteTextures(1, &textureId);
+// Binds a scene texture key for drawing and marks it as used this frame, so textureResidency keeps it resident
+void BindSceneTexture(GLuint textureId) {
+    glBindTexture(GL_TEXTURE_2D, sceneTextureLoader->Name(textureId));
+    textureResidency.Touch(textureId);
+}
+
+/*
+* Sets the per frame uniforms shared by the scene variants and the tessellation program
+* The program must be in use
+* @params programId: program to set the uniforms on
+*         view, projection: camera matrices for this frame
+*/
+void SetSceneUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection) {
+    // Set the view and projection matrices
+    glUniformMatrix4fv(shaderLibrary.Uniform(programId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(shaderLibrary.Uniform(programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    GLint UVScaleLoc = shaderLibrary.Uniform(programId, "uvScale");
+    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(uvScale));
+
+    // Set the point light properties in the shader
+    GLint pointLightLoc = shaderLibrary.Uniform(programId, "pointLights");
+    int numPointLights = SCENE_LIGHT_COUNT;
+
+    for (int i = 0; i < numPointLights; ++i) {
+        std::string baseName = "pointLights[" + std::to_string(i) + "].";
+        glUniform3fv(shaderLibrary.Uniform(programId, (baseName + "position").c_str()), 1, glm::value_ptr(pointLights[i].position));
+        glUniform3fv(shaderLibrary.Uniform(programId, (baseName + "color").c_str()), 1, glm::value_ptr(pointLights[i].color));
+        glUniform1f(shaderLibrary.Uniform(programId, (baseName + "intensity").c_str()), pointLights[i].intensity);
+        glUniform1f(shaderLibrary.Uniform(programId, (baseName + "ambientStrength").c_str()), pointLights[i].ambientStrength);
+        glUniform1f(shaderLibrary.Uniform(programId, (baseName + "specularIntensity").c_str()), pointLights[i].specularIntensity);
+        glUniform1f(shaderLibrary.Uniform(programId, (baseName + "highlightSize").c_str()), pointLights[i].highlightSize);
+    }
+
+    // The ambient term does not depend on the surface, the Blinn-Phong tiers read it summed once here
+    glm::vec3 ambientLight(0.0f);
+    for (int i = 0; i < numPointLights; ++i)
+        ambientLight += pointLights[i].ambientStrength * pointLights[i].color * pointLights[i].intensity;
+    glUniform3fv(shaderLibrary.Uniform(programId, "ambientLight"), 1, glm::value_ptr(ambientLight));
+    glUniform3fv(shaderLibrary.Uniform(programId, "viewPosition"), 1, glm::value_ptr(camera.Position));
+}
+
+/*
+* Points the samplers of a program using fragmentShaderSource at their texture units
+* Set once per program, a reloaded program needs them again
+* @params programId: scene variant or tessellation program
+*/
+void SetSamplerUniforms(GLuint programId) {
+    glProgramUniform1i(programId, shaderLibrary.Uniform(programId, "uTexture"), 0);
+    glProgramUniform1i(programId, shaderLibrary.Uniform(programId, "pageTable"), VirtualTextureSystem::PAGE_TABLE_UNIT);
+    glProgramUniform1i(programId, shaderLibrary.Uniform(programId, "physicalPages"), VirtualTextureSystem::PHYSICAL_PAGES_UNIT);
+}
+
+/*
+* Features of the cheapest scene variant that draws a material in the current lighting tier
+* @params material: material of the surface
+*         virtualTexture: index in virtualTextures the surface samples, -1 for a regular texture
+*/
+uint32_t MaterialFeatures(const Material& material, int virtualTexture) {
+    uint32_t features = SHADER_TEXTURED | LIGHTING_TIERS[lightingTier].features;
+    if (material.specularColor != glm::vec3(0.0f))
+        features |= SHADER_SPECULAR;
+    if (virtualTexture >= 0)
+        features |= SHADER_VIRTUAL_TEXTURE;
+    return features;
+}
+
+/*
+* Switches to a scene variant, compiling it if this is its first use
+* The frame's view, projection, and light uniforms are set the first time the variant is used in a frame
+* @params features: ShaderFeature flags, e.g. from MaterialFeatures
+*         lightCount: SCENE_LIGHT_COUNT for lit surfaces, 0 for unlit ones
+* @return the program now in use, 0 if the variant does not compile
+*/
+GLuint UseSceneVariant(uint32_t features, int lightCount) {
+    ShaderVariant* variant = sceneVariants.Get(features, lightCount);
+    if (!variant) {
+        glUseProgram(0);
+        return 0;
+    }
+
+    glUseProgram(variant->program);
+    if (variant->frame != sceneFrame) {
+        variant->frame = sceneFrame;
+        SetSceneUniforms(variant->program, sceneView, sceneProjection);
+    }
+    return variant->program;
+}
+
+/*
+* Draws a surface as tessellated patches with the tessellation program, which stays in use
+* @params patches: coarse patches of the surface
+*         model: model matrix of this instance
+*         material: material of the surface
+*         textureId: texture of the surface
+*/
+void DrawTessellatedSurface(const SurfacePatches& patches, const glm::mat4& model, const Material& material, GLuint textureId) {
+    glUseProgram(tessellationProgramId);
+    glUniformMatrix4fv(shaderLibrary.Uniform(tessellationProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniform1f(shaderLibrary.Uniform(tessellationProgramId, "material.shininess"), material.shininess);
+    glUniform3fv(shaderLibrary.Uniform(tessellationProgramId, "material.specularColor"), 1, glm::value_ptr(material.specularColor));
+
+    glActiveTexture(GL_TEXTURE0);
+    BindSceneTexture(textureId);
+    surfaceTessellator.Draw(patches);
+}
+
+/*
+* Draws the virtual textured meshes into the feedback target of virtualTextures, which reads back
+* the pages they need a frame or two later. Other meshes are not drawn, so pages hidden behind them
+* are still requested
+* @params cubes: Vector that holds all the cube objects for rendering
+*         view, projection: camera matrices for this frame
+*/
+void RenderVirtualFeedback(const vector<Cube>& cubes, const glm::mat4& view, const glm::mat4& projection) {
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    if (!virtualTextures.BeginFeedback(framebufferWidth, framebufferHeight))
+        return;
+
+    glUseProgram(virtualFeedbackProgramId);
+    glUniformMatrix4fv(shaderLibrary.Uniform(virtualFeedbackProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(shaderLibrary.Uniform(virtualFeedbackProgramId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform2fv(shaderLibrary.Uniform(virtualFeedbackProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
+
+    if (plane.virtualTexture >= 0) {
+        virtualTextures.BindFeedback(plane.virtualTexture, virtualFeedbackProgramId);
+        glBindVertexArray(plane.planeVAO);
+        for (const auto& transformMatrix : plane.planeMatrices) {
+            glUniformMatrix4fv(shaderLibrary.Uniform(virtualFeedbackProgramId, "model"), 1, GL_FALSE, glm::value_ptr(transformMatrix));
+            glDrawElements(GL_TRIANGLES, plane.planeIndices, GL_UNSIGNED_INT, 0);
+        }
+    }
+
+    for (const auto& cube : cubes) {
+        if (cube.virtualTexture < 0)
+            continue;
+        virtualTextures.BindFeedback(cube.virtualTexture, virtualFeedbackProgramId);
+        glm::mat4 model = cube.translation * cube.rotation;
+        glUniformMatrix4fv(shaderLibrary.Uniform(virtualFeedbackProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        glBindVertexArray(cube.cubeVAO);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+    virtualTextures.EndFeedback(framebufferWidth, framebufferHeight);
 }
 
 /*
 * Render function to display the scene
 * Sets up the view and projection matrices
-* Binds the shader program
+* Draws every object with the scene variant of its material
 * Applies the combined model matrix for transformation as well as a combined model matrix
 * Combined model matrix is utilized to transform the cylinders and torus as a single object
 * Iterates through the stored structs and renders each object
@@ -1246,9 +2198,6 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Use the shader program
-    glUseProgram(objectProgramId);
-
     // Transforms the camera
     glm::mat4 view = camera.GetViewMatrix();
     glm::mat4 projection;
@@ -1261,9 +2210,22 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
         projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
     }
 
-    // Set the view and projection matrices
-    glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    // Set the view, projection, and light uniforms on every program that shades objects
+    // The scene variants get them from UseSceneVariant, only the ones used this frame
+    ++sceneFrame;
+    sceneView = view;
+    sceneProjection = projection;
+    if (UseTessellation()) {
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glUseProgram(tessellationProgramId);
+        SetSceneUniforms(tessellationProgramId, view, projection);
+        surfaceTessellator.SetTarget(framebufferWidth, framebufferHeight, TESS_PIXELS_PER_EDGE);
+    }
+
+    // Find the virtual texture pages in view before the draws below sample them
+    if (virtualTextures.Count() > 0)
+        RenderVirtualFeedback(cubes, view, projection);
 
     // Rotation around axis for cylinders and torus
     float rotationAngleX = glm::radians(-90.0f); // Adjust the angle as needed for X-axis
@@ -1285,57 +2247,46 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
     // Apply the rotation to the combined model matrix (cylinders and torus only)
     glm::mat4 combinedModelMatrixWithRotation = rotationMatrixZ * rotationMatrixY * rotationMatrixX * combinedModelMatrix;
 
-    // Set the combined model matrix uniform for the shader program
-    glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(combinedModelMatrix));
-
-    GLint UVScaleLoc = glGetUniformLocation(objectProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(uvScale));
-
-    // Set the point light properties in the shader
-    GLint pointLightLoc = glGetUniformLocation(objectProgramId, "pointLights");
-    int numPointLights = 3;
-
-    for (int i = 0; i < numPointLights; ++i) {
-        std::string baseName = "pointLights[" + std::to_string(i) + "].";
-        glUniform3fv(glGetUniformLocation(objectProgramId, (baseName + "position").c_str()), 1, glm::value_ptr(pointLights[i].position));
-        glUniform3fv(glGetUniformLocation(objectProgramId, (baseName + "color").c_str()), 1, glm::value_ptr(pointLights[i].color));
-        glUniform1f(glGetUniformLocation(objectProgramId, (baseName + "intensity").c_str()), pointLights[i].intensity);
-        glUniform1f(glGetUniformLocation(objectProgramId, (baseName + "ambientStrength").c_str()), pointLights[i].ambientStrength);
-        glUniform1f(glGetUniformLocation(objectProgramId, (baseName + "specularIntensity").c_str()), pointLights[i].specularIntensity);
-        glUniform1f(glGetUniformLocation(objectProgramId, (baseName + "highlightSize").c_str()), pointLights[i].highlightSize);
-    }
-
     // Code to Render the cylinders
     for (const auto& cylinder : cylinders) {
+        // Switch to the variant of the cylinder's material
+        GLuint objectProgramId = UseSceneVariant(MaterialFeatures(cylinder.cylMaterial), SCENE_LIGHT_COUNT);
+
         for (const auto& transformMatrix : cylinder.CylinderMatrices) {
             // Set material properties in the shader
-            GLint shininessLoc = glGetUniformLocation(objectProgramId, "material.shininess");
+            GLint shininessLoc = shaderLibrary.Uniform(objectProgramId, "material.shininess");
             glUniform1f(shininessLoc, cylinder.cylMaterial.shininess);
 
-            GLint specularColorLoc = glGetUniformLocation(objectProgramId, "material.specularColor");
+            GLint specularColorLoc = shaderLibrary.Uniform(objectProgramId, "material.specularColor");
             glUniform3fv(specularColorLoc, 1, glm::value_ptr(cylinder.cylMaterial.specularColor));
             
             // Calculate the combined model matrix for the current cylinder and its specific transformation
             glm::mat4 combinedModelMatrixWithRotationAndTransform = combinedModelMatrixWithRotation * transformMatrix;
 
             // Set the combined model matrix uniform for the shader program
-            glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(combinedModelMatrixWithRotationAndTransform));
-
-            // Bind the appropriate VAO for the sides
-            glBindVertexArray(cylinder.cylinderSidesVAO);
-            glEnableVertexAttribArray(1); 
-            glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideTexture);
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-            glBindTexture(GL_TEXTURE_2D, cylinder.sideTextureID);
-            glDrawElements(GL_TRIANGLES, cylinder.cylinderSidesIndices, GL_UNSIGNED_INT, 0);
-            glDisableVertexAttribArray(1); 
+            glUniformMatrix4fv(shaderLibrary.Uniform(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(combinedModelMatrixWithRotationAndTransform));
+
+            // Bind the appropriate VAO for the sides, or tessellate them from the coarse patches
+            if (UseTessellation()) {
+                DrawTessellatedSurface(cylinder.sidePatches, combinedModelMatrixWithRotationAndTransform, cylinder.cylMaterial, cylinder.sideTextureID);
+                glUseProgram(objectProgramId);
+            }
+            else {
+                glBindVertexArray(cylinder.cylinderSidesVAO);
+                glEnableVertexAttribArray(1); 
+                glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderSideVBO);
+                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, TexCoords));
+                BindSceneTexture(cylinder.sideTextureID);
+                glDrawElements(GL_TRIANGLES, cylinder.cylinderSidesIndices, GL_UNSIGNED_INT, 0);
+                glDisableVertexAttribArray(1); 
+            }
 
             // Bind the appropriate VAO for the top circle
             glBindVertexArray(cylinder.cylinderTopVAO);
             glEnableVertexAttribArray(1); 
             glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderTopTexture);
             glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-            glBindTexture(GL_TEXTURE_2D, cylinder.topBottomTextureID);
+            BindSceneTexture(cylinder.topBottomTextureID);
             glDrawElements(GL_TRIANGLES, cylinder.cylinderTopIndices, GL_UNSIGNED_INT, 0);
             glDisableVertexAttribArray(1); 
 
@@ -1344,50 +2295,74 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
             glEnableVertexAttribArray(1);
             glBindBuffer(GL_ARRAY_BUFFER, cylinder.cylinderBottomTexture);
             glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-            glBindTexture(GL_TEXTURE_2D, cylinder.topBottomTextureID);
+            BindSceneTexture(cylinder.topBottomTextureID);
             glDrawElements(GL_TRIANGLES, cylinder.cylinderBottomIndices, GL_UNSIGNED_INT, 0);
             glDisableVertexAttribArray(1);
         }
     }
 
+    // Visible meshlet ranges, reused every frame to avoid reallocating
+    static MeshletDrawList meshletDrawList;
+
     // Code to Render the torus
     for (const auto& transformMatrix : torus.torusMatrices) {
+        // Switch to the variant of the torus' material, the previous instance may have left the tessellation program in use
+        GLuint objectProgramId = UseSceneVariant(MaterialFeatures(torus.torusMaterial), SCENE_LIGHT_COUNT);
+
         // Set material properties in the shader
-        GLint shininessLoc = glGetUniformLocation(objectProgramId, "material.shininess");
+        GLint shininessLoc = shaderLibrary.Uniform(objectProgramId, "material.shininess");
         glUniform1f(shininessLoc, torus.torusMaterial.shininess);
 
-        GLint specularColorLoc = glGetUniformLocation(objectProgramId, "material.specularColor");
+        GLint specularColorLoc = shaderLibrary.Uniform(objectProgramId, "material.specularColor");
         glUniform3fv(specularColorLoc, 1, glm::value_ptr(torus.torusMaterial.specularColor));
         
         // Calculate the combined model matrix for the torus and its specific transformation
         glm::mat4 combinedModelMatrixWithRotationAndTransform = combinedModelMatrixWithRotation * transformMatrix;
 
         // Set the combined model matrix uniform for the shader program
-        glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(combinedModelMatrixWithRotationAndTransform));
+        glUniformMatrix4fv(shaderLibrary.Uniform(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(combinedModelMatrixWithRotationAndTransform));
+
+        // Tessellated patches replace the baked mesh and its meshlets
+        if (UseTessellation()) {
+            DrawTessellatedSurface(torus.patches, combinedModelMatrixWithRotationAndTransform, torus.torusMaterial, torus.torusTextureID);
+            continue;
+        }
 
         glBindVertexArray(torus.torusVAO);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, torus.torusTextureID);
-        glDrawElements(GL_TRIANGLES, torus.torusIndices, GL_UNSIGNED_INT, 0);
+        BindSceneTexture(torus.torusTextureID);
+
+        // Only draw the meshlets inside the view frustum that face the camera
+        meshletDrawList.Clear();
+        CullMeshlets(torus.meshlets, combinedModelMatrixWithRotationAndTransform, view, projection, camera.Position, true, meshletDrawList);
+        DrawMeshletRanges(meshletDrawList);
     }
 
     // Code to Render the plane
     for (const auto& transformMatrix : plane.planeMatrices) {
+        // Switch to the variant of the plane's material
+        GLuint objectProgramId = UseSceneVariant(MaterialFeatures(plane.planeMaterial, plane.virtualTexture), SCENE_LIGHT_COUNT);
+
         // Set material properties in the shader
-        GLint shininessLoc = glGetUniformLocation(objectProgramId, "material.shininess");
+        GLint shininessLoc = shaderLibrary.Uniform(objectProgramId, "material.shininess");
         glUniform1f(shininessLoc, plane.planeMaterial.shininess);
 
-        GLint specularColorLoc = glGetUniformLocation(objectProgramId, "material.specularColor");
+        GLint specularColorLoc = shaderLibrary.Uniform(objectProgramId, "material.specularColor");
         glUniform3fv(specularColorLoc, 1, glm::value_ptr(plane.planeMaterial.specularColor));
         
         glm::mat4 planeMatrix = transformMatrix;
 
         // Set the combined model matrix uniform for the shader program
-        glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(planeMatrix));
+        glUniformMatrix4fv(shaderLibrary.Uniform(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(planeMatrix));
 
         glBindVertexArray(plane.planeVAO);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, plane.planeTextureID);
+        if (plane.virtualTexture >= 0) {
+            virtualTextures.Bind(plane.virtualTexture, objectProgramId);
+            glDrawElements(GL_TRIANGLES, plane.planeIndices, GL_UNSIGNED_INT, 0);
+            continue;
+        }
+        BindSceneTexture(plane.planeTextureID);
         glDrawElements(GL_TRIANGLES, plane.planeIndices, GL_UNSIGNED_INT, 0);
     }
 
@@ -1396,54 +2371,76 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
 
     // Code to Render Cubes
     for (const auto& cube : cubes) {
+        // Switch to the variant of the cube's material
+        GLuint objectProgramId = UseSceneVariant(MaterialFeatures(cube.cubeMaterial, cube.virtualTexture), SCENE_LIGHT_COUNT);
+
         // Set material properties in the shader
-        GLint shininessLoc = glGetUniformLocation(objectProgramId, "material.shininess");
+        GLint shininessLoc = shaderLibrary.Uniform(objectProgramId, "material.shininess");
         glUniform1f(shininessLoc, cube.cubeMaterial.shininess);
 
-        GLint specularColorLoc = glGetUniformLocation(objectProgramId, "material.specularColor");
+        GLint specularColorLoc = shaderLibrary.Uniform(objectProgramId, "material.specularColor");
         glUniform3fv(specularColorLoc, 1, glm::value_ptr(cube.cubeMaterial.specularColor));
         
         glBindVertexArray(cube.cubeVAO);
 
         // Set the model matrix for this cube
         glm::mat4 model = cube.translation * cube.rotation;
-        glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(shaderLibrary.Uniform(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+        // A virtual box atlas covers every face in one draw
+        glActiveTexture(GL_TEXTURE0);
+        if (cube.virtualTexture >= 0) {
+            virtualTextures.Bind(cube.virtualTexture, objectProgramId);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            continue;
+        }
 
-        for (int i = 0; i < 6; ++i) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, cube.textures[i]);
+        // Faces sharing a texture (all of them when the box atlas is used) go out as one draw
+        for (int first = 0; first < 6;) {
+            int last = first + 1;
+            while (last < 6 && cube.textures[last] == cube.textures[first])
+                ++last;
 
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(i * 6 * sizeof(GLuint)));
+            BindSceneTexture(cube.textures[first]);
+            glDrawElements(GL_TRIANGLES, (last - first) * 6, GL_UNSIGNED_INT, (void*)(first * 6 * sizeof(GLuint)));
+            first = last;
         }
     }
 
     // Code to Render the Sphere
+    // Switch to the variant of the sphere's material
+    GLuint objectProgramId = UseSceneVariant(MaterialFeatures(sphere.sphereMaterial), SCENE_LIGHT_COUNT);
+
     // Set material properties in the shader
-    GLint shininessLoc = glGetUniformLocation(objectProgramId, "material.shininess");
+    GLint shininessLoc = shaderLibrary.Uniform(objectProgramId, "material.shininess");
     glUniform1f(shininessLoc, sphere.sphereMaterial.shininess);
 
-    GLint specularColorLoc = glGetUniformLocation(objectProgramId, "material.specularColor");
+    GLint specularColorLoc = shaderLibrary.Uniform(objectProgramId, "material.specularColor");
     glUniform3fv(specularColorLoc, 1, glm::value_ptr(sphere.sphereMaterial.specularColor));
     
     // Set the model matrix for this sphere
     glm::mat4 model = sphere.translation;
-    glUniformMatrix4fv(glGetUniformLocation(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(shaderLibrary.Uniform(objectProgramId, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
     glBindVertexArray(sphere.sphereVAO);
 
     // Bind the sphere's texture
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sphere.texture);
-
-    // Draw the sphere
-    glDrawElements(GL_TRIANGLES, sphere.sphereIndices, GL_UNSIGNED_INT, 0);
+    BindSceneTexture(sphere.texture);
 
-    // Use the shader program for lights
-    glUseProgram(lightProgramId);
+    // Draw the sphere, either tessellated or only the meshlets inside the view frustum that face the camera
+    if (UseTessellation()) {
+        DrawTessellatedSurface(sphere.patches, model, sphere.sphereMaterial, sphere.texture);
+    }
+    else {
+        meshletDrawList.Clear();
+        CullMeshlets(sphere.meshlets, model, view, projection, camera.Position, true, meshletDrawList);
+        DrawMeshletRanges(meshletDrawList);
+    }
 
-    // Set the view and projection matrices for the lights
-    glUniformMatrix4fv(glGetUniformLocation(lightProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(lightProgramId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    // Use the unlit, untextured variant for lights, drawn in white
+    GLuint lightProgramId = UseSceneVariant(0, 0);
+    glUniform4f(shaderLibrary.Uniform(lightProgramId, "baseColor"), 1.0f, 1.0f, 1.0f, 1.0f);
 
     // Render light cubes
     for (const auto& pointLight : pointLights) {
@@ -1454,7 +2451,7 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
             lightCubeModelMatrix = glm::scale(lightCubeModelMatrix, glm::vec3(0.2f));
 
             // Set the combined model matrix uniform for the shader program
-            glUniformMatrix4fv(glGetUniformLocation(lightProgramId, "model"), 1, GL_FALSE, glm::value_ptr(lightCubeModelMatrix));
+            glUniformMatrix4fv(shaderLibrary.Uniform(lightProgramId, "model"), 1, GL_FALSE, glm::value_ptr(lightCubeModelMatrix));
 
             glBindVertexArray(lightCube.lCubeVAO);
             glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
@@ -1469,66 +2466,516 @@ void Render(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const
 
 /*
 * Create shader program
-* Compiles the vertex and fragment shaders
-* Links them into a shader program
+* Compiles the vertex and fragment shaders through the shader library
+* Links them into a shader program, or restores it from the program cache
 * @params vtxShaderSource: Vertex shader source code
 *         fragShaderSource: Fragment shader source code
 *         programId: Reference to the generated shader program
 * @return true if the shader program creation is successful, false otherwise
 */
 bool CreateShaders(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId) {
-    // Create vertex shader
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vtxShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, nullptr, infoLog);
-        cout << "Vertex shader compilation failed:\n" << infoLog << endl;
-        return false;
+    return shaderLibrary.Create("", { { GL_VERTEX_SHADER, { vtxShaderSource } }, { GL_FRAGMENT_SHADER, { fragShaderSource } } }, programId);
+}
+
+/*
+* Create compute shader program
+* Compiles the compute shader with the shared surface functions appended, or restores it from the program cache
+* @params computeShaderSource: Compute shader source code
+*         programId: Reference to the generated shader program
+* @return true if the shader program creation is successful, false otherwise
+*/
+bool CreateComputeShader(const char* computeShaderSource, GLuint& programId) {
+    return shaderLibrary.Create("Compute", { { GL_COMPUTE_SHADER, { computeShaderSource, surfaceFunctionsSource } } }, programId);
+}
+
+/*
+* Create tessellation shader program
+* Compiles the vertex, tessellation control, tessellation evaluation, and fragment shaders,
+* or restores the linked program from the program cache
+* Both tessellation stages get the shared surface functions appended
+* @params vtxShaderSource: Vertex shader source code
+*         tcsShaderSource: Tessellation control shader source code
+*         tesShaderSource: Tessellation evaluation shader source code
+*         fragShaderSource: Fragment shader source code
+*         programId: Reference to the generated shader program
+* @return true if the shader program creation is successful, false otherwise
+*/
+bool CreateTessellationShaders(const char* vtxShaderSource, const char* tcsShaderSource, const char* tesShaderSource, const char* fragShaderSource, GLuint& programId) {
+    return shaderLibrary.Create("Tessellation", {
+        { GL_VERTEX_SHADER, { vtxShaderSource } },
+        { GL_TESS_CONTROL_SHADER, { tcsShaderSource, surfaceFunctionsSource } },
+        { GL_TESS_EVALUATION_SHADER, { tesShaderSource, surfaceFunctionsSource } },
+        { GL_FRAGMENT_SHADER, { fragShaderSource } } }, programId);
+}
+
+/*
+* Destroy Shaders function
+* Destorys program and forgets its reflected uniforms
+*/
+void DestroyShaders(GLuint programId) {
+    shaderLibrary.Destroy(programId);
+}
+
+/*
+* Creates every mesh object in the scene
+* Procedural meshes are read from the mesh cache when a matching cache file exists
+* @params cylinders: vector to hold the cylinder objects
+*         cubes: vector to hold the cube objects
+*         lCubes: vector to hold the light cube objects
+*/
+void CreateSceneGeometry(vector<Cylinder>& cylinders, vector<Cube>& cubes, vector<LightCube>& lCubes) {
+    CreateCylinderMesh(0.1175f, 1.4f, 32, 12, textures["cylTopSmallTexture"], textures["cylSidesLongTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), cylinders);
+    CreateCylinderMesh(0.25f, 0.08f, 24, 8, textures["cylTopSmallTexture"], textures["cylSidesTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, -0.7f, 0.0f), cylinders);
+    CreateCylinderMesh(0.3f, 0.08f, 24, 8, textures["cylTopLargeTexture"], textures["cylSidesTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.7f, 0.0f), cylinders);
+    CreateTorusMesh(0.04f, 0.26f, 20, 34, textures["Torus"], 128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(0.0f, -0.7f, 0.0f));
+    CreatePlane(18.0f, 18.0f, textures["Plane"], 16.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(0.0f, 0.0f, 0.0f));
+    // Face regions in CreateCubeMesh's texture order, the whole texture when the atlas is not used
+    AtlasRegion largeFaces[6] = { boxAtlas.Region("largeLeftSide"), boxAtlas.Region("largeRightSide"), boxAtlas.Region("largeFrontSide"),
+        boxAtlas.Region("largeBackSide"), boxAtlas.Region("largeTopSide"), boxAtlas.Region("largeTopSide") };
+    AtlasRegion smallFaces[6] = { boxAtlas.Region("smallLeftSide"), boxAtlas.Region("smallRightSide"), boxAtlas.Region("smallFrontSide"),
+        boxAtlas.Region("smallBackSide"), boxAtlas.Region("smallTopSide"), boxAtlas.Region("smallTopSide") };
+    CreateCubeMesh(1.8f, 1.6f, 2.8f, textures["largeLeftSide"], textures["largeRightSide"], textures["largeFrontSide"], textures["largeBackSide"], textures["largeTopSide"], textures["largeTopSide"],
+        128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(2.0f, 0.8f, 1.1f), -40.0f, cubes, largeFaces);
+    CreateCubeMesh(1.4f, 0.6, 1.4f, textures["smallLeftSide"], textures["smallRightSide"], textures["smallFrontSide"], textures["smallBackSide"], textures["smallTopSide"], textures["smallTopSide"],
+        128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(-2.0f, 0.3f, 2.5f), 10.0f, cubes, smallFaces);
+    CreateSphereMesh(0.22f, textures["Sphere"], 128.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.22f, 2.5f));
+    CreateLightCubes(lCubes);
+    CreateLightCubes(lCubes);
+}
+
+/*
+* Deletes the VAOs and buffers of every mesh CreateSceneGeometry made and empties the containers,
+* so the scene can be created again from scratch
+* The textures are owned by textureRegistry and are left alone
+*/
+void DestroySceneGeometry(vector<Cylinder>& cylinders, vector<Cube>& cubes, vector<LightCube>& lCubes) {
+    for (Cylinder& cylinder : cylinders) {
+        GLuint vaos[] = { cylinder.cylinderTopVAO, cylinder.cylinderBottomVAO, cylinder.cylinderSidesVAO };
+        GLuint buffers[] = { cylinder.cylinderTopVBO, cylinder.cylinderBottomVBO, cylinder.cylinderSideVBO, cylinder.cylinderTopNormalsVBO,
+            cylinder.cylinderBottomNormalsVBO, cylinder.cylinderTopTexture, cylinder.cylinderBottomTexture,
+            cylinder.cylinderTopEBO, cylinder.cylinderBottomEBO, cylinder.cylinderSidesEBO };
+        glDeleteVertexArrays(3, vaos);
+        glDeleteBuffers(10, buffers);
+        DestroySurfacePatches(cylinder.sidePatches);
+    }
+    for (Cube& cube : cubes) {
+        glDeleteVertexArrays(1, &cube.cubeVAO);
+        glDeleteBuffers(1, &cube.cubeVBO);
+        glDeleteBuffers(1, &cube.cubeEBO);
     }
+    for (LightCube& cube : lCubes) {
+        glDeleteVertexArrays(1, &cube.lCubeVAO);
+        glDeleteBuffers(1, &cube.lCubeVBO);
+        glDeleteBuffers(1, &cube.lCubeEBO);
+    }
+    cylinders.clear();
+    cubes.clear();
+    lCubes.clear();
+
+    glDeleteVertexArrays(1, &torus.torusVAO);
+    glDeleteBuffers(1, &torus.torusVBO);
+    glDeleteBuffers(1, &torus.torusEBO);
+    DestroySurfacePatches(torus.patches);
+    torus = Torus();
+
+    glDeleteVertexArrays(1, &plane.planeVAO);
+    glDeleteBuffers(1, &plane.planeVBO);
+    glDeleteBuffers(1, &plane.planeEBO);
+    plane = Plane();
+
+    glDeleteVertexArrays(1, &sphere.sphereVAO);
+    glDeleteBuffers(1, &sphere.sphereVBO);
+    glDeleteBuffers(1, &sphere.sphereEBO);
+    DestroySurfacePatches(sphere.patches);
+    sphere = Sphere();
+}
+
+/*
+* Features of the fragmentShaderSource variant the tessellated surfaces shade with in a lighting tier
+* The tessellation stages do not light per vertex, the low tier falls back to per fragment Blinn-Phong there
+*/
+uint32_t TessellationShaderFeatures(int tier) {
+    return SHADER_TEXTURED | SHADER_SPECULAR | (LIGHTING_TIERS[tier].features & ~SHADER_VERTEX_LIGHTING);
+}
 
-    // Create fragment shader
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragShaderSource, nullptr);
-    glCompileShader(fragmentShader);
+/*
+* Stages of the programs shaderReloader watches, each names the file in shaderfiles that replaces its inline source:
+*   object.vert, object.frag           vertexShaderSource, fragmentShaderSource (scene variants and tessellation program)
+*   virtualfeedback.frag               virtualFeedbackFragmentShaderSource
+*   surface.vert, .tesc, .tese         the tessellation stages, without the surface functions
+*   surfacefunctions.glsl              surfaceFunctionsSource, appended to both tessellation stages
+* Each file is a complete GLSL source with its own #version line
+* WatchShaderFiles and ExportShaders both build their programs from these, so the export validates what the reloader compiles
+* @params header: the scene variant's ShaderVariants::Header
+*/
+vector<ReloadableStage> SceneVariantStages(const std::string& header) {
+    return { { GL_VERTEX_SHADER, { { "object.vert", vertexShaderSource } }, header },
+             { GL_FRAGMENT_SHADER, { { "object.frag", fragmentShaderSource } }, header } };
+}
+
+vector<ReloadableStage> VirtualFeedbackStages() {
+    return { { GL_VERTEX_SHADER, { { "object.vert", vertexShaderSource } }, sceneVariants.Header(0, 0) },
+             { GL_FRAGMENT_SHADER, { { "virtualfeedback.frag", virtualFeedbackFragmentShaderSource } } } };
+}
+
+// @params fragmentFeatures: the fragmentShaderSource variant, see TessellationShaderFeatures
+vector<ReloadableStage> TessellationStages(uint32_t fragmentFeatures) {
+    const ShaderSourceFile surfaceFunctions = { "surfacefunctions.glsl", surfaceFunctionsSource };
+    return { { GL_VERTEX_SHADER, { { "surface.vert", surfaceTessVertexShaderSource } } },
+             { GL_TESS_CONTROL_SHADER, { { "surface.tesc", surfaceTessControlShaderSource }, surfaceFunctions } },
+             { GL_TESS_EVALUATION_SHADER, { { "surface.tese", surfaceTessEvaluationShaderSource }, surfaceFunctions } },
+             { GL_FRAGMENT_SHADER, { { "object.frag", fragmentShaderSource } }, sceneVariants.Header(fragmentFeatures, SCENE_LIGHT_COUNT) } };
+}
+
+/*
+* Hands one scene variant to shaderReloader, both of its stages get the variant's defines and lighting library
+* Does nothing before shaderReloader is started, WatchShaderFiles then hands over the variants created so far
+*/
+void WatchSceneVariant(ShaderVariant& variant, const std::string& name, const std::string& header) {
+    shaderReloader.Watch("object " + name, &variant.program, SceneVariantStages(header), SetSamplerUniforms);
+}
 
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, nullptr, infoLog);
-        cout << "Fragment shader compilation failed:\n" << infoLog << endl;
+/*
+* Hands the scene programs to shaderReloader, see SceneVariantStages for the files that replace their stages
+* The compute program is not watched, the surfaces it generates are only built at startup
+*/
+void WatchShaderFiles() {
+    // Variants compiled from now on are handed over as they are created
+    sceneVariants.ForEach(WatchSceneVariant);
+    if (virtualFeedbackProgramId)
+        shaderReloader.Watch("virtual feedback", &virtualFeedbackProgramId, VirtualFeedbackStages());
+    if (UseTessellation()) {
+        shaderReloader.Watch("tessellation", &tessellationProgramId, TessellationStages(tessellationShaderFeatures),
+            [](GLuint programId) {
+                SetSamplerUniforms(programId);
+                surfaceTessellator.SetProgram(programId);
+            });
+    }
+}
+
+/*
+* Writes the stage sources of every program the scene can compile to directory, see ShaderExport
+* That is every lit variant in every lighting tier, the unlit variant, the virtual texture feedback program,
+* the tessellation program of every tier and the compute program, with the files in shaderfiles that replace them
+* Needs no GL context, so the ValidateShaders build step can run it straight after linking
+* @return false if a file could not be written
+*/
+bool ExportShaders(const char* directory) {
+    ShaderExport shaderExport;
+    if (!shaderExport.Begin(directory))
         return false;
+
+    // The variants are only named here, Header does not compile them
+    sceneVariants.Create(vertexShaderSource, fragmentShaderSource, CreateShaders, lightingFunctionsSource);
+    for (const LightingTier& tier : LIGHTING_TIERS) {
+        for (uint32_t features = 0; features <= SHADER_MATERIAL_FEATURES; ++features) {
+            uint32_t variant = features | tier.features;
+            shaderExport.AddReloadable("object " + ShaderVariants::Name(variant, SCENE_LIGHT_COUNT),
+                SceneVariantStages(sceneVariants.Header(variant, SCENE_LIGHT_COUNT)));
+        }
     }
+    shaderExport.AddReloadable("object " + ShaderVariants::Name(0, 0), SceneVariantStages(sceneVariants.Header(0, 0)));
+    shaderExport.AddReloadable("virtual feedback", VirtualFeedbackStages());
+    for (int tier = 0; tier < LIGHTING_TIER_COUNT; ++tier)
+        shaderExport.AddReloadable(string("tessellation ") + LIGHTING_TIERS[tier].name, TessellationStages(TessellationShaderFeatures(tier)));
+    shaderExport.Add("surface compute", { { GL_COMPUTE_SHADER, { surfaceComputeShaderSource, surfaceFunctionsSource } } });
 
-    // Create shader program
-    programId = glCreateProgram();
-    glAttachShader(programId, vertexShader);
-    glAttachShader(programId, fragmentShader);
-    glLinkProgram(programId);
+    return shaderExport.Finish();
+}
 
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(programId, 512, nullptr, infoLog);
-        cout << "Shader program linking failed:\n" << infoLog << endl;
-        return false;
+/*
+* Measures geometry startup time with a cold and a warm mesh cache
+* The cold pass deletes the cache so every generator runs and writes its file
+* The warm pass maps the files written by the cold pass
+* glFinish is included so the timings cover the buffer uploads
+* Each pass destroys its geometry and residency accounts again, so the warm pass starts from the same empty scene
+*/
+void BenchmarkMeshCache() {
+    const char* passNames[] = { "cold", "warm" };
+
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 0)
+            MeshCache::Clear();
+
+        vector<Cylinder> cylinders;
+        vector<Cube> cubes;
+        vector<LightCube> lCubes;
+
+        unsigned int hitsBefore = MeshCache::hits;
+        unsigned int missesBefore = MeshCache::misses;
+
+        double start = glfwGetTime();
+        CreateSceneGeometry(cylinders, cubes, lCubes);
+        glFinish();
+        double elapsed = glfwGetTime() - start;
+
+        cout << "Mesh cache " << passNames[pass] << " startup: " << elapsed * 1000.0 << " ms ("
+            << MeshCache::hits - hitsBefore << " hits, " << MeshCache::misses - missesBefore << " misses)" << endl;
+
+        DestroySceneGeometry(cylinders, cubes, lCubes);
+        GeometryResidency::Get().ClearAccounts();
     }
+}
 
-    // Cleanup shader objects
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+/*
+* Measures the texture import kernels on the project's PNG files
+* Each file is decoded once, then the old byte-at-a-time flip and scalar conversions are timed
+* against the texture import stage on copies of the same pixels, and the results are compared
+* RGB input is produced by asking stb_image for three channels, as the project files are all RGBA
+*/
+void BenchmarkTextureImport() {
+    const char* kernelNames[] = { "flip", "rgb to rgba", "premultiply" };
+    double scalarSeconds[3] = {}, importSeconds[3] = {};
+    double megabytes[3] = {};
+    bool identical = true;
+    int imageCount = 0;
+
+    for (const SceneTexture& texture : sceneTextures) {
+        const char* file = texture.file;
+        int width, height, channels;
+        unsigned char* rgba = stbi_load(file, &width, &height, &channels, STBI_rgb_alpha);
+        unsigned char* rgb = stbi_load(file, &width, &height, &channels, STBI_rgb);
+        if (!rgba || !rgb) {
+            cout << "Skipping " << file << ": " << stbi_failure_reason() << endl;
+            stbi_image_free(rgba);
+            stbi_image_free(rgb);
+            continue;
+        }
+        ++imageCount;
+
+        size_t pixelCount = size_t(width) * size_t(height);
+        vector<unsigned char> scalar(rgba, rgba + pixelCount * 4);
+        vector<unsigned char> vectorised(scalar);
+
+        // Flip: byte swaps as the loader used to, against one memcpy per row
+        double start = glfwGetTime();
+        for (int j = 0; j < height / 2; ++j) {
+            size_t index1 = size_t(j) * width * 4;
+            size_t index2 = size_t(height - 1 - j) * width * 4;
+            for (int i = width * 4; i > 0; --i, ++index1, ++index2) {
+                unsigned char tmp = scalar[index1];
+                scalar[index1] = scalar[index2];
+                scalar[index2] = tmp;
+            }
+        }
+        scalarSeconds[0] += glfwGetTime() - start;
+        start = glfwGetTime();
+        FlipRows(vectorised.data(), width, height, 4);
+        importSeconds[0] += glfwGetTime() - start;
+        identical = identical && scalar == vectorised;
+        megabytes[0] += pixelCount * 4 / 1e6;
+
+        // RGB to RGBA expansion
+        start = glfwGetTime();
+        for (size_t i = 0; i < pixelCount; ++i) {
+            scalar[i * 4] = rgb[i * 3];
+            scalar[i * 4 + 1] = rgb[i * 3 + 1];
+            scalar[i * 4 + 2] = rgb[i * 3 + 2];
+            scalar[i * 4 + 3] = 255;
+        }
+        scalarSeconds[1] += glfwGetTime() - start;
+        start = glfwGetTime();
+        ExpandRgbToRgba(rgb, vectorised.data(), pixelCount);
+        importSeconds[1] += glfwGetTime() - start;
+        identical = identical && scalar == vectorised;
+        megabytes[1] += pixelCount * 3 / 1e6;
+
+        // Premultiplied alpha on the original RGBA pixels
+        memcpy(scalar.data(), rgba, pixelCount * 4);
+        memcpy(vectorised.data(), rgba, pixelCount * 4);
+        start = glfwGetTime();
+        for (size_t i = 0; i < pixelCount; ++i) {
+            unsigned char* p = &scalar[i * 4];
+            for (int c = 0; c < 3; ++c)
+                p[c] = static_cast<unsigned char>((p[c] * p[3] + 127) / 255);
+        }
+        scalarSeconds[2] += glfwGetTime() - start;
+        start = glfwGetTime();
+        PremultiplyAlpha(vectorised.data(), pixelCount);
+        importSeconds[2] += glfwGetTime() - start;
+        identical = identical && scalar == vectorised;
+        megabytes[2] += pixelCount * 4 / 1e6;
+
+        stbi_image_free(rgba);
+        stbi_image_free(rgb);
+    }
 
-    return true;
+    cout << "Texture import over " << imageCount << " images:" << endl;
+    for (int k = 0; k < 3; ++k) {
+        double scalarRate = scalarSeconds[k] > 0.0 ? megabytes[k] / scalarSeconds[k] : 0.0;
+        double importRate = importSeconds[k] > 0.0 ? megabytes[k] / importSeconds[k] : 0.0;
+        cout << "  " << kernelNames[k] << ": scalar " << scalarRate << " MB/s, import stage " << importRate << " MB/s ("
+            << (scalarRate > 0.0 ? importRate / scalarRate : 0.0) << "x)" << endl;
+    }
+    cout << "  results " << (identical ? "identical" : "DIFFER") << endl;
 }
 
 /*
-* Destroy Shaders function
-* Destorys program
+* Measures texture startup time with a cold and a warm compressed texture cache
+* The cold pass deletes the cache so every image is decoded, transcoded and written
+* The warm pass maps the files written by the cold pass
+* glFinish is included so the timings cover the uploads
 */
-void DestroyShaders(GLuint programId) {
-    glDeleteProgram(programId);
+void BenchmarkTextureCache() {
+    const char* passNames[] = { "cold", "warm" };
+
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 0)
+            TextureCache::Clear();
+
+        unsigned int hitsBefore = TextureCache::hits;
+        unsigned int missesBefore = TextureCache::misses;
+        size_t bytesBefore = textureMemoryBytes;
+
+        double start = glfwGetTime();
+        AsyncTextureLoader loader(DecodeTexture, UploadTexture, FreeTexturePixels);
+        vector<GLuint> loaded;
+        for (const SceneTexture& texture : sceneTextures)
+            loaded.push_back(loader.Load(texture.file));
+        loader.Finish();
+        glFinish();
+        double elapsed = glfwGetTime() - start;
+
+        cout << "Texture cache " << passNames[pass] << " startup: " << elapsed * 1000.0 << " ms ("
+            << TextureCache::hits - hitsBefore << " hits, " << TextureCache::misses - missesBefore << " misses, "
+            << (textureMemoryBytes - bytesBefore) / (1024.0 * 1024.0) << " MB of texture memory)" << endl;
+
+        for (GLuint texture : loaded)
+            loader.Delete(texture);
+    }
+}
+
+/*
+* Measures shader startup time with a cold and a warm program cache
+* The cold pass deletes the cache so every program is compiled, linked and saved
+* The warm pass restores the programs from the binaries written by the cold pass
+* Every program the scene can use is created, whether or not its option is on, and every lit variant of every lighting tier
+*/
+void BenchmarkProgramCache() {
+    const char* passNames[] = { "cold", "warm" };
+
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 0)
+            ProgramCache::Clear();
+
+        unsigned int hitsBefore = ProgramCache::hits;
+        unsigned int missesBefore = ProgramCache::misses;
+
+        double start = glfwGetTime();
+        ShaderVariants variants;
+        variants.Create(vertexShaderSource, fragmentShaderSource, CreateShaders, lightingFunctionsSource);
+        bool created = true;
+        for (const LightingTier& tier : LIGHTING_TIERS) {
+            for (uint32_t features = 0; features <= SHADER_MATERIAL_FEATURES; ++features)
+                created = variants.Get(features | tier.features, SCENE_LIGHT_COUNT) && created;
+        }
+        created = variants.Get(0, 0) && created;
+
+        GLuint programs[3] = {};
+        std::string feedbackVertexSource = InsertShaderDefines(vertexShaderSource, variants.Header(0, 0));
+        std::string tessellationFragmentSource = InsertShaderDefines(fragmentShaderSource, variants.Header(tessellationShaderFeatures, SCENE_LIGHT_COUNT));
+        created = CreateShaders(feedbackVertexSource.c_str(), virtualFeedbackFragmentShaderSource, programs[0]) && created;
+        created = CreateComputeShader(surfaceComputeShaderSource, programs[1]) && created;
+        created = CreateTessellationShaders(surfaceTessVertexShaderSource, surfaceTessControlShaderSource, surfaceTessEvaluationShaderSource,
+            tessellationFragmentSource.c_str(), programs[2]) && created;
+        glFinish();
+        double elapsed = glfwGetTime() - start;
+
+        cout << "Program cache " << passNames[pass] << " startup: " << elapsed * 1000.0 << " ms ("
+            << ProgramCache::hits - hitsBefore << " hits, " << ProgramCache::misses - missesBefore << " misses"
+            << (created ? "" : ", some programs failed") << ")" << endl;
+
+        variants.Destroy();
+        for (GLuint program : programs)
+            DestroyShaders(program);
+    }
+}
+
+/*
+* Draws the scene in every lighting tier and records the GPU time of each frame in lightingTimer
+* A tier draws a few untimed frames first, so its variants are compiled and the queries are not waiting on them
+* @params cylinders, cubes, lCubes: the scene, as drawn by Render
+*/
+void BenchmarkLighting(const vector<Cylinder>& cylinders, const vector<Cube>& cubes, const vector<LightCube>& lCubes) {
+    const int warmupFrames = 10;
+    const int timedFrames = 200;
+    int startTier = lightingTier;
+
+    for (int tier = 0; tier < LIGHTING_TIER_COUNT; ++tier) {
+        lightingTier = tier;
+        for (int frame = 0; frame < warmupFrames + timedFrames; ++frame) {
+            bool timed = frame >= warmupFrames;
+            if (timed)
+                lightingTimer.Begin(tier);
+            Render(cylinders, cubes, lCubes);
+            if (timed)
+                lightingTimer.End();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        lightingTimer.Collect(true);
+    }
+
+    lightingTier = startTier;
+}
+
+/*
+* Generates one surface with the compute shader, reads it back, and compares it with ParametricSurface<F>
+* @return true if positions, normals, texture coords, and indices match
+*/
+template <typename F>
+bool CompareGpuSurface(const char* name, GpuSurfaceKind kind, const glm::vec4& params, const F& function, int uSegments, int vSegments) {
+    vector<SurfaceVertex> cpuVertices;
+    vector<GLuint> cpuIndices;
+    ParametricSurface<F>(function, uSegments, vSegments).Generate(cpuVertices, cpuIndices);
+
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    unsigned int indexCount = gpuSurfaces.Generate(kind, params, uSegments, vSegments, buffers[0], buffers[1]);
+
+    // Read the shader output back through the copy target so no VAO state changes
+    vector<SurfaceVertex> gpuVertices(cpuVertices.size());
+    vector<GLuint> gpuIndices(indexCount);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffers[0]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, gpuVertices.size() * sizeof(SurfaceVertex), gpuVertices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, buffers[1]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, gpuIndices.size() * sizeof(GLuint), gpuIndices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glDeleteBuffers(2, buffers);
+
+    float positionError = 0.0f, normalError = 0.0f, texCoordError = 0.0f;
+    unsigned int tangentMismatches = 0;
+    for (size_t i = 0; i < cpuVertices.size(); ++i) {
+        const SurfaceVertex& cpu = cpuVertices[i];
+        const SurfaceVertex& gpu = gpuVertices[i];
+        positionError = glm::max(positionError, glm::length(gpu.Position - cpu.Position));
+        normalError = glm::max(normalError, glm::length(gpu.Normal - cpu.Normal));
+        texCoordError = glm::max(texCoordError, glm::length(gpu.TexCoords - cpu.TexCoords));
+        if (glm::dot(glm::vec3(gpu.Tangent), glm::vec3(cpu.Tangent)) < 0.9f || gpu.Tangent.w != cpu.Tangent.w)
+            ++tangentMismatches;
+    }
+
+    const float tolerance = 1e-4f;
+    bool indicesMatch = gpuIndices == cpuIndices;
+    bool passed = indicesMatch && positionError < tolerance && normalError < tolerance && texCoordError < tolerance;
+    cout << name << ": " << (passed ? "match" : "MISMATCH") << " (" << cpuVertices.size() << " vertices, max error position "
+        << positionError << " normal " << normalError << " texcoord " << texCoordError << ", indices "
+        << (indicesMatch ? "identical" : "differ") << ", " << tangentMismatches << " tangents differ)" << endl;
+    return passed;
+}
+
+/*
+* Compares every compute shader surface used in the scene with its CPU generator
+* Run with LIBGL_ALWAYS_SOFTWARE=1 to check the shader on Mesa llvmpipe without GPU hardware
+* Tangents are reported but not required to match: the CPU averages triangle tangents while
+* the shader uses the analytic gradient, so the rows next to the sphere poles differ
+* @return true if every surface matches
+*/
+bool ValidateGpuGeometry() {
+    bool passed = CompareGpuSurface("sphere", GPU_SURFACE_SPHERE, glm::vec4(0.22f, 0.0f, 0.0f, 0.0f), SphereSurface{ 0.22f }, 50, 50);
+    passed = CompareGpuSurface("torus", GPU_SURFACE_TORUS, glm::vec4(0.04f, 0.26f, 0.0f, 0.0f), TorusSurface{ 0.04f, 0.26f }, 20, 34) && passed;
+    passed = CompareGpuSurface("cylinder", GPU_SURFACE_CYLINDER, glm::vec4(0.1175f, 1.4f, 0.0f, 0.0f), CylinderSurface{ 0.1175f, 1.4f }, 32, 12) && passed;
+    return passed;
 }
 
 /*
@@ -1540,46 +2987,276 @@ void DestroyShaders(GLuint programId) {
 * Creates mesh objects for cylinders and torus
 * Enters the main render loop
 * Cleans up resources before exiting
+* Pass --bench-mesh-cache to print cold/warm geometry startup times and exit
+* Pass --geometry-report to print the CPU geometry memory kept after upload
+* Pass --gpu-geometry to generate the sphere, torus, and cylinder sides with a compute shader
+* Pass --validate-gpu-geometry to compare the compute shader output with the CPU generators and exit
+* Pass --tessellate to draw the sphere, torus, and cylinder sides with screen space adaptive tessellation
+* Pass --import <file> (repeatable) to import OBJ/glTF models, print MB/s and triangles/s, and exit
+* Pass --import-tangents to also generate tangents for the imported models
+* Pass --bench-texture-import to time the texture import kernels on the project PNGs and exit
+* Pass --bench-texture-cache to print cold/warm texture startup times with the compressed cache and exit
+* Pass --bench-program-cache to print cold/warm shader startup times with the program binary cache and exit
+* Pass --no-program-cache to compile every shader from source without reading or writing program binaries
+* Pass --hot-reload-shaders to recompile the scene shaders from shaderfiles whenever a file there changes, see WatchShaderFiles
+* Pass --uncompressed-textures to load RGBA8 textures without the compressed cache
+* Pass --texture-budget <MB> to keep the textures under that much video memory, 0 for no budget
+* Pass --texture-quality <low|medium|high|ultra> to pick the starting texture filtering tier, T cycles them
+* Pass --lighting <phong|blinn|low> to pick the starting lighting tier, L cycles them
+* Pass --bench-lighting to draw the scene in every lighting tier, print the GPU time per frame of each, and exit
+* Pass --export-shaders <dir> to write the stage sources of every shader program there for validateshaders.py and exit, see ExportShaders
 * @params argc: Number of command-line arguments
 *         argv: Array of command-line argument strings
 * @return EXIT_SUCCESS if the program runs successfully, EXIT_FAILURE otherwise
 */
 int main(int argc, char* argv[]) {
+    bool benchMeshCache = false;
+    bool geometryReport = false;
+    bool validateGpuGeometry = false;
+    bool benchTextureImport = false;
+    bool benchTextureCache = false;
+    bool benchProgramCache = false;
+    bool benchLighting = false;
+    const char* exportShadersDir = nullptr;
+    int textureBudgetMB = -1; // -1 takes the budget from the driver
+    int textureQualityTier = DEFAULT_TEXTURE_QUALITY_TIER;
+    vector<string> importPaths;
+    ModelImportOptions importOptions;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--bench-mesh-cache")
+            benchMeshCache = true;
+        else if (string(argv[i]) == "--geometry-report")
+            geometryReport = true;
+        else if (string(argv[i]) == "--gpu-geometry")
+            gpuGeometry = true;
+        else if (string(argv[i]) == "--validate-gpu-geometry")
+            validateGpuGeometry = true;
+        else if (string(argv[i]) == "--tessellate")
+            tessellateSurfaces = true;
+        else if (string(argv[i]) == "--import" && i + 1 < argc)
+            importPaths.push_back(argv[++i]);
+        else if (string(argv[i]) == "--import-tangents")
+            importOptions.generateTangents = true;
+        else if (string(argv[i]) == "--bench-texture-import")
+            benchTextureImport = true;
+        else if (string(argv[i]) == "--bench-texture-cache")
+            benchTextureCache = true;
+        else if (string(argv[i]) == "--bench-program-cache")
+            benchProgramCache = true;
+        else if (string(argv[i]) == "--no-program-cache")
+            ProgramCache::enabled = false;
+        else if (string(argv[i]) == "--hot-reload-shaders")
+            hotReloadShaders = true;
+        else if (string(argv[i]) == "--uncompressed-textures")
+            compressTextures = false;
+        else if (string(argv[i]) == "--texture-budget" && i + 1 < argc)
+            textureBudgetMB = std::max(0, atoi(argv[++i]));
+        else if (string(argv[i]) == "--virtual-textures")
+            virtualTexturing = true;
+        else if (string(argv[i]) == "--texture-quality" && i + 1 < argc) {
+            int tier = TextureSamplers::FindTier(argv[++i]);
+            if (tier < 0)
+                cout << "Unknown texture quality " << argv[i] << ", using " << TEXTURE_QUALITY_TIERS[textureQualityTier].name << endl;
+            else
+                textureQualityTier = tier;
+        }
+        else if (string(argv[i]) == "--lighting" && i + 1 < argc) {
+            int tier = FindLightingTier(argv[++i]);
+            if (tier < 0)
+                cout << "Unknown lighting tier " << argv[i] << ", using " << LIGHTING_TIERS[lightingTier].name << endl;
+            else
+                lightingTier = tier;
+        }
+        else if (string(argv[i]) == "--bench-lighting")
+            benchLighting = true;
+        else if (string(argv[i]) == "--export-shaders" && i + 1 < argc)
+            exportShadersDir = argv[++i];
+    }
+    tessellationShaderFeatures = TessellationShaderFeatures(lightingTier);
+
+    // Exporting the shader sources needs no window, so it also runs on build machines without a GPU
+    if (exportShadersDir)
+        return ExportShaders(exportShadersDir) ? EXIT_SUCCESS : EXIT_FAILURE;
+
     // Initialize GLFW and create a window
     if (!Initialize(argc, argv, &window))
         return EXIT_FAILURE;
 
-    // Create the shader program for the objects
-    if (!CreateShaders(vertexShaderSource, fragmentShaderSource, objectProgramId)) {
+    // The compressed cache holds S3TC blocks, fall back to RGBA8 where they cannot be sampled
+    if (compressTextures && !TextureCache::Supported()) {
+        cout << "S3TC texture compression not supported, loading uncompressed textures" << endl;
+        compressTextures = false;
+    }
+
+    // Linked programs are restored from their driver binaries when the driver can save them
+    if (ProgramCache::enabled && !ProgramCache::Supported()) {
+        cout << "Program binaries not supported, compiling shaders from source" << endl;
+        ProgramCache::enabled = false;
+    }
+
+    // Texture workers stage mip levels in the upload ring, they fall back to client memory without it
+    if (!textureUploadRing.Create(TEXTURE_UPLOAD_RING_BYTES))
+        cout << "Texture upload ring unavailable, uploading textures from client memory" << endl;
+
+    // Time the texture cache instead of running the scene when requested
+    if (benchTextureCache) {
+        if (compressTextures)
+            BenchmarkTextureCache();
+        glfwTerminate();
+        return compressTextures ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Time the shader startup with the program cache instead of running the scene when requested
+    if (benchProgramCache) {
+        if (ProgramCache::enabled)
+            BenchmarkProgramCache();
+        glfwTerminate();
+        return ProgramCache::enabled ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Time the texture import kernels instead of running the scene when requested
+    if (benchTextureImport) {
+        BenchmarkTextureImport();
+        glfwTerminate();
+        return EXIT_SUCCESS;
+    }
+
+    // Import the requested models and report the throughput instead of running the scene
+    if (!importPaths.empty()) {
+        bool imported = true;
+        {
+            vector<Mesh> models;
+            ModelImportStats totals;
+            for (const string& path : importPaths) {
+                ModelImportStats stats;
+                imported = ImportModel(path, models, importOptions, &stats) && imported;
+                stats.Report(cout, path);
+                totals.bytes += stats.bytes;
+                totals.vertices += stats.vertices;
+                totals.triangles += stats.triangles;
+                totals.meshes += stats.meshes;
+                totals.parseSeconds += stats.parseSeconds;
+                totals.uploadSeconds += stats.uploadSeconds;
+            }
+            if (importPaths.size() > 1)
+                totals.Report(cout, "total");
+        }
+        glfwTerminate();
+        return imported ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Create the shader variants for the objects, starting with the textured, specular one most materials use
+    sceneVariants.Create(vertexShaderSource, fragmentShaderSource, CreateShaders, lightingFunctionsSource);
+    sceneVariants.SetCreated([](ShaderVariant& variant, const std::string& name, const std::string& header) {
+        SetSamplerUniforms(variant.program);
+        WatchSceneVariant(variant, name, header);
+    });
+    if (!sceneVariants.Get(SHADER_TEXTURED | SHADER_SPECULAR | LIGHTING_TIERS[lightingTier].features, SCENE_LIGHT_COUNT)) {
+        sceneVariants.Destroy();
         glfwTerminate();
         return EXIT_FAILURE;
     }
 
-    // Create the shader program for the lights
-    if (!CreateShaders(lightVertexShaderSource, lightFragmentShaderSource, lightProgramId)) {
+    // Create the unlit variant for the lights
+    if (!sceneVariants.Get(0, 0)) {
+        sceneVariants.Destroy();
         glfwTerminate();
         return EXIT_FAILURE;
     }
 
+    // Create the compute program for the GPU geometry path, the CPU generators are used if it fails
+    if (gpuGeometry || validateGpuGeometry) {
+        if (CreateComputeShader(surfaceComputeShaderSource, surfaceComputeProgramId))
+            gpuSurfaces.SetProgram(surfaceComputeProgramId);
+        else
+            cout << "GPU geometry disabled, using the CPU generators" << endl;
+    }
+
+    // Create the tessellation program for the curved surfaces, the baked meshes are drawn if it fails
+    if (tessellateSurfaces) {
+        std::string tessellationFragmentSource = InsertShaderDefines(fragmentShaderSource, sceneVariants.Header(tessellationShaderFeatures, SCENE_LIGHT_COUNT));
+        if (CreateTessellationShaders(surfaceTessVertexShaderSource, surfaceTessControlShaderSource, surfaceTessEvaluationShaderSource,
+            tessellationFragmentSource.c_str(), tessellationProgramId))
+            surfaceTessellator.SetProgram(tessellationProgramId);
+        else
+            cout << "Tessellation disabled, drawing the baked meshes" << endl;
+    }
+
+    // Compare the compute shader surfaces with the CPU generators instead of running the scene when requested
+    if (validateGpuGeometry) {
+        bool passed = gpuSurfaces.IsReady() && ValidateGpuGeometry();
+        sceneVariants.Destroy();
+        DestroyShaders(surfaceComputeProgramId);
+        DestroyShaders(tessellationProgramId);
+        glfwTerminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // load all textures to be utilized
-    textures["cylTopLargeTexture"] = LoadTexture("cylTopLarge.png");
-    textures["cylTopSmallTexture"] = LoadTexture("cylTopSmall.png");
-    textures["cylSidesLongTexture"] = LoadTexture("cylLongSide.png");
-    textures["cylSidesTexture"] = LoadTexture("cylSide.png");
-    textures["Torus"] = LoadTexture("torus.png");
-    textures["Plane"] = LoadTexture("plane.png");
-    textures["Sphere"] = LoadTexture("marble.png");
-    textures["smallLeftSide"] = LoadTexture("left_face.png");
-    textures["smallRightSide"] = LoadTexture("right_face.png");
-    textures["smallFrontSide"] = LoadTexture("front_face.png");
-    textures["smallBackSide"] = LoadTexture("back_face.png");
-    textures["smallTopSide"] = LoadTexture("top_face.png");
-    textures["largeLeftSide"] = LoadTexture("Lleft_face.png");
-    textures["largeRightSide"] = LoadTexture("Lright_face.png");
-    textures["largeFrontSide"] = LoadTexture("Lfront_face.png");
-    textures["largeBackSide"] = LoadTexture("Lback_face.png");
-    textures["largeTopSide"] = LoadTexture("Ltop_face.png");
+    // The files are decoded on worker threads, each texture shows a placeholder until the render loop uploads it
+    // The box faces share one atlas texture when they fit, which is composed on a worker like any other texture
+    // Textures come from textureRegistry, which loads each image file once and tracks it in textureResidency,
+    // which shrinks or evicts the least recently drawn ones when over budget
+    textureResidency.SetBudget(textureBudgetMB >= 0 ? size_t(textureBudgetMB) * 1024 * 1024 : TextureResidency::DefaultBudget());
+    if (textureResidency.Budget() > 0)
+        cout << "Texture budget: " << textureResidency.Budget() / (1024.0 * 1024.0) << " MB" << endl;
+    AsyncTextureLoader textureLoader(DecodeTexture, UploadTexture, FreeTexturePixels);
+    sceneTextureLoader = &textureLoader;
+    TextureRegistry textureRegistry(textureLoader, &textureResidency);
+    bool useBoxAtlas = PlanBoxAtlas();
+
+    // Textures marked virtual, and the box atlas, stream their pages through virtualTextures instead of loading whole
+    // Their tiled files are built next to the texture cache the first time
+    map<string, int> virtualTextureIndices; // scene texture name, or "boxatlas", to its virtualTextures index
+    if (virtualTexturing) {
+        std::string feedbackVertexSource = InsertShaderDefines(vertexShaderSource, sceneVariants.Header(0, 0));
+        if (CreateShaders(feedbackVertexSource.c_str(), virtualFeedbackFragmentShaderSource, virtualFeedbackProgramId) &&
+            virtualTextures.Create(&textureUploadRing, compressTextures, textureImportOptions.srgb, FreeTexturePixels)) {
+            MipOptions mipOptions = MipOptions::For(textureImportOptions);
+            for (const SceneTexture& texture : sceneTextures) {
+                if (texture.virtualTexture) {
+                    TextureCacheKey cacheKey(texture.file, textureImportOptions);
+                    virtualTextureIndices[texture.name] = virtualTextures.Add(cacheKey.Path(".vtex"), texture.file, DecodeVirtualTexturePixels, mipOptions);
+                }
+            }
+            if (useBoxAtlas) {
+                vector<string> sources;
+                for (const AtlasEntry& entry : boxAtlas.Entries())
+                    sources.push_back(entry.path);
+                TextureCacheKey cacheKey("boxatlas", sources, boxAtlas.LayoutHash(), textureImportOptions);
+                virtualTextureIndices["boxatlas"] = virtualTextures.Add(cacheKey.Path(".vtex"), "boxatlas", ComposeBoxAtlas, mipOptions, TextureAtlas::MAX_MIP_LEVEL);
+            }
+        }
+        else {
+            cout << "Virtual texturing disabled, loading every texture whole" << endl;
+        }
+    }
+
+    if (useBoxAtlas && !virtualTextureIndices.count("boxatlas")) {
+        TextureHandle boxAtlasTexture = textureRegistry.Acquire("boxatlas", DecodeBoxAtlas);
+        for (const SceneTexture& texture : sceneTextures) {
+            if (texture.boxFace)
+                textures[texture.name] = boxAtlasTexture;
+        }
+    }
+    for (const SceneTexture& texture : sceneTextures) {
+        if ((!useBoxAtlas || !texture.boxFace) && !virtualTextureIndices.count(texture.name))
+            textures[texture.name] = textureRegistry.Acquire(texture.file);
+    }
 
+    // Run the cold/warm geometry startup benchmark instead of the scene when requested
+    if (benchMeshCache) {
+        textureLoader.Finish();
+        BenchmarkMeshCache();
+        textures.clear();
+        virtualTextures.Destroy();
+        sceneVariants.Destroy();
+        DestroyShaders(surfaceComputeProgramId);
+        DestroyShaders(tessellationProgramId);
+        DestroyShaders(virtualFeedbackProgramId);
+        glfwTerminate();
+        return EXIT_SUCCESS;
+    }
 
     // Declare a vectors to hold all the cylinder, cube, and lightCube objects
     vector<Cylinder> cylinders;
@@ -1587,20 +3264,25 @@ int main(int argc, char* argv[]) {
     vector<LightCube> lCubes;
 
     // Create all mesh objects
-    CreateCylinderMesh(0.1175f, 1.4f, 32, 12, textures["cylTopSmallTexture"], textures["cylSidesLongTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), cylinders);
-    CreateCylinderMesh(0.25f, 0.08f, 24, 8, textures["cylTopSmallTexture"], textures["cylSidesTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, -0.7f, 0.0f), cylinders);
-    CreateCylinderMesh(0.3f, 0.08f, 24, 8, textures["cylTopLargeTexture"], textures["cylSidesTexture"], 16.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.7f, 0.0f), cylinders);
-    CreateTorusMesh(0.04f, 0.26f, 20, 34, textures["Torus"], 128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(0.0f, -0.7f, 0.0f));
-    CreatePlane(18.0f, 18.0f, textures["Plane"], 16.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(0.0f, 0.0f, 0.0f));
-    CreateCubeMesh(1.8f, 1.6f, 2.8f, textures["largeLeftSide"], textures["largeRightSide"], textures["largeFrontSide"], textures["largeBackSide"], textures["largeTopSide"], textures["largeTopSide"],
-        128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(2.0f, 0.8f, 1.1f), -40.0f, cubes);
-    CreateCubeMesh(1.4f, 0.6, 1.4f, textures["smallLeftSide"], textures["smallRightSide"], textures["smallFrontSide"], textures["smallBackSide"], textures["smallTopSide"], textures["smallTopSide"],
-        128.0f, glm::vec3(0.98f, 0.92f, 0.84f), glm::vec3(-2.0f, 0.3f, 2.5f), 10.0f, cubes);
-    CreateSphereMesh(0.22f, textures["Sphere"], 128.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.22f, 2.5f));
-    CreateLightCubes(lCubes);
-    CreateLightCubes(lCubes);
+    CreateSceneGeometry(cylinders, cubes, lCubes);
+    if (geometryReport)
+        GeometryResidency::Get().Report(cout);
+    if (virtualTextureIndices.count("Plane"))
+        plane.virtualTexture = virtualTextureIndices["Plane"];
+    if (virtualTextureIndices.count("boxatlas")) {
+        for (Cube& cube : cubes)
+            cube.virtualTexture = virtualTextureIndices["boxatlas"];
+    }
 
-    glUseProgram(objectProgramId);
+    // Compile the variants of the remaining materials now rather than on the frame that first draws them
+    for (const Cylinder& cylinder : cylinders)
+        sceneVariants.Get(MaterialFeatures(cylinder.cylMaterial), SCENE_LIGHT_COUNT);
+    for (const Cube& cube : cubes)
+        sceneVariants.Get(MaterialFeatures(cube.cubeMaterial, cube.virtualTexture), SCENE_LIGHT_COUNT);
+    sceneVariants.Get(MaterialFeatures(torus.torusMaterial), SCENE_LIGHT_COUNT);
+    sceneVariants.Get(MaterialFeatures(plane.planeMaterial, plane.virtualTexture), SCENE_LIGHT_COUNT);
+    sceneVariants.Get(MaterialFeatures(sphere.sphereMaterial), SCENE_LIGHT_COUNT);
+    cout << "Shader variants: " << sceneVariants.Count() << endl;
     
     // Assign properties to point lights
     // point light 1
@@ -1627,43 +3309,93 @@ int main(int argc, char* argv[]) {
     pointLights[2].specularIntensity = 0.25f;
     pointLights[2].highlightSize = 0.1f;
 
-    glUniform1i(glGetUniformLocation(objectProgramId, "uTexture"), 0);
+    // Every scene texture is sampled on unit 0 through the shared sampler, the virtual textures keep their own filtering
+    textureSamplers.Create(gTexWrapMode, textureQualityTier);
+    textureSamplers.Bind(0);
+    cout << "Texture quality: " << textureSamplers.TierName() << endl;
+
+    if (UseTessellation())
+        SetSamplerUniforms(tessellationProgramId);
+
+    // Time the frames of every lighting tier when requested, the report below prints them instead of running the scene
+    lightingTimer.Create(LIGHTING_TIER_COUNT);
+    cout << "Lighting: " << LIGHTING_TIERS[lightingTier].name << endl;
+    if (benchLighting) {
+        textureLoader.Finish();
+        BenchmarkLighting(cylinders, cubes, lCubes);
+        glfwSetWindowShouldClose(window, true);
+    }
+
+    // Recompile the programs whose files change in shaderfiles from now on
+    if (hotReloadShaders && shaderReloader.Start(SHADER_RELOAD_DIR, window))
+        WatchShaderFiles();
 
     // Main render loop
+    bool texturesReported = false;
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // Upload the textures that finished decoding, a few per frame to avoid hitches
+        textureUploadRing.Reclaim();
+        textureLoader.Poll(TEXTURE_UPLOADS_PER_FRAME);
+        if (!texturesReported && textureLoader.Idle()) {
+            cout << "All textures loaded after " << textureLoader.MillisecondsToIdle() << " ms ("
+                << textureMemoryBytes / (1024.0 * 1024.0) << " MB of texture memory)" << endl;
+            texturesReported = true;
+        }
+
         ProcessInput(window);
 
+        // Swap in the shaders that finished recompiling since the last frame
+        if (hotReloadShaders)
+            shaderReloader.Update();
+
+        lightingTimer.Begin(lightingTier);
         Render(cylinders, cubes, lCubes);
+        lightingTimer.End();
+
+        // Shrink or evict textures when over budget, and stream back the ones drawn again
+        textureResidency.Update(textureLoader);
+
+        // Stream in the virtual texture pages the feedback pass asked for
+        if (virtualTextures.Count() > 0)
+            virtualTextures.Update();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    if (textureResidency.Budget() > 0)
+        textureResidency.Report(cout);
+    if (virtualTextures.Count() > 0)
+        virtualTextures.Report(cout);
+
+    // GPU time of a frame in every lighting tier that was drawn
+    lightingTimer.Collect(true);
+    for (int tier = 0; tier < LIGHTING_TIER_COUNT; ++tier) {
+        if (lightingTimer.Samples(tier) > 0) {
+            cout << "Lighting " << LIGHTING_TIERS[tier].name << ": " << lightingTimer.AverageMilliseconds(tier) << " ms GPU per frame ("
+                << lightingTimer.Samples(tier) << " frames)" << endl;
+        }
+    }
+
     // Clean up resources
-    DestroyShaders(objectProgramId);
-    DestroyShaders(lightProgramId);
-
-    DestroyTexture(textures["Plane"]);
-    DestroyTexture(textures["cylTopLargeTexture"]);
-    DestroyTexture(textures["cylTopSmallTexture"]);
-    DestroyTexture(textures["cylSidesLongTexture"]);
-    DestroyTexture(textures["cylSidesTexture"]);
-    DestroyTexture(textures["Torus"]);
-    DestroyTexture(textures["smallLeftSide"]);
-    DestroyTexture(textures["smallRightSide"]);
-    DestroyTexture(textures["smallTopSide"]);
-    DestroyTexture(textures["smallBackSide"]);
-    DestroyTexture(textures["smallFrontSide"]);
-    DestroyTexture(textures["largeLeftSide"]);
-    DestroyTexture(textures["largeRightSide"]);
-    DestroyTexture(textures["largeTopSide"]);
-    DestroyTexture(textures["largeBackSide"]);
-    DestroyTexture(textures["largeFrontSide"]);
-    DestroyTexture(textures["Sphere"]);
+    DestroySceneGeometry(cylinders, cubes, lCubes);
+    shaderReloader.Stop();
+    sceneVariants.Destroy();
+    DestroyShaders(surfaceComputeProgramId);
+    DestroyShaders(tessellationProgramId);
+    DestroyShaders(virtualFeedbackProgramId);
+
+    textureRegistry.Report(cout);
+    textures.clear();
+    textureLoader.Stop();
+    virtualTextures.Destroy();
+    textureSamplers.Destroy();
+    textureUploadRing.Destroy();
+    lightingTimer.Destroy();
 
     glfwTerminate();
 
@@ -0,0 +1,247 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* BC1/BC3 block compression
+* Encodes RGBA8 images into the S3TC block formats every desktop GPU samples
+* natively, 4x4 texels per block:
+* - BC1 (DXT1) stores opaque color in 8 bytes, 1/8 of RGBA8
+* - BC3 (DXT5) adds an interpolated alpha block, 16 bytes, 1/4 of RGBA8
+*
+* The color endpoints come from the principal axis of the block's colors and
+* are then refined once by least squares against the chosen indices, which is
+* close to the quality of the common offline tools at a fraction of their cost
+*/
+
+#ifndef BCENCODER_H
+#define BCENCODER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+const int BC_BLOCK_SIZE = 4;
+const size_t BC1_BLOCK_BYTES = 8;
+const size_t BC3_BLOCK_BYTES = 16;
+
+// Bytes of one BC1 or BC3 image, partial blocks at the edges count as whole blocks
+inline size_t BCImageSize(int width, int height, bool alpha)
+{
+    size_t blocks = size_t((width + 3) / 4) * size_t((height + 3) / 4);
+    return blocks * (alpha ? BC3_BLOCK_BYTES : BC1_BLOCK_BYTES);
+}
+
+inline uint16_t PackRgb565(const float color[3])
+{
+    int r = std::min(31, std::max(0, int(color[0] * (31.0f / 255.0f) + 0.5f)));
+    int g = std::min(63, std::max(0, int(color[1] * (63.0f / 255.0f) + 0.5f)));
+    int b = std::min(31, std::max(0, int(color[2] * (31.0f / 255.0f) + 0.5f)));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackRgb565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/*
+* Picks the nearest of the four BC1 palette colors for every texel
+* @params c0, c1: packed endpoints with c0 > c1, so the block is in four color mode
+* @return the summed squared error of the block
+*/
+inline int SelectBC1Indices(const unsigned char* texels, uint16_t c0, uint16_t c1, uint32_t& indices)
+{
+    int palette[4][3];
+    UnpackRgb565(c0, palette[0]);
+    UnpackRgb565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i) {
+        const unsigned char* t = texels + i * 4;
+        int best = 0, bestDistance = INT32_MAX;
+        for (int p = 0; p < 4; ++p) {
+            int dr = t[0] - palette[p][0], dg = t[1] - palette[p][1], db = t[2] - palette[p][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = p;
+            }
+        }
+        indices |= uint32_t(best) << (i * 2);
+        error += bestDistance;
+    }
+    return error;
+}
+
+// Packs two endpoints in four color order and picks their indices
+inline int FitBC1Endpoints(const unsigned char* texels, const float e0[3], const float e1[3], uint16_t& c0, uint16_t& c1, uint32_t& indices)
+{
+    c0 = PackRgb565(e0);
+    c1 = PackRgb565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    if (c0 == c1) {
+        // Both endpoints quantize to the same color; nudge one so the block stays in four color mode
+        if (c1 > 0)
+            --c1;
+        else
+            ++c0;
+    }
+    return SelectBC1Indices(texels, c0, c1, indices);
+}
+
+/*
+* Encodes the color of a 4x4 block of RGBA texels as a BC1 block in four color mode
+* BC3 reuses this for its color half, where three color mode is not available
+*/
+inline void EncodeBC1Block(const unsigned char* texels, unsigned char* out)
+{
+    // Mean and covariance of the block colors
+    float mean[3] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c)
+            mean[c] += texels[i * 4 + c];
+    }
+    for (int c = 0; c < 3; ++c)
+        mean[c] /= 16.0f;
+
+    float cov[6] = {}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i) {
+        float r = texels[i * 4] - mean[0], g = texels[i * 4 + 1] - mean[1], b = texels[i * 4 + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // Principal axis by power iteration, starting from the widest channel
+    float axis[3] = { cov[0], cov[3], cov[5] };
+    for (int iteration = 0; iteration < 4; ++iteration) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length <= 0.0f)
+            break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+    float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    // Project the texels on the axis, the extremes are the first endpoint estimate
+    float minT = 0.0f, maxT = 0.0f;
+    if (axisLength > 0.0f) {
+        minT = maxT = ((texels[0] - mean[0]) * axis[0] + (texels[1] - mean[1]) * axis[1] + (texels[2] - mean[2]) * axis[2]) / axisLength;
+        for (int i = 1; i < 16; ++i) {
+            float t = ((texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2]) / axisLength;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + axis[c] * maxT;
+        e1[c] = mean[c] + axis[c] * minT;
+    }
+
+    uint16_t c0, c1;
+    uint32_t indices;
+    int error = FitBC1Endpoints(texels, e0, e1, c0, c1, indices);
+
+    // Least squares refinement: solve for the endpoints that best reproduce the texels with these indices
+    if (error > 0) {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; ++i) {
+            float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a * texels[i * 4 + c];
+                bx[c] += b * texels[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) > 1e-6f) {
+            float r0[3], r1[3];
+            for (int c = 0; c < 3; ++c) {
+                r0[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+                r1[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+            }
+            uint16_t refined0, refined1;
+            uint32_t refinedIndices;
+            if (FitBC1Endpoints(texels, r0, r1, refined0, refined1, refinedIndices) < error) {
+                c0 = refined0;
+                c1 = refined1;
+                indices = refinedIndices;
+            }
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(c0);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+// Encodes the alpha of a 4x4 block as the 8 byte interpolated alpha half of BC3
+inline void EncodeBC3AlphaBlock(const unsigned char* texels, unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, int(texels[i * 4 + 3]));
+        a1 = std::min(a1, int(texels[i * 4 + 3]));
+    }
+
+    // a0 > a1 selects eight value mode: a0, a1 and six steps between them
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        static const int order[8] = { 1, 7, 6, 5, 4, 3, 2, 0 }; // index of the k-th step from a1 to a0
+        for (int i = 0; i < 16; ++i) {
+            int step = ((texels[i * 4 + 3] - a1) * 14 + (a0 - a1)) / ((a0 - a1) * 2);
+            indices |= uint64_t(order[step]) << (i * 3);
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(a0);
+    out[1] = static_cast<unsigned char>(a1);
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+/*
+* Compresses a whole RGBA8 image, row 0 first like the uploaded texture
+* Edge blocks repeat the last row/column so partial blocks stay well fitted
+* @params alpha: true writes BC3, false writes BC1 and ignores alpha
+*         out: BCImageSize(width, height, alpha) bytes
+*/
+inline void EncodeBCImage(const unsigned char* rgba, int width, int height, bool alpha, unsigned char* out)
+{
+    unsigned char texels[64];
+    for (int by = 0; by < height; by += BC_BLOCK_SIZE) {
+        for (int bx = 0; bx < width; bx += BC_BLOCK_SIZE) {
+            for (int y = 0; y < BC_BLOCK_SIZE; ++y) {
+                int sy = std::min(by + y, height - 1);
+                for (int x = 0; x < BC_BLOCK_SIZE; ++x) {
+                    int sx = std::min(bx + x, width - 1);
+                    memcpy(texels + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+                }
+            }
+
+            if (alpha) {
+                EncodeBC3AlphaBlock(texels, out);
+                out += 8;
+            }
+            EncodeBC1Block(texels, out);
+            out += BC1_BLOCK_BYTES;
+        }
+    }
+}
+
+#endif
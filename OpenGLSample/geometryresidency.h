@@ -0,0 +1,104 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Geometry residency policy
+* Decides whether CPU side copies of vertex/index data are kept after the
+* data has been uploaded to the GPU, and accounts for the memory per category
+*
+* By default nothing is retained. Systems that read geometry on the CPU
+* (picking, physics, a BVH) must call Request before the meshes are created
+*/
+
+#ifndef GEOMETRYRESIDENCY_H
+#define GEOMETRYRESIDENCY_H
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// CPU side consumers of mesh geometry, combined as bit flags
+enum GeometryConsumer : unsigned int {
+    GEOMETRY_CONSUMER_NONE = 0,
+    GEOMETRY_CONSUMER_PICKING = 1 << 0,
+    GEOMETRY_CONSUMER_PHYSICS = 1 << 1,
+    GEOMETRY_CONSUMER_BVH = 1 << 2
+};
+
+// Accounting buckets, one per kind of mesh owner
+enum GeometryCategory {
+    GEOMETRY_CYLINDER,
+    GEOMETRY_TORUS,
+    GEOMETRY_MESH,
+    GEOMETRY_CATEGORY_COUNT
+};
+
+class GeometryResidency
+{
+public:
+    // Process wide policy shared by Source.cpp and mesh.h
+    static GeometryResidency& Get()
+    {
+        static GeometryResidency residency;
+        return residency;
+    }
+
+    // Registers consumers that need CPU copies of meshes created from now on
+    void Request(unsigned int consumer) { consumers |= consumer; }
+
+    // Unregisters consumers; meshes created from now on are released if no consumer is left
+    void Release(unsigned int consumer) { consumers &= ~consumer; }
+
+    bool RetainsCpuCopies() const { return consumers != GEOMETRY_CONSUMER_NONE; }
+
+    // Records a CPU copy of the given size as kept or dropped for the category
+    void Account(GeometryCategory category, size_t bytes, bool retained)
+    {
+        if (retained)
+            retainedBytes[category] += bytes;
+        else
+            releasedBytes[category] += bytes;
+    }
+
+    // Forgets the bytes accounted so far, once every mesh they were accounted for has been destroyed
+    void ClearAccounts()
+    {
+        for (int i = 0; i < GEOMETRY_CATEGORY_COUNT; ++i) {
+            retainedBytes[i] = 0;
+            releasedBytes[i] = 0;
+        }
+    }
+
+    /*
+    * Applies the policy to a CPU copy that has already been uploaded
+    * The vector is emptied and its storage freed unless a consumer needs it
+    */
+    template <typename T>
+    void Settle(GeometryCategory category, std::vector<T>& data)
+    {
+        bool retain = RetainsCpuCopies();
+        Account(category, data.size() * sizeof(T), retain);
+        if (!retain)
+            std::vector<T>().swap(data);
+    }
+
+    // Prints the retained and released CPU bytes for every category
+    void Report(std::ostream& out) const
+    {
+        static const char* const names[GEOMETRY_CATEGORY_COUNT] = { "cylinder", "torus", "mesh" };
+
+        size_t totalRetained = 0, totalReleased = 0;
+        out << "Geometry residency (consumers 0x" << std::hex << consumers << std::dec << ")" << std::endl;
+        for (int i = 0; i < GEOMETRY_CATEGORY_COUNT; ++i) {
+            out << "  " << names[i] << ": " << retainedBytes[i] << " bytes retained, " << releasedBytes[i] << " bytes released" << std::endl;
+            totalRetained += retainedBytes[i];
+            totalReleased += releasedBytes[i];
+        }
+        out << "  total: " << totalRetained << " bytes retained, " << totalReleased << " bytes released" << std::endl;
+    }
+
+private:
+    unsigned int consumers = GEOMETRY_CONSUMER_NONE;
+    size_t retainedBytes[GEOMETRY_CATEGORY_COUNT] = {};
+    size_t releasedBytes[GEOMETRY_CATEGORY_COUNT] = {};
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Compute shader surface generation
+* Runs the sphere, torus and cylinder mappings from parametric.h on the GPU and
+* writes SurfaceVertex data and triangle indices straight into buffers that are
+* then used as the VBO and EBO, so nothing crosses the bus at load time
+*
+* The buffers are only reallocated when a surface grows, so re-tessellating a
+* mesh at a different segment count is a single dispatch
+* The compute program itself is created in Source.cpp next to the other shaders
+*/
+
+#ifndef GPUSURFACE_H
+#define GPUSURFACE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "parametric.h"
+#include "shaderlibrary.h"
+
+// Surface kinds understood by the compute shader
+enum GpuSurfaceKind {
+    GPU_SURFACE_SPHERE = 0,   // params.x = radius
+    GPU_SURFACE_TORUS = 1,    // params.x = inner (tube) radius, params.y = outer radius
+    GPU_SURFACE_CYLINDER = 2  // params.x = radius, params.y = height
+};
+
+const GLuint GPU_SURFACE_WORKGROUP_SIZE = 64; // must match local_size_x in the compute shader
+
+class GpuSurfaceGenerator
+{
+public:
+    // Uses the linked surface compute program for every later Generate call
+    void SetProgram(GLuint computeProgram)
+    {
+        program = computeProgram;
+        kindLoc = ShaderLibrary::Get().Uniform(program, "surfaceKind");
+        paramsLoc = ShaderLibrary::Get().Uniform(program, "surfaceParams");
+        segmentsLoc = ShaderLibrary::Get().Uniform(program, "segments");
+    }
+
+    bool IsReady() const { return program != 0; }
+
+    /*
+    * Writes the surface into vbo and ebo, growing them when they are too small
+    * The grid and index order match ParametricSurface<F>::Generate
+    * The program in use before the call is in use again afterwards
+    * @return the number of indices written
+    */
+    unsigned int Generate(GpuSurfaceKind kind, const glm::vec4& params, int uSegments, int vSegments, GLuint vbo, GLuint ebo)
+    {
+        GLuint vertexCount = GLuint(uSegments + 1) * GLuint(vSegments + 1);
+        GLuint indexCount = GLuint(uSegments) * GLuint(vSegments) * 6;
+        Reserve(vbo, size_t(vertexCount) * sizeof(SurfaceVertex));
+        Reserve(ebo, size_t(indexCount) * sizeof(GLuint));
+
+        GLint previousProgram = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glUseProgram(program);
+        glUniform1i(kindLoc, kind);
+        glUniform4f(paramsLoc, params.x, params.y, params.z, params.w);
+        glUniform2i(segmentsLoc, uSegments, vSegments);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vbo);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ebo);
+        glDispatchCompute((vertexCount + GPU_SURFACE_WORKGROUP_SIZE - 1) / GPU_SURFACE_WORKGROUP_SIZE, 1, 1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+
+        // Make the shader writes visible to vertex fetch, index fetch and buffer reads
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glUseProgram(GLuint(previousProgram));
+        return indexCount;
+    }
+
+private:
+    GLuint program = 0;
+    GLint kindLoc = -1;
+    GLint paramsLoc = -1;
+    GLint segmentsLoc = -1;
+
+    // Grows a buffer to at least bytes; smaller requests keep the existing storage
+    static void Reserve(GLuint buffer, size_t bytes)
+    {
+        // The storage buffer target is used so the bound VAO's element buffer is left alone
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        GLint64 size = 0;
+        glGetBufferParameteri64v(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &size);
+        if (size_t(size) < bytes)
+            glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+
+#endif
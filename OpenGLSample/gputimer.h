@@ -0,0 +1,103 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* GPU timer
+* Measures how long the GPU spends on a span of commands with GL_TIME_ELAPSED
+* queries, e.g. one frame of Render. The results are read frames later, once
+* the GPU has them, so timing never waits for the GPU to catch up. Every span
+* is recorded under a slot, e.g. the lighting tier the frame was drawn with,
+* and each slot keeps its own average
+*/
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+class GpuTimer
+{
+public:
+    static constexpr int QUERY_COUNT = 8; // spans in flight, a few frames' worth
+
+    // Creates the queries, call once on the GL thread
+    void Create(int slotCount)
+    {
+        glGenQueries(QUERY_COUNT, queries);
+        for (int& slot : querySlots)
+            slot = -1;
+        totalMilliseconds.assign(size_t(slotCount), 0.0);
+        samples.assign(size_t(slotCount), 0);
+        created = true;
+    }
+
+    void Destroy()
+    {
+        if (created)
+            glDeleteQueries(QUERY_COUNT, queries);
+        created = false;
+    }
+
+    // Starts timing the commands issued until End, skipped while every query is still in flight
+    void Begin(int slot)
+    {
+        Collect(false);
+        active = -1;
+        for (int i = 0; i < QUERY_COUNT && created; ++i) {
+            if (querySlots[i] < 0) {
+                active = i;
+                break;
+            }
+        }
+        if (active < 0)
+            return;
+
+        querySlots[active] = slot;
+        glBeginQuery(GL_TIME_ELAPSED, queries[active]);
+    }
+
+    void End()
+    {
+        if (active >= 0)
+            glEndQuery(GL_TIME_ELAPSED);
+        active = -1;
+    }
+
+    /*
+    * Adds the finished spans to their slots
+    * @params wait: also waits for the spans still in flight, e.g. before a report
+    */
+    void Collect(bool wait)
+    {
+        for (int i = 0; i < QUERY_COUNT; ++i) {
+            if (querySlots[i] < 0 || i == active)
+                continue;
+
+            GLint available = GL_TRUE;
+            if (!wait)
+                glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            totalMilliseconds[querySlots[i]] += double(nanoseconds) * 1e-6;
+            ++samples[querySlots[i]];
+            querySlots[i] = -1;
+        }
+    }
+
+    double AverageMilliseconds(int slot) const { return samples[slot] ? totalMilliseconds[slot] / samples[slot] : 0.0; }
+
+    unsigned int Samples(int slot) const { return samples[slot]; }
+
+private:
+    GLuint queries[QUERY_COUNT] = {};
+    int querySlots[QUERY_COUNT] = {}; // slot each query is timing, -1 when it is free
+    int active = -1;                  // query between Begin and End
+    bool created = false;
+    std::vector<double> totalMilliseconds;
+    std::vector<unsigned int> samples;
+};
+
+#endif
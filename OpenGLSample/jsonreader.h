@@ -0,0 +1,306 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Minimal JSON reader
+* Parses a JSON document into a tree of JsonValue nodes, enough to read the
+* glTF scene description; binary payloads never go through this parser
+*/
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct JsonValue {
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+    Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;                           // array elements
+    std::vector<std::pair<std::string, JsonValue>> members; // object members in file order
+
+    // Member with the given key, nullptr if this is not an object or the key is missing
+    const JsonValue* Find(const std::string& key) const
+    {
+        for (const auto& member : members) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+
+    // Element i of an array, nullptr when out of range
+    const JsonValue* At(size_t i) const { return i < items.size() ? &items[i] : nullptr; }
+
+    size_t Size() const { return type == JSON_ARRAY ? items.size() : members.size(); }
+
+    // Number of the given member, or fallback when it is missing or not a number
+    double Number(const std::string& key, double fallback) const
+    {
+        const JsonValue* value = Find(key);
+        return value && value->type == JSON_NUMBER ? value->number : fallback;
+    }
+
+    // String of the given member, or an empty string
+    std::string String(const std::string& key) const
+    {
+        const JsonValue* value = Find(key);
+        return value && value->type == JSON_STRING ? value->text : std::string();
+    }
+};
+
+class JsonReader
+{
+public:
+    /*
+    * Parses text into root
+    * @return false with a message in Error() if the text is not valid JSON
+    */
+    bool Parse(const char* text, size_t length, JsonValue& root)
+    {
+        p = text;
+        end = text + length;
+        error.clear();
+        SkipSpace();
+        if (!ParseValue(root, 0))
+            return false;
+        SkipSpace();
+        if (p != end)
+            return Fail("unexpected data after the document");
+        return true;
+    }
+
+    const std::string& Error() const { return error; }
+
+private:
+    const char* p = nullptr;
+    const char* end = nullptr;
+    std::string error;
+
+    static const int MAX_DEPTH = 256;
+
+    bool Fail(const char* message)
+    {
+        error = message;
+        return false;
+    }
+
+    void SkipSpace()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            ++p;
+    }
+
+    bool Literal(const char* word)
+    {
+        for (; *word; ++word, ++p) {
+            if (p >= end || *p != *word)
+                return Fail("invalid literal");
+        }
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return Fail("document nested too deeply");
+        if (p >= end)
+            return Fail("unexpected end of document");
+
+        switch (*p) {
+        case '{': return ParseObject(value, depth);
+        case '[': return ParseArray(value, depth);
+        case '"':
+            value.type = JsonValue::JSON_STRING;
+            return ParseString(value.text);
+        case 't':
+            value.type = JsonValue::JSON_BOOL;
+            value.boolean = true;
+            return Literal("true");
+        case 'f':
+            value.type = JsonValue::JSON_BOOL;
+            return Literal("false");
+        case 'n':
+            value.type = JsonValue::JSON_NULL;
+            return Literal("null");
+        default:
+            return ParseNumber(value);
+        }
+    }
+
+    bool ParseNumber(JsonValue& value)
+    {
+        // strtod needs a terminated string, numbers are short so copy the token
+        const char* start = p;
+        while (p < end && (*p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E' || (*p >= '0' && *p <= '9')))
+            ++p;
+        if (p == start)
+            return Fail("unexpected character");
+
+        std::string token(start, p);
+        char* parsedEnd = nullptr;
+        value.type = JsonValue::JSON_NUMBER;
+        value.number = std::strtod(token.c_str(), &parsedEnd);
+        if (parsedEnd != token.c_str() + token.size())
+            return Fail("invalid number");
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, unsigned long code)
+    {
+        if (code < 0x80) {
+            out += char(code);
+        }
+        else if (code < 0x800) {
+            out += char(0xC0 | (code >> 6));
+            out += char(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            out += char(0xE0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        }
+        else {
+            out += char(0xF0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3F));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ParseHex4(unsigned long& code)
+    {
+        if (end - p < 4)
+            return Fail("truncated escape");
+        code = 0;
+        for (int i = 0; i < 4; ++i, ++p) {
+            char c = *p;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return Fail("invalid escape");
+        }
+        return true;
+    }
+
+    bool ParseString(std::string& out)
+    {
+        ++p; // opening quote
+        out.clear();
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+
+            if (++p >= end)
+                break;
+            char c = *p++;
+            switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long code;
+                if (!ParseHex4(code))
+                    return false;
+                // Combine a surrogate pair into one code point
+                if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    p += 2;
+                    unsigned long low;
+                    if (!ParseHex4(low))
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default:
+                return Fail("invalid escape");
+            }
+        }
+
+        if (p >= end)
+            return Fail("unterminated string");
+        ++p; // closing quote
+        return true;
+    }
+
+    bool ParseArray(JsonValue& value, int depth)
+    {
+        value.type = JsonValue::JSON_ARRAY;
+        ++p;
+        SkipSpace();
+        if (p < end && *p == ']') {
+            ++p;
+            return true;
+        }
+
+        for (;;) {
+            value.items.emplace_back();
+            SkipSpace();
+            if (!ParseValue(value.items.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == ']') {
+                ++p;
+                return true;
+            }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ParseObject(JsonValue& value, int depth)
+    {
+        value.type = JsonValue::JSON_OBJECT;
+        ++p;
+        SkipSpace();
+        if (p < end && *p == '}') {
+            ++p;
+            return true;
+        }
+
+        for (;;) {
+            SkipSpace();
+            if (p >= end || *p != '"')
+                return Fail("expected a member name");
+            value.members.emplace_back();
+            if (!ParseString(value.members.back().first))
+                return false;
+            SkipSpace();
+            if (p >= end || *p != ':')
+                return Fail("expected ':'");
+            ++p;
+            SkipSpace();
+            if (!ParseValue(value.members.back().second, depth + 1))
+                return false;
+            SkipSpace();
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == '}') {
+                ++p;
+                return true;
+            }
+            return Fail("expected ',' or '}'");
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Read-only memory mapped file
+* Maps a whole file into the address space so cached asset data can be handed
+* straight to OpenGL without reading it into an intermediate buffer
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+* Move-only owner of a read-only file mapping
+* The mapping is released when the object is destroyed or Close is called
+*/
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            data = other.data;
+            size = other.size;
+#ifdef _WIN32
+            mapping = other.mapping;
+            other.mapping = nullptr;
+#endif
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    /*
+    * Maps the file at path into memory
+    * Returns false if the file does not exist, is empty, or cannot be mapped
+    */
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file); // the mapping keeps its own reference to the file
+        if (!mapping)
+            return false;
+
+        data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping stays valid after the descriptor is closed
+        if (view == MAP_FAILED)
+            return false;
+
+        data = static_cast<const unsigned char*>(view);
+        size = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    // Unmaps the file, safe to call on an unopened object
+    void Close()
+    {
+        if (!data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif
@@ -7,8 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "geometryresidency.h"
+#include "shaderlibrary.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -31,39 +37,270 @@ struct Texture {
 	string path;
 };
 
+// set the vertex attribute pointers of the bound VAO for the Vertex layout in the bound VBO
+inline void SetupVertexAttributes()
+{
+	// vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	// vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	// vertex texture coords
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	// vertex tangent
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	// vertex bitangent
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+// the GL objects and index range a mesh draws from
+struct MeshBuffers {
+	unsigned int VAO = 0;
+	unsigned int VBO = 0;
+	unsigned int EBO = 0;
+	unsigned int indexCount = 0;
+	size_t indexOffset = 0; // byte offset of the first index inside EBO
+	int baseVertex = 0;     // added to every index, for meshes packed into a shared VBO
+	bool owned = true;      // false when a MeshPool keeps ownership of the GL objects
+};
+
+/*
+* Packs many meshes into one VAO/VBO/EBO so they can be uploaded without a
+* buffer per mesh; meshes built from Allocate only borrow the pool's objects
+* The pool must outlive every mesh that adopts its buffers
+*/
+class MeshPool {
+public:
+	MeshPool(size_t maxVertices, size_t maxIndices) : vertexCapacity(maxVertices), indexCapacity(maxIndices)
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, maxIndices * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+		SetupVertexAttributes();
+		glBindVertexArray(0);
+	}
+	~MeshPool() { release(); }
+
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+
+	MeshPool(MeshPool&& other) noexcept { *this = std::move(other); }
+	MeshPool& operator=(MeshPool&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			VAO = std::exchange(other.VAO, 0);
+			VBO = std::exchange(other.VBO, 0);
+			EBO = std::exchange(other.EBO, 0);
+			vertexCapacity = std::exchange(other.vertexCapacity, 0);
+			indexCapacity = std::exchange(other.indexCapacity, 0);
+			vertexCount = std::exchange(other.vertexCount, 0);
+			indexCount = std::exchange(other.indexCount, 0);
+		}
+		return *this;
+	}
+
+	/*
+	* Copies the geometry into the next free range of the pool
+	* Returns false and leaves the pool unchanged if the geometry does not fit
+	*/
+	bool Allocate(const Vertex* vertexData, size_t numVertices, const unsigned int* indexData, size_t numIndices, MeshBuffers& buffers)
+	{
+		if (vertexCount + numVertices > vertexCapacity || indexCount + numIndices > indexCapacity)
+			return false;
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), numVertices * sizeof(Vertex), vertexData);
+		// the element binding belongs to whatever VAO is bound, so the indices go through the copy target instead
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), numIndices * sizeof(unsigned int), indexData);
+
+		buffers.VAO = VAO;
+		buffers.VBO = VBO;
+		buffers.EBO = EBO;
+		buffers.indexCount = static_cast<unsigned int>(numIndices);
+		buffers.indexOffset = indexCount * sizeof(unsigned int);
+		buffers.baseVertex = static_cast<int>(vertexCount);
+		buffers.owned = false;
+
+		vertexCount += numVertices;
+		indexCount += numIndices;
+		return true;
+	}
+
+private:
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	size_t vertexCapacity = 0, indexCapacity = 0;
+	size_t vertexCount = 0, indexCount = 0;
+
+	void release()
+	{
+		if (VAO)
+			glDeleteVertexArrays(1, &VAO);
+		if (VBO)
+			glDeleteBuffers(1, &VBO);
+		if (EBO)
+			glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+};
+
+/*
+* Move-only mesh that owns its GL objects and deletes them when destroyed
+* Copying is disabled so a mesh can never be duplicated by accident, which
+* used to double peak memory and leave the copy's GL objects behind
+*/
 class Mesh {
 public:
 	// mesh Data
+	// vertices and indices are emptied after upload unless GeometryResidency has a consumer for them
 	vector<Vertex>       vertices;
 	vector<unsigned int> indices;
 	vector<Texture>      textures;
-	unsigned int VAO;
+	unsigned int VAO = 0;
+	unsigned int indexCount = 0;
 
-	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// constructor, takes ownership of the vectors without copying them
+	Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
-
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
+		setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+
+		// the GPU owns the geometry now, only keep the CPU copies if picking/physics/BVH asked for them
+		GeometryResidency::Get().Settle(GEOMETRY_MESH, this->vertices);
+		GeometryResidency::Get().Settle(GEOMETRY_MESH, this->indices);
+	}
+
+	// constructor, uploads straight from caller memory (e.g. a mapped file) without an intermediate vector
+	Mesh(const Vertex* vertexData, size_t numVertices, const unsigned int* indexData, size_t numIndices, vector<Texture>&& textures)
+		: textures(std::move(textures))
+	{
+		setupMesh(vertexData, numVertices, indexData, numIndices);
+
+		// only copy the geometry to the CPU side if a consumer needs it
+		bool retain = GeometryResidency::Get().RetainsCpuCopies();
+		GeometryResidency::Get().Account(GEOMETRY_MESH, numVertices * sizeof(Vertex) + numIndices * sizeof(unsigned int), retain);
+		if (retain)
+		{
+			vertices.assign(vertexData, vertexData + numVertices);
+			indices.assign(indexData, indexData + numIndices);
+		}
+	}
+
+	// constructor, adopts buffers that were already filled, e.g. a range handed out by MeshPool
+	Mesh(const MeshBuffers& buffers, vector<Texture>&& textures)
+		: textures(std::move(textures)), VAO(buffers.VAO), indexCount(buffers.indexCount),
+		VBO(buffers.VBO), EBO(buffers.EBO), indexOffset(buffers.indexOffset), baseVertex(buffers.baseVertex), owned(buffers.owned)
+	{
+	}
+
+	~Mesh() { release(); }
+
+	// forces Draw to resolve the sampler bindings again, call after changing textures
+	void InvalidateSamplers() { samplerBindings.clear(); }
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	Mesh(Mesh&& other) noexcept { *this = std::move(other); }
+	Mesh& operator=(Mesh&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			vertices = std::move(other.vertices);
+			indices = std::move(other.indices);
+			textures = std::move(other.textures);
+			VAO = std::exchange(other.VAO, 0);
+			indexCount = std::exchange(other.indexCount, 0);
+			VBO = std::exchange(other.VBO, 0);
+			EBO = std::exchange(other.EBO, 0);
+			indexOffset = std::exchange(other.indexOffset, 0);
+			baseVertex = std::exchange(other.baseVertex, 0);
+			owned = std::exchange(other.owned, false);
+			samplerBindings = std::move(other.samplerBindings);
+		}
+		return *this;
 	}
 
 	// render the mesh
 	void Draw(Shader &shader)
 	{
-		// bind appropriate textures
+		// sampler names are only looked up the first time the mesh is drawn with a shader
+		ProgramReflection& reflection = ShaderLibrary::Get().Reflection(shader.ID);
+		SamplerBinding& binding = samplerBindings[shader.ID];
+		if (binding.reflection != reflection.Serial())
+			resolveSamplers(reflection, binding);
+
+		// bind appropriate textures, the shader's samplers already point at their units
+		const vector<GLuint>& unitTextures = binding.unitTextures;
+		if (GLAD_GL_VERSION_4_4)
+		{
+			glBindTextures(0, static_cast<GLsizei>(unitTextures.size()), unitTextures.data());
+		}
+		else
+		{
+			for (unsigned int i = 0; i < unitTextures.size(); i++)
+			{
+				glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+				glBindTexture(GL_TEXTURE_2D, unitTextures[i]);
+			}
+		}
+
+		// draw mesh
+		glBindVertexArray(VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)indexOffset, baseVertex);
+		glBindVertexArray(0);
+
+		// always good practice to set everything back to defaults once configured.
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+private:
+	// render data
+	unsigned int VBO = 0, EBO = 0;
+	size_t indexOffset = 0;
+	int baseVertex = 0;
+	bool owned = false;
+
+	// textures of one shader laid out by the texture unit of their sampler
+	struct SamplerBinding {
+		uint64_t reflection = 0;     // ProgramReflection::Serial of the shader they were resolved for
+		vector<GLuint> unitTextures; // texture for every unit, 0 where the mesh has none, laid out for glBindTextures
+	};
+	unordered_map<unsigned int, SamplerBinding> samplerBindings; // by shader program
+
+	/*
+	* Builds the sampler name of every texture (e.g. texture_diffuse1) and finds the
+	* unit the shader samples it from once, so Draw does no string work or uniform calls
+	* The units belong to the shader, see ProgramReflection::SamplerUnit, so meshes
+	* listing their textures in a different order can share it
+	*/
+	void resolveSamplers(ProgramReflection& reflection, SamplerBinding& binding)
+	{
 		unsigned int diffuseNr = 1;
 		unsigned int specularNr = 1;
 		unsigned int normalNr = 1;
 		unsigned int heightNr = 1;
+
+		binding.unitTextures.clear();
 		for (unsigned int i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 			// retrieve texture number (the N in diffuse_textureN)
 			string number;
-			string name = textures[i].type;
+			const string& name = textures[i].type;
 			if (name == "texture_diffuse")
 				number = std::to_string(diffuseNr++);
 			else if (name == "texture_specular")
@@ -73,28 +310,22 @@ public:
 			else if (name == "texture_height")
 				number = std::to_string(heightNr++); // transfer unsigned int to stream
 
-			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			GLint unit = reflection.SamplerUnit((name + number).c_str());
+			if (unit < 0)
+				continue;
+			if (binding.unitTextures.size() <= size_t(unit))
+				binding.unitTextures.resize(size_t(unit) + 1, 0);
+			binding.unitTextures[unit] = textures[i].id;
 		}
-
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
+		binding.reflection = reflection.Serial();
 	}
 
-private:
-	// render data 
-	unsigned int VBO, EBO;
-
 	// initializes all the buffer objects/arrays
-	void setupMesh()
+	void setupMesh(const Vertex* vertexData, size_t numVertices, const unsigned int* indexData, size_t numIndices)
 	{
+		indexCount = static_cast<unsigned int>(numIndices);
+		owned = true;
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
@@ -106,29 +337,28 @@ private:
 		// A great thing about structs is that their memory layout is sequential for all its items.
 		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
 
 		// set the vertex attribute pointers
-		// vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		SetupVertexAttributes();
 
 		glBindVertexArray(0);
 	}
+
+	// deletes the GL objects this mesh owns, borrowed pool buffers are left alone
+	void release()
+	{
+		if (owned)
+		{
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+		}
+		VAO = VBO = EBO = 0;
+		owned = false;
+	}
 };
-#endif
\ No newline at end of file
+#endif
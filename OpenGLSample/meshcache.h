@@ -0,0 +1,361 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Binary mesh cache
+* Stores generated geometry in a versioned binary file so later launches can
+* memory map it and hand the vertex/index blobs straight to glBufferData
+*
+* File layout:
+*   MeshCacheHeader
+*   MeshCacheStream[streamCount]   vertex layout descriptor for every blob
+*   blobs, each aligned to MESH_CACHE_ALIGNMENT bytes
+*
+* A cache file is named after its generator and the hash of the generator
+* parameters, so changing a parameter (or the generator version) simply misses
+* and writes a new file
+*/
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+const char* const MESH_CACHE_DIR = "meshcache";
+const uint32_t MESH_CACHE_MAGIC = 0x48534D43; // "CMSH" read as little-endian bytes
+const uint32_t MESH_CACHE_VERSION = 1;
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+const uint32_t MESH_CACHE_MAX_ATTRIBUTES = 4;
+
+enum MeshStreamKind : uint32_t {
+    MESH_STREAM_VERTICES = 0,
+    MESH_STREAM_INDICES = 1,
+    MESH_STREAM_RECORDS = 2  // plain records read back on the CPU, never uploaded
+};
+
+// A float vertex attribute inside a vertex stream
+struct MeshCacheAttribute {
+    uint32_t location;   // shader attribute location
+    uint32_t components; // number of floats
+    uint32_t offset;     // byte offset inside one element
+};
+
+// Descriptor for a single blob in the cache file
+struct MeshCacheStream {
+    uint32_t kind;           // MeshStreamKind
+    uint32_t part;           // sub-mesh the stream belongs to (e.g. cylinder sides/top/bottom)
+    uint32_t stride;         // bytes per element
+    uint32_t count;          // number of elements
+    uint32_t attributeCount; // attributes used for vertex streams
+    MeshCacheAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+    uint32_t reserved;
+    uint64_t offset;         // byte offset of the blob from the start of the file
+    uint64_t size;           // byte size of the blob
+};
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t paramsHash;
+    uint32_t streamCount;
+    uint32_t streamSize; // sizeof(MeshCacheStream) when the file was written
+    uint64_t fileSize;
+};
+
+// Descriptor plus a pointer to the blob, either inside the mapping or in generator memory
+struct MeshStreamView {
+    MeshCacheStream desc;
+    const void* data;
+
+    size_t Size() const { return size_t(desc.stride) * desc.count; }
+    uint32_t Count() const { return desc.count; }
+};
+
+// Builds a vertex stream view over generator memory
+inline MeshStreamView VertexStream(uint32_t part, const void* data, size_t count, uint32_t stride, std::initializer_list<MeshCacheAttribute> attributes) {
+    MeshStreamView view = {};
+    view.desc.kind = MESH_STREAM_VERTICES;
+    view.desc.part = part;
+    view.desc.stride = stride;
+    view.desc.count = static_cast<uint32_t>(count);
+    for (const auto& attribute : attributes) {
+        if (view.desc.attributeCount < MESH_CACHE_MAX_ATTRIBUTES)
+            view.desc.attributes[view.desc.attributeCount++] = attribute;
+    }
+    view.data = data;
+    return view;
+}
+
+// Builds an index stream view over generator memory
+inline MeshStreamView IndexStream(uint32_t part, const GLuint* data, size_t count) {
+    MeshStreamView view = {};
+    view.desc.kind = MESH_STREAM_INDICES;
+    view.desc.part = part;
+    view.desc.stride = sizeof(GLuint);
+    view.desc.count = static_cast<uint32_t>(count);
+    view.data = data;
+    return view;
+}
+
+// Builds a view over a table of plain records, e.g. a meshlet table
+inline MeshStreamView RecordStream(uint32_t part, const void* data, size_t count, uint32_t stride) {
+    MeshStreamView view = {};
+    view.desc.kind = MESH_STREAM_RECORDS;
+    view.desc.part = part;
+    view.desc.stride = stride;
+    view.desc.count = static_cast<uint32_t>(count);
+    view.data = data;
+    return view;
+}
+
+// Copies one attribute of a stream into a CPU side vector for code that still needs the geometry after upload
+template <typename T>
+inline void CopyStream(const MeshStreamView* stream, std::vector<T>& out, size_t offset = 0) {
+    const unsigned char* first = static_cast<const unsigned char*>(stream->data) + offset;
+    out.resize(stream->Count());
+    for (size_t i = 0; i < out.size(); ++i)
+        memcpy(&out[i], first + i * stream->desc.stride, sizeof(T));
+}
+
+/*
+* Uploads a stream to the buffer currently bound to its target
+* Vertex streams also set up their attribute pointers on the bound VAO
+*/
+inline void UploadStream(const MeshStreamView& stream) {
+    if (stream.desc.kind == MESH_STREAM_INDICES) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, stream.Size(), stream.data, GL_STATIC_DRAW);
+        return;
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, stream.Size(), stream.data, GL_STATIC_DRAW);
+    for (uint32_t i = 0; i < stream.desc.attributeCount; ++i) {
+        const MeshCacheAttribute& attribute = stream.desc.attributes[i];
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, stream.desc.stride, (void*)(uintptr_t)attribute.offset);
+    }
+}
+
+/*
+* Identifies one generator invocation
+* Every parameter that changes the output must be added to the key
+* Bump generatorVersion whenever the generator code itself changes
+*/
+class MeshCacheKey
+{
+public:
+    MeshCacheKey(const std::string& generator, uint32_t generatorVersion) : name(generator)
+    {
+        AddBytes(generator.data(), generator.size());
+        Add(generatorVersion);
+        Add(MESH_CACHE_VERSION);
+    }
+
+    MeshCacheKey& Add(float value) { AddBytes(&value, sizeof(value)); return *this; }
+    MeshCacheKey& Add(int value) { AddBytes(&value, sizeof(value)); return *this; }
+    MeshCacheKey& Add(uint32_t value) { AddBytes(&value, sizeof(value)); return *this; }
+
+    uint64_t Hash() const { return hash; }
+
+    // Path of the cache file for this key, e.g. meshcache/torus_0123456789abcdef.mesh
+    std::string Path() const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return std::string(MESH_CACHE_DIR) + "/" + name + "_" + hex + ".mesh";
+    }
+
+private:
+    std::string name;
+    uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+
+    void AddBytes(const void* bytes, size_t count)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ull; // FNV-1a prime
+        }
+    }
+};
+
+/*
+* One generator's cached geometry
+* Load maps a cache file and exposes its streams without copying them
+* Store writes the generator output to disk and exposes the generator memory,
+* so callers upload through the same stream views on a hit or a miss
+*/
+class MeshCache
+{
+public:
+    // Cache statistics for the whole process
+    static inline unsigned int hits = 0;
+    static inline unsigned int misses = 0;
+
+    bool Load(const MeshCacheKey& key)
+    {
+        streams.clear();
+        if (!file.Open(key.Path()) || !Validate(key)) {
+            file.Close();
+            streams.clear();
+            ++misses;
+            return false;
+        }
+        ++hits;
+        return true;
+    }
+
+    /*
+    * Writes the streams to the cache file for key
+    * The views must point at memory that outlives this MeshCache
+    * Failure to write only costs the next launch a regeneration
+    */
+    bool Store(const MeshCacheKey& key, const std::vector<MeshStreamView>& generated)
+    {
+        file.Close();
+        streams = generated;
+
+        std::error_code error;
+        std::filesystem::create_directories(MESH_CACHE_DIR, error);
+
+        // Lay out the blobs after the header and descriptor table
+        std::vector<MeshCacheStream> table;
+        uint64_t offset = sizeof(MeshCacheHeader) + generated.size() * sizeof(MeshCacheStream);
+        for (const auto& stream : generated) {
+            offset = AlignUp(offset);
+            MeshCacheStream desc = stream.desc;
+            desc.offset = offset;
+            desc.size = stream.Size();
+            table.push_back(desc);
+            offset += desc.size;
+        }
+
+        MeshCacheHeader header = {};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.paramsHash = key.Hash();
+        header.streamCount = static_cast<uint32_t>(table.size());
+        header.streamSize = sizeof(MeshCacheStream);
+        header.fileSize = offset;
+
+        // Write to a temporary file and rename so a crash never leaves a truncated cache
+        std::string path = key.Path();
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(MeshCacheStream));
+
+            static const char padding[MESH_CACHE_ALIGNMENT] = {};
+            uint64_t written = sizeof(header) + table.size() * sizeof(MeshCacheStream);
+            for (size_t i = 0; i < table.size(); ++i) {
+                out.write(padding, table[i].offset - written);
+                out.write(static_cast<const char*>(generated[i].data), table[i].size);
+                written = table[i].offset + table[i].size;
+            }
+            if (!out)
+                return false;
+        }
+
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+    // Finds the vertex stream that feeds the given attribute location of a part
+    const MeshStreamView* Vertices(uint32_t part, uint32_t location) const
+    {
+        for (const auto& stream : streams) {
+            if (stream.desc.kind != MESH_STREAM_VERTICES || stream.desc.part != part)
+                continue;
+            for (uint32_t i = 0; i < stream.desc.attributeCount; ++i) {
+                if (stream.desc.attributes[i].location == location)
+                    return &stream;
+            }
+        }
+        return nullptr;
+    }
+
+    // Finds the index stream of a part
+    const MeshStreamView* Indices(uint32_t part) const
+    {
+        return Find(MESH_STREAM_INDICES, part);
+    }
+
+    // Finds the record table of a part
+    const MeshStreamView* Records(uint32_t part) const
+    {
+        return Find(MESH_STREAM_RECORDS, part);
+    }
+
+    // Deletes every cache file, forcing the next Load calls to miss
+    static void Clear()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(MESH_CACHE_DIR, error);
+    }
+
+private:
+    MappedFile file;
+    std::vector<MeshStreamView> streams;
+
+    const MeshStreamView* Find(uint32_t kind, uint32_t part) const
+    {
+        for (const auto& stream : streams) {
+            if (stream.desc.kind == kind && stream.desc.part == part)
+                return &stream;
+        }
+        return nullptr;
+    }
+
+    static uint64_t AlignUp(uint64_t value)
+    {
+        return (value + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+    }
+
+    // Checks the mapped file against the key and builds stream views into the mapping
+    bool Validate(const MeshCacheKey& key)
+    {
+        if (file.Size() < sizeof(MeshCacheHeader))
+            return false;
+
+        MeshCacheHeader header;
+        memcpy(&header, file.Data(), sizeof(header));
+        if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+            header.paramsHash != key.Hash() || header.fileSize != file.Size() ||
+            header.streamSize != sizeof(MeshCacheStream))
+            return false;
+
+        uint64_t tableEnd = sizeof(MeshCacheHeader) + uint64_t(header.streamCount) * sizeof(MeshCacheStream);
+        if (tableEnd > file.Size())
+            return false;
+
+        const MeshCacheStream* table = reinterpret_cast<const MeshCacheStream*>(file.Data() + sizeof(MeshCacheHeader));
+        for (uint32_t i = 0; i < header.streamCount; ++i) {
+            const MeshCacheStream& desc = table[i];
+            if (desc.offset % MESH_CACHE_ALIGNMENT != 0 || desc.offset < tableEnd ||
+                desc.offset + desc.size > file.Size() ||
+                desc.size != uint64_t(desc.stride) * desc.count ||
+                desc.attributeCount > MESH_CACHE_MAX_ATTRIBUTES)
+                return false;
+
+            MeshStreamView view;
+            view.desc = desc;
+            view.data = file.Data() + desc.offset;
+            streams.push_back(view);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,251 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Meshlet clustering and per-cluster culling
+* Splits an indexed triangle mesh into small clusters (meshlets) and reorders
+* the index buffer so every meshlet is one contiguous index range
+*
+* Every frame CullMeshlets tests each meshlet's bounding sphere against the
+* view frustum and its normal cone against the camera position, then merges
+* the surviving ranges into the fewest glMultiDrawElements draws
+*
+* Backface cone culling assumes closed, opaque surfaces such as the sphere
+* and torus; open surfaces should pass cullBackfaces = false
+*/
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+/*
+* One cluster of triangles, all values in object space
+* The layout is plain data so meshlet tables can be stored in the mesh cache
+*/
+struct Meshlet {
+    uint32_t indexOffset;  // first index of the meshlet in the reordered index buffer
+    uint32_t indexCount;   // three indices per triangle
+    glm::vec3 center;      // bounding sphere
+    float radius;
+    glm::vec3 coneAxis;    // average facing direction of the triangles
+    float coneCutoff;      // sine of the cone spread, 1 when the cone cannot be culled
+};
+
+// Draw ranges that survived culling, laid out for glMultiDrawElements
+struct MeshletDrawList {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    unsigned int visibleMeshlets = 0;
+    unsigned int culledMeshlets = 0;
+
+    void Clear()
+    {
+        counts.clear();
+        offsets.clear();
+        visibleMeshlets = 0;
+        culledMeshlets = 0;
+    }
+};
+
+// A single meshlet covering a whole mesh, for meshes that were never clustered on the CPU
+inline Meshlet WholeMeshMeshlet(uint32_t indexCount, const glm::vec3& center, float radius)
+{
+    Meshlet meshlet = {};
+    meshlet.indexCount = indexCount;
+    meshlet.center = center;
+    meshlet.radius = radius;
+    meshlet.coneCutoff = 1.0f;
+    return meshlet;
+}
+
+/*
+* Groups triangles into meshlets of at most maxVertices unique vertices and
+* maxTriangles triangles, walking the index buffer in order so the grid
+* layout of the generators keeps clusters compact
+* @params vertexData: first vertex, positions and normals are read with the given offsets and stride
+*         indices: triangle list to cluster
+*         reordered: receives the index buffer in meshlet order
+*         meshlets: receives the meshlet table
+*/
+inline void BuildMeshlets(const void* vertexData, size_t vertexCount, size_t stride, size_t positionOffset, size_t normalOffset,
+    const GLuint* indices, size_t indexCount, std::vector<GLuint>& reordered, std::vector<Meshlet>& meshlets,
+    uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(vertexData);
+    auto position = [&](GLuint i) { glm::vec3 p; memcpy(&p, bytes + i * stride + positionOffset, sizeof(p)); return p; };
+    auto normal = [&](GLuint i) { glm::vec3 n; memcpy(&n, bytes + i * stride + normalOffset, sizeof(n)); return n; };
+
+    reordered.clear();
+    reordered.reserve(indexCount);
+    meshlets.clear();
+
+    // stamp[v] == meshlets.size() + 1 while v belongs to the meshlet being filled
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    std::vector<GLuint> clusterVertices;
+    uint32_t clusterStart = 0;
+
+    auto finish = [&]() {
+        uint32_t count = static_cast<uint32_t>(reordered.size()) - clusterStart;
+        if (count == 0)
+            return;
+
+        Meshlet meshlet = {};
+        meshlet.indexOffset = clusterStart;
+        meshlet.indexCount = count;
+
+        // Bounding sphere around the centre of the vertex bounding box
+        glm::vec3 minimum = position(clusterVertices[0]);
+        glm::vec3 maximum = minimum;
+        for (GLuint v : clusterVertices) {
+            glm::vec3 p = position(v);
+            for (int k = 0; k < 3; ++k) {
+                minimum[k] = std::fmin(minimum[k], p[k]);
+                maximum[k] = std::fmax(maximum[k], p[k]);
+            }
+        }
+        meshlet.center = (minimum + maximum) * 0.5f;
+        for (GLuint v : clusterVertices)
+            meshlet.radius = std::fmax(meshlet.radius, glm::length(position(v) - meshlet.center));
+
+        // Normal cone from the face normals, oriented to agree with the vertex normals
+        std::vector<glm::vec3> faceNormals;
+        glm::vec3 axis(0.0f);
+        for (uint32_t i = clusterStart; i < clusterStart + count; i += 3) {
+            GLuint a = reordered[i], b = reordered[i + 1], c = reordered[i + 2];
+            glm::vec3 face = glm::cross(position(b) - position(a), position(c) - position(a));
+            float area = glm::length(face);
+            if (area <= 1e-12f)
+                continue; // degenerate triangles, e.g. at the sphere poles, face nowhere
+            face /= area;
+            if (glm::dot(face, normal(a) + normal(b) + normal(c)) < 0.0f)
+                face = -face;
+            faceNormals.push_back(face);
+            axis += face;
+        }
+
+        meshlet.coneCutoff = 1.0f;
+        float axisLength = glm::length(axis);
+        if (axisLength > 1e-6f) {
+            meshlet.coneAxis = axis / axisLength;
+            float minDot = 1.0f;
+            for (const glm::vec3& face : faceNormals)
+                minDot = std::fmin(minDot, glm::dot(face, meshlet.coneAxis));
+
+            // Cones wider than a hemisphere can always be seen from somewhere in front
+            if (minDot > 0.0f)
+                meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+
+        meshlets.push_back(meshlet);
+        clusterVertices.clear();
+        clusterStart = static_cast<uint32_t>(reordered.size());
+    };
+
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        uint32_t current = static_cast<uint32_t>(meshlets.size()) + 1;
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; ++k) {
+            if (stamp[indices[t + k]] != current)
+                ++newVertices;
+        }
+
+        uint32_t triangles = (static_cast<uint32_t>(reordered.size()) - clusterStart) / 3;
+        if (clusterVertices.size() + newVertices > maxVertices || triangles + 1 > maxTriangles) {
+            finish();
+            current = static_cast<uint32_t>(meshlets.size()) + 1;
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = indices[t + k];
+            if (stamp[v] != current) {
+                stamp[v] = current;
+                clusterVertices.push_back(v);
+            }
+            reordered.push_back(v);
+        }
+    }
+    finish();
+}
+
+/*
+* Extracts the six clip planes of a view-projection-model matrix
+* The planes are in the model's object space with unit length normals,
+* so object space bounding spheres can be tested directly
+*/
+inline void ExtractFrustumPlanes(const glm::mat4& clip, glm::vec4 planes[6])
+{
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+
+    planes[0] = rows[3] + rows[0]; // left
+    planes[1] = rows[3] - rows[0]; // right
+    planes[2] = rows[3] + rows[1]; // bottom
+    planes[3] = rows[3] - rows[1]; // top
+    planes[4] = rows[3] + rows[2]; // near
+    planes[5] = rows[3] - rows[2]; // far
+    for (int i = 0; i < 6; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+/*
+* Culls the meshlets of one mesh instance and appends the visible index ranges
+* Neighbouring visible meshlets are merged into a single range
+* @params model, view, projection: the matrices the instance is drawn with
+*         cameraPosition: world space eye position for the normal cone test
+*/
+inline void CullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+    const glm::vec3& cameraPosition, bool cullBackfaces, MeshletDrawList& drawList)
+{
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(projection * view * model, planes);
+    glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+    GLsizei* open = nullptr; // count of the range the next visible meshlet may extend
+    uint32_t openEnd = 0;
+    for (const Meshlet& meshlet : meshlets) {
+        bool visible = true;
+        for (int i = 0; i < 6 && visible; ++i)
+            visible = glm::dot(glm::vec3(planes[i]), meshlet.center) + planes[i].w >= -meshlet.radius;
+
+        if (visible && cullBackfaces) {
+            glm::vec3 toCenter = meshlet.center - eye;
+            visible = glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+        }
+
+        if (!visible) {
+            ++drawList.culledMeshlets;
+            open = nullptr;
+            continue;
+        }
+
+        ++drawList.visibleMeshlets;
+        if (open && openEnd == meshlet.indexOffset) {
+            *open += meshlet.indexCount;
+        }
+        else {
+            drawList.counts.push_back(meshlet.indexCount);
+            drawList.offsets.push_back((const void*)(uintptr_t)(meshlet.indexOffset * sizeof(GLuint)));
+            open = &drawList.counts.back();
+        }
+        openEnd = meshlet.indexOffset + meshlet.indexCount;
+    }
+}
+
+// Draws the ranges in drawList from the bound VAO's element buffer
+inline void DrawMeshletRanges(const MeshletDrawList& drawList)
+{
+    if (!drawList.counts.empty())
+        glMultiDrawElements(GL_TRIANGLES, drawList.counts.data(), GL_UNSIGNED_INT, drawList.offsets.data(), static_cast<GLsizei>(drawList.counts.size()));
+}
+
+#endif
@@ -0,0 +1,322 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Mipmap generator
+* Builds the mip chain of an RGBA8 texture on the CPU, so every machine gets
+* the same levels instead of whatever glGenerateMipmap does in its driver:
+* - each level is filtered from the one above with a Kaiser windowed sinc,
+*   which keeps detail a box filter blurs away without visible ringing
+* - color is filtered in linear light and weighted by alpha, so dark fringes
+*   do not creep in around transparent texels
+* - images drawn with an alpha test can keep the coverage of level 0 at
+*   their cutoff, so cutouts do not thin out or vanish in the distance;
+*   blended images leave it off, their alpha is filtered like color
+*
+* Every level is filtered in bands of rows, so the horizontally filtered
+* scratch rows stay small, with SSE for the four channels of a texel where
+* available. Generate runs on the calling thread: the callers are already the
+* texture loader's workers, one image each, and more threads per level would
+* only oversubscribe them
+*/
+
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "textureimport.h"
+
+struct MipOptions {
+    bool srgbColor = true;      // color bytes are sRGB encoded and are filtered in linear light
+    bool premultiplied = false; // color is already multiplied by alpha, so it is not weighted again
+    float alphaCutoff = 0.0f;   // alpha test threshold whose coverage every level keeps, 0 filters alpha plainly
+
+    /*
+    * Options for images that went through the import stage with these settings
+    * @params alphaCutoff: the shader's alpha test threshold, only for textures drawn with an alpha test
+    */
+    static MipOptions For(const TextureImportOptions& import, float alphaCutoff = 0.0f)
+    {
+        MipOptions options;
+        options.premultiplied = import.premultiplyAlpha;
+        options.alphaCutoff = alphaCutoff;
+        return options;
+    }
+};
+
+// One generated level, tightly packed RGBA8 in the row order of its source
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+class MipGenerator
+{
+public:
+    static const int FILTER_RADIUS = 2;        // kernel half width in texels of the smaller level
+    static const int BAND_ROWS = 32;    // output rows filtered together, bounds the scratch rows
+
+    /*
+    * Level 0 texels past its footprint that a texel of level is filtered from, through every level above it
+    * Each level reads up to 2 * FILTER_RADIUS texels of the level above past the texels it covers
+    */
+    static constexpr int Reach(int level) { return 2 * FILTER_RADIUS * ((1 << level) - 1); }
+
+    /*
+    * Generates the levels below an RGBA8 image, halving each side (never below 1) per level
+    * @params levelCount: how many levels to generate at most, the chain always stops at 1x1
+    *         levels: receives level 1 onward, level 0 is the image itself
+    */
+    static void Generate(const unsigned char* rgba, int width, int height, int levelCount, const MipOptions& options, std::vector<MipLevel>& levels)
+    {
+        levels.clear();
+        const unsigned char* source = rgba;
+        int w = width, h = height;
+        while (int(levels.size()) < levelCount && (w > 1 || h > 1)) {
+            MipLevel level;
+            level.width = std::max(1, w / 2);
+            level.height = std::max(1, h / 2);
+            level.pixels.resize(size_t(level.width) * size_t(level.height) * 4);
+            Downsample(source, w, h, level, options);
+            levels.push_back(std::move(level));
+            source = levels.back().pixels.data();
+            w = levels.back().width;
+            h = levels.back().height;
+        }
+
+        // Coverage is matched against level 0 once the whole chain exists, the levels were filtered from unscaled alpha
+        if (options.alphaCutoff > 0.0f && !levels.empty()) {
+            unsigned char cutoff = static_cast<unsigned char>(std::min(255.0f, options.alphaCutoff * 255.0f + 0.5f));
+            size_t covered = 0, count = size_t(width) * size_t(height);
+            for (size_t i = 0; i < count; ++i)
+                covered += rgba[i * 4 + 3] >= cutoff;
+            if (covered > 0 && covered < count) {
+                double coverage = double(covered) / double(count);
+                for (MipLevel& level : levels)
+                    KeepCoverage(level, cutoff, coverage);
+            }
+        }
+    }
+
+private:
+    // Source texels and weights of every output texel along one axis, padded to the same tap count
+    struct Taps {
+        int count = 0;
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    // Lookup tables between sRGB bytes and linear floats, finer than SrgbTables so dark gradients survive
+    struct Tables {
+        static const int LINEAR_STEPS = 16384;
+        float toLinear[256];
+        unsigned char toSrgb[LINEAR_STEPS];
+
+        static const Tables& Get()
+        {
+            static const Tables tables;
+            return tables;
+        }
+
+    private:
+        Tables()
+        {
+            for (int i = 0; i < 256; ++i) {
+                double c = i / 255.0;
+                toLinear[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+            }
+            for (int i = 0; i < LINEAR_STEPS; ++i) {
+                double linear = i / double(LINEAR_STEPS - 1);
+                double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                toSrgb[i] = static_cast<unsigned char>(c * 255.0 + 0.5);
+            }
+        }
+    };
+
+    // Zeroth order modified Bessel function of the first kind, for the Kaiser window
+    static double BesselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-12)
+                break;
+        }
+        return sum;
+    }
+
+    // Kaiser windowed sinc, t in texels of the smaller level
+    static double Kernel(double t)
+    {
+        const double alpha = 4.0; // window shape, trades sharpness against ringing
+        const double pi = 3.14159265358979323846;
+        double u = t / FILTER_RADIUS;
+        if (std::fabs(u) >= 1.0)
+            return 0.0;
+        double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+        return sinc * BesselI0(alpha * std::sqrt(1.0 - u * u)) / BesselI0(alpha);
+    }
+
+    // Taps from a source axis of srcSize texels to dstSize texels, edges repeat the border texel
+    static Taps BuildTaps(int srcSize, int dstSize)
+    {
+        Taps taps;
+        double scale = double(srcSize) / double(dstSize);
+        double support = FILTER_RADIUS * scale;
+        taps.count = int(std::ceil(support * 2.0)) + 1;
+        taps.index.assign(size_t(dstSize) * taps.count, 0);
+        taps.weight.assign(size_t(dstSize) * taps.count, 0.0f);
+
+        for (int x = 0; x < dstSize; ++x) {
+            double center = (x + 0.5) * scale;
+            int first = int(std::floor(center - support));
+            double total = 0.0;
+            std::vector<double> weights(taps.count);
+            for (int k = 0; k < taps.count; ++k) {
+                weights[k] = Kernel((first + k + 0.5 - center) / scale);
+                total += weights[k];
+            }
+            for (int k = 0; k < taps.count; ++k) {
+                taps.index[size_t(x) * taps.count + k] = std::min(std::max(first + k, 0), srcSize - 1);
+                taps.weight[size_t(x) * taps.count + k] = float(weights[k] / total);
+            }
+        }
+        return taps;
+    }
+
+    // acc += texel * weight on four floats
+    static inline void MulAdd(float* acc, const float* texel, float weight)
+    {
+#if TEXTUREIMPORT_SSE2
+        _mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(_mm_loadu_ps(texel), _mm_set1_ps(weight))));
+#else
+        for (int c = 0; c < 4; ++c)
+            acc[c] += texel[c] * weight;
+#endif
+    }
+
+    // One source row as linear floats, color weighted by alpha
+    static void DecodeRow(const unsigned char* row, int width, const MipOptions& options, float* out)
+    {
+        const Tables& tables = Tables::Get();
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* p = row + size_t(x) * 4;
+            float a = p[3] * (1.0f / 255.0f);
+            float weight = options.premultiplied ? 1.0f : a;
+            for (int c = 0; c < 3; ++c)
+                out[x * 4 + c] = (options.srgbColor ? tables.toLinear[p[c]] : p[c] * (1.0f / 255.0f)) * weight;
+            out[x * 4 + 3] = a;
+        }
+    }
+
+    // One filtered texel back to RGBA8, undoing the alpha weighting
+    static void EncodeTexel(const float* in, const MipOptions& options, unsigned char* out)
+    {
+        const Tables& tables = Tables::Get();
+        float a = std::min(std::max(in[3], 0.0f), 1.0f);
+        float unweight = options.premultiplied || a <= 0.0f ? 1.0f : 1.0f / a;
+        for (int c = 0; c < 3; ++c) {
+            float value = std::min(std::max(in[c] * unweight, 0.0f), 1.0f);
+            if (options.srgbColor)
+                out[c] = tables.toSrgb[int(value * (Tables::LINEAR_STEPS - 1) + 0.5f)];
+            else
+                out[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+        }
+        out[3] = static_cast<unsigned char>(a * 255.0f + 0.5f);
+    }
+
+    /*
+    * Filters one band of output rows: the source rows it needs are filtered horizontally
+    * into scratch first, then each output texel sums them vertically
+    */
+    static void FilterBand(const unsigned char* src, int srcWidth, const Taps& across, const Taps& down, int firstRow, int lastRow,
+        const MipOptions& options, MipLevel& level)
+    {
+        int rowFirst = down.index[size_t(firstRow) * down.count];
+        int rowLast = rowFirst;
+        for (int y = firstRow; y < lastRow; ++y) {
+            for (int k = 0; k < down.count; ++k) {
+                rowFirst = std::min(rowFirst, down.index[size_t(y) * down.count + k]);
+                rowLast = std::max(rowLast, down.index[size_t(y) * down.count + k]);
+            }
+        }
+
+        std::vector<float> decoded(size_t(srcWidth) * 4);
+        std::vector<float> rows(size_t(rowLast - rowFirst + 1) * level.width * 4, 0.0f);
+        for (int row = rowFirst; row <= rowLast; ++row) {
+            DecodeRow(src + size_t(row) * srcWidth * 4, srcWidth, options, decoded.data());
+            float* out = &rows[size_t(row - rowFirst) * level.width * 4];
+            for (int x = 0; x < level.width; ++x) {
+                const int* index = &across.index[size_t(x) * across.count];
+                const float* weight = &across.weight[size_t(x) * across.count];
+                for (int k = 0; k < across.count; ++k)
+                    MulAdd(out + x * 4, &decoded[size_t(index[k]) * 4], weight[k]);
+            }
+        }
+
+        std::vector<float> acc(size_t(level.width) * 4);
+        for (int y = firstRow; y < lastRow; ++y) {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (int k = 0; k < down.count; ++k) {
+                const float* row = &rows[size_t(down.index[size_t(y) * down.count + k] - rowFirst) * level.width * 4];
+                float weight = down.weight[size_t(y) * down.count + k];
+                if (weight == 0.0f)
+                    continue;
+                for (int x = 0; x < level.width; ++x)
+                    MulAdd(&acc[size_t(x) * 4], row + x * 4, weight);
+            }
+            unsigned char* out = &level.pixels[size_t(y) * level.width * 4];
+            for (int x = 0; x < level.width; ++x)
+                EncodeTexel(&acc[size_t(x) * 4], options, out + x * 4);
+        }
+    }
+
+    // Filters src into level one band of rows at a time
+    static void Downsample(const unsigned char* src, int srcWidth, int srcHeight, MipLevel& level, const MipOptions& options)
+    {
+        Taps across = BuildTaps(srcWidth, level.width);
+        Taps down = BuildTaps(srcHeight, level.height);
+        for (int firstRow = 0; firstRow < level.height; firstRow += BAND_ROWS)
+            FilterBand(src, srcWidth, across, down, firstRow, std::min(level.height, firstRow + BAND_ROWS), options, level);
+    }
+
+    // Scales the alpha of a level so the share of texels at or above cutoff matches level 0
+    static void KeepCoverage(MipLevel& level, unsigned char cutoff, double coverage)
+    {
+        size_t count = size_t(level.width) * size_t(level.height);
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i)
+            ++histogram[level.pixels[i * 4 + 3]];
+
+        // Coverage grows with the scale, so bisect for the scale that matches best
+        auto covered = [&](double scale) {
+            double total = 0.0;
+            for (int a = 0; a < 256; ++a) {
+                if (std::min(255.0, a * scale + 0.5) >= cutoff)
+                    total += double(histogram[a]);
+            }
+            return total / double(count);
+        };
+        double low = 0.0, high = 4.0;
+        for (int iteration = 0; iteration < 16; ++iteration) {
+            double mid = (low + high) * 0.5;
+            if (covered(mid) < coverage)
+                low = mid;
+            else
+                high = mid;
+        }
+
+        double scale = high;
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char& a = level.pixels[i * 4 + 3];
+            a = static_cast<unsigned char>(std::min(255.0, a * scale + 0.5));
+        }
+    }
+};
+
+#endif
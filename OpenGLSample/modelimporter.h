@@ -0,0 +1,923 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Streaming model importer for Wavefront OBJ and glTF 2.0 (.gltf/.glb)
+* Files are memory mapped and parsed on worker threads straight into the
+* Vertex/index vectors that are then moved into Mesh, so the geometry is never
+* copied between parsing and upload. GL calls stay on the calling thread
+*
+* OBJ files are split into chunks at line boundaries. A counting pass gives
+* every chunk the global numbering of its v/vt/vn lines, so the chunks can be
+* parsed, deduplicated and written into the final vectors independently
+* Vertices are only deduplicated inside a chunk, so the few shared across a
+* chunk boundary are stored twice
+* glTF primitives are converted in parallel, tightly packed 32 bit index
+* buffers are uploaded straight from the mapping
+*
+* Every OBJ file becomes one Mesh and every glTF primitive one Mesh, in mesh
+* space; node transforms, materials and textures are left to the caller
+*/
+
+#ifndef MODELIMPORTER_H
+#define MODELIMPORTER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "jsonreader.h"
+#include "mappedfile.h"
+#include "mesh.h"
+
+struct ModelImportOptions {
+    bool generateTangents = false; // fill Vertex::Tangent and Bitangent, most shaders here do not read them
+    unsigned int threads = 0;      // worker threads, 0 uses every hardware thread
+};
+
+// Throughput of one import, parse covers reading and converting, upload covers building the meshes
+struct ModelImportStats {
+    size_t bytes = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t meshes = 0;
+    double parseSeconds = 0.0;
+    double uploadSeconds = 0.0;
+
+    double Seconds() const { return parseSeconds + uploadSeconds; }
+    double MegabytesPerSecond() const { return Seconds() > 0.0 ? bytes / (1024.0 * 1024.0) / Seconds() : 0.0; }
+    double TrianglesPerSecond() const { return Seconds() > 0.0 ? triangles / Seconds() : 0.0; }
+
+    void Report(std::ostream& out, const std::string& name) const
+    {
+        out << name << ": " << meshes << " meshes, " << vertices << " vertices, " << triangles << " triangles, "
+            << bytes / (1024.0 * 1024.0) << " MB in " << Seconds() * 1000.0 << " ms (parse " << parseSeconds * 1000.0
+            << " ms, upload " << uploadSeconds * 1000.0 << " ms), " << MegabytesPerSecond() << " MB/s, "
+            << TrianglesPerSecond() << " triangles/s" << std::endl;
+    }
+};
+
+// Number of threads to use for the given options
+inline unsigned int ModelImportThreads(const ModelImportOptions& options)
+{
+    if (options.threads)
+        return options.threads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs body(i) for every i in [0, count) on up to threads threads, the caller's thread included
+template <typename F>
+void ParallelFor(size_t count, unsigned int threads, const F& body)
+{
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            body(i);
+    };
+
+    std::vector<std::thread> workers;
+    size_t extra = std::min<size_t>(threads, count);
+    for (size_t t = 1; t < extra; ++t)
+        workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+/*
+* Fills Tangent and Bitangent from the texture coordinates of the triangles
+* Per vertex sums of the triangle tangents, made orthogonal to the normal
+*/
+inline void ComputeVertexTangents(std::vector<Vertex>& vertices, const unsigned int* indices, size_t indexCount)
+{
+    for (Vertex& vertex : vertices) {
+        vertex.Tangent = glm::vec3(0.0f);
+        vertex.Bitangent = glm::vec3(0.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        Vertex& a = vertices[indices[i]];
+        Vertex& b = vertices[indices[i + 1]];
+        Vertex& c = vertices[indices[i + 2]];
+        glm::vec3 e1 = b.Position - a.Position;
+        glm::vec3 e2 = c.Position - a.Position;
+        glm::vec2 d1 = b.TexCoords - a.TexCoords;
+        glm::vec2 d2 = c.TexCoords - a.TexCoords;
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (std::fabs(det) < 1e-12f)
+            continue;
+
+        glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) / det;
+        glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) / det;
+        for (Vertex* v : { &a, &b, &c }) {
+            v->Tangent += tangent;
+            v->Bitangent += bitangent;
+        }
+    }
+
+    for (Vertex& vertex : vertices) {
+        glm::vec3 n = vertex.Normal;
+        glm::vec3 t = vertex.Tangent - n * glm::dot(n, vertex.Tangent);
+        if (glm::dot(t, t) < 1e-12f) {
+            glm::vec3 axis = std::fabs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            t = glm::cross(axis, n);
+        }
+        t = glm::normalize(t);
+        float handedness = glm::dot(glm::cross(n, t), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        vertex.Tangent = t;
+        vertex.Bitangent = glm::cross(n, t) * handedness;
+    }
+}
+
+/*
+* Area weighted smooth normals for the flagged vertices, or every vertex when flags is empty
+* Used when a file has no normals of its own
+*/
+inline void ComputeVertexNormals(std::vector<Vertex>& vertices, const unsigned int* indices, size_t indexCount, const std::vector<char>& flags)
+{
+    auto needs = [&](unsigned int v) { return flags.empty() || flags[v]; };
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        if (needs(static_cast<unsigned int>(v)))
+            vertices[v].Normal = glm::vec3(0.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        glm::vec3 face = glm::cross(vertices[b].Position - vertices[a].Position, vertices[c].Position - vertices[a].Position);
+        for (unsigned int v : { a, b, c }) {
+            if (needs(v))
+                vertices[v].Normal += face;
+        }
+    }
+
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        if (!needs(static_cast<unsigned int>(v)))
+            continue;
+        float length = glm::length(vertices[v].Normal);
+        vertices[v].Normal = length > 0.0f ? vertices[v].Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Wavefront OBJ
+// ---------------------------------------------------------------------------
+
+// One face corner, 0 based global indices, -1 when the attribute is absent
+struct ObjCorner {
+    int64_t position;
+    int64_t texCoord;
+    int64_t normal;
+
+    bool operator==(const ObjCorner& other) const
+    {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& corner) const
+    {
+        uint64_t h = uint64_t(corner.position) * 0x9E3779B97F4A7C15ull;
+        h ^= uint64_t(corner.texCoord) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+        h ^= uint64_t(corner.normal) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h);
+    }
+};
+
+// A line aligned slice of an OBJ file and everything parsed from it
+struct ObjChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    // v, vt, and vn lines in this chunk and the global number of the first one
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+    size_t positionBase = 0, texCoordBase = 0, normalBase = 0;
+
+    std::vector<ObjCorner> corners;        // three per triangle, polygons are fanned
+    std::vector<uint32_t> cornerVertex;    // chunk local vertex of every corner
+    std::vector<ObjCorner> uniqueCorners;  // one per chunk local vertex
+    size_t vertexBase = 0, indexBase = 0;  // where the chunk writes into the final vectors
+    bool missingNormals = false;
+    bool failed = false;
+};
+
+inline const char* ObjSkipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+inline const char* ObjNextLine(const char* p, const char* end)
+{
+    const void* newline = memchr(p, '\n', size_t(end - p));
+    return newline ? static_cast<const char*>(newline) + 1 : end;
+}
+
+inline bool ObjIsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Locale independent float parser, returns nullptr if no number starts at p
+inline const char* ObjParseFloat(const char* p, const char* end, float& value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = ObjSkipSpace(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    for (; p < end && ObjIsDigit(*p); ++p, digits = true)
+        mantissa = mantissa * 10.0 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (++p; p < end && ObjIsDigit(*p); ++p, digits = true) {
+            mantissa = mantissa * 10.0 + (*p - '0');
+            --exponent;
+        }
+    }
+    if (!digits)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && ObjIsDigit(*q)) {
+            int e = 0;
+            for (; q < end && ObjIsDigit(*q); ++q)
+                e = std::min(e * 10 + (*q - '0'), 10000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    if (exponent < 0)
+        mantissa = -exponent <= 22 ? mantissa / powers[-exponent] : mantissa * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        mantissa = exponent <= 22 ? mantissa * powers[exponent] : mantissa * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -mantissa : mantissa);
+    return p;
+}
+
+inline const char* ObjParseInt(const char* p, const char* end, int64_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= end || !ObjIsDigit(*p))
+        return nullptr;
+    value = 0;
+    for (; p < end && ObjIsDigit(*p); ++p)
+        value = value * 10 + (*p - '0');
+    if (negative)
+        value = -value;
+    return p;
+}
+
+// Turns a 1 based or negative OBJ index into a 0 based global index, seen is the count parsed so far
+inline int64_t ObjResolveIndex(int64_t index, size_t seen)
+{
+    return index > 0 ? index - 1 : int64_t(seen) + index;
+}
+
+// Counting pass: how many v, vt, and vn lines the chunk holds
+inline void ObjCountChunk(ObjChunk& chunk)
+{
+    for (const char* line = chunk.begin; line < chunk.end; line = ObjNextLine(line, chunk.end)) {
+        const char* p = ObjSkipSpace(line, chunk.end);
+        if (chunk.end - p < 2 || p[0] != 'v')
+            continue;
+        if (p[1] == ' ' || p[1] == '\t')
+            ++chunk.positionCount;
+        else if (p[1] == 't')
+            ++chunk.texCoordCount;
+        else if (p[1] == 'n')
+            ++chunk.normalCount;
+    }
+}
+
+/*
+* Parsing pass: writes the chunk's attributes into the global arrays at its bases
+* and collects its triangulated faces with resolved global indices
+*/
+inline void ObjParseChunk(ObjChunk& chunk, glm::vec3* positions, glm::vec2* texCoords, glm::vec3* normals)
+{
+    size_t positionsSeen = 0, texCoordsSeen = 0, normalsSeen = 0;
+    std::vector<ObjCorner> polygon;
+
+    for (const char* line = chunk.begin; line < chunk.end; line = ObjNextLine(line, chunk.end)) {
+        const char* p = ObjSkipSpace(line, chunk.end);
+        if (chunk.end - p < 2)
+            continue;
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            glm::vec3& position = positions[chunk.positionBase + positionsSeen++];
+            const char* q = p + 1;
+            for (int k = 0; k < 3 && q; ++k)
+                q = ObjParseFloat(q, chunk.end, position[k]);
+            if (!q)
+                chunk.failed = true;
+        }
+        else if (p[0] == 'v' && p[1] == 't') {
+            glm::vec2& texCoord = texCoords[chunk.texCoordBase + texCoordsSeen++];
+            texCoord = glm::vec2(0.0f);
+            const char* q = ObjParseFloat(p + 2, chunk.end, texCoord.x);
+            if (q)
+                ObjParseFloat(q, chunk.end, texCoord.y); // v is optional
+            else
+                chunk.failed = true;
+        }
+        else if (p[0] == 'v' && p[1] == 'n') {
+            glm::vec3& normal = normals[chunk.normalBase + normalsSeen++];
+            const char* q = p + 2;
+            for (int k = 0; k < 3 && q; ++k)
+                q = ObjParseFloat(q, chunk.end, normal[k]);
+            if (!q)
+                chunk.failed = true;
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            // Corners look like v, v/vt, v//vn, or v/vt/vn
+            polygon.clear();
+            const char* q = ObjSkipSpace(p + 1, chunk.end);
+            while (q < chunk.end && *q != '\n' && *q != '\r' && *q != '#') {
+                ObjCorner corner = { -1, -1, -1 };
+                int64_t index;
+                q = ObjParseInt(q, chunk.end, index);
+                if (!q) {
+                    chunk.failed = true;
+                    break;
+                }
+                corner.position = ObjResolveIndex(index, chunk.positionBase + positionsSeen);
+                if (q < chunk.end && *q == '/') {
+                    ++q;
+                    if (q < chunk.end && *q != '/') {
+                        q = ObjParseInt(q, chunk.end, index);
+                        if (!q) {
+                            chunk.failed = true;
+                            break;
+                        }
+                        corner.texCoord = ObjResolveIndex(index, chunk.texCoordBase + texCoordsSeen);
+                    }
+                    if (q < chunk.end && *q == '/') {
+                        q = ObjParseInt(q + 1, chunk.end, index);
+                        if (!q) {
+                            chunk.failed = true;
+                            break;
+                        }
+                        corner.normal = ObjResolveIndex(index, chunk.normalBase + normalsSeen);
+                    }
+                }
+                polygon.push_back(corner);
+                q = ObjSkipSpace(q, chunk.end);
+            }
+
+            for (size_t k = 2; k < polygon.size(); ++k) {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[k - 1]);
+                chunk.corners.push_back(polygon[k]);
+            }
+        }
+    }
+}
+
+// Dedup pass: one chunk local vertex per distinct v/vt/vn combination
+inline void ObjDeduplicateChunk(ObjChunk& chunk, size_t positionCount, size_t texCoordCount, size_t normalCount)
+{
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> lookup;
+    lookup.reserve(chunk.corners.size() / 2);
+    chunk.cornerVertex.resize(chunk.corners.size());
+
+    for (size_t i = 0; i < chunk.corners.size(); ++i) {
+        const ObjCorner& corner = chunk.corners[i];
+        if (corner.position < 0 || size_t(corner.position) >= positionCount
+            || corner.texCoord >= int64_t(texCoordCount) || corner.normal >= int64_t(normalCount)
+            || corner.texCoord < -1 || corner.normal < -1) {
+            chunk.failed = true;
+            return;
+        }
+
+        auto inserted = lookup.emplace(corner, static_cast<uint32_t>(chunk.uniqueCorners.size()));
+        if (inserted.second) {
+            chunk.uniqueCorners.push_back(corner);
+            chunk.missingNormals |= corner.normal < 0;
+        }
+        chunk.cornerVertex[i] = inserted.first->second;
+    }
+}
+
+/*
+* Imports an OBJ file as one Mesh
+* @params path: file to import
+*         meshes: the new mesh is appended here
+*         stats: receives sizes and timings, may be nullptr
+* @return false if the file cannot be mapped or is malformed
+*/
+inline bool ImportObj(const std::string& path, std::vector<Mesh>& meshes, const ModelImportOptions& options, ModelImportStats* stats = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.Open(path)) {
+        std::cout << "Failed to open model: " << path << std::endl;
+        return false;
+    }
+
+    // Split the file into line aligned chunks, a few per thread so uneven chunks balance out
+    unsigned int threads = ModelImportThreads(options);
+    const char* text = reinterpret_cast<const char*>(file.Data());
+    const char* textEnd = text + file.Size();
+    const size_t MIN_CHUNK_BYTES = 256 * 1024;
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads * 4, file.Size() / MIN_CHUNK_BYTES));
+
+    std::vector<ObjChunk> chunks;
+    const char* chunkBegin = text;
+    for (size_t i = 1; i <= chunkCount && chunkBegin < textEnd; ++i) {
+        const char* chunkEnd = i == chunkCount ? textEnd : std::max(chunkBegin, text + file.Size() * i / chunkCount);
+        chunkEnd = ObjNextLine(chunkEnd == text ? text : chunkEnd - 1, textEnd);
+        ObjChunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        chunkBegin = chunkEnd;
+    }
+
+    ParallelFor(chunks.size(), threads, [&](size_t i) { ObjCountChunk(chunks[i]); });
+
+    // Every chunk now knows the global number of its first v, vt, and vn line
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.normalBase = normalCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+    }
+
+    std::vector<glm::vec3> positions(positionCount);
+    std::vector<glm::vec2> texCoords(texCoordCount);
+    std::vector<glm::vec3> normals(normalCount);
+    ParallelFor(chunks.size(), threads, [&](size_t i) {
+        ObjParseChunk(chunks[i], positions.data(), texCoords.data(), normals.data());
+        ObjDeduplicateChunk(chunks[i], positionCount, texCoordCount, normalCount);
+    });
+
+    size_t vertexCount = 0, indexCount = 0;
+    bool missingNormals = false;
+    for (ObjChunk& chunk : chunks) {
+        if (chunk.failed) {
+            std::cout << "Malformed OBJ file: " << path << std::endl;
+            return false;
+        }
+        chunk.vertexBase = vertexCount;
+        chunk.indexBase = indexCount;
+        vertexCount += chunk.uniqueCorners.size();
+        indexCount += chunk.corners.size();
+        missingNormals |= chunk.missingNormals;
+    }
+
+    // Each chunk fills its own slice of the final vectors
+    std::vector<Vertex> vertices(vertexCount);
+    std::vector<unsigned int> indices(indexCount);
+    std::vector<char> normalFlags(missingNormals ? vertexCount : 0, 0);
+    ParallelFor(chunks.size(), threads, [&](size_t i) {
+        ObjChunk& chunk = chunks[i];
+        for (size_t v = 0; v < chunk.uniqueCorners.size(); ++v) {
+            const ObjCorner& corner = chunk.uniqueCorners[v];
+            Vertex& vertex = vertices[chunk.vertexBase + v];
+            vertex.Position = positions[size_t(corner.position)];
+            vertex.TexCoords = corner.texCoord >= 0 ? texCoords[size_t(corner.texCoord)] : glm::vec2(0.0f);
+            vertex.Normal = corner.normal >= 0 ? normals[size_t(corner.normal)] : glm::vec3(0.0f);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+            if (corner.normal < 0)
+                normalFlags[chunk.vertexBase + v] = 1;
+        }
+        for (size_t k = 0; k < chunk.cornerVertex.size(); ++k)
+            indices[chunk.indexBase + k] = static_cast<unsigned int>(chunk.vertexBase + chunk.cornerVertex[k]);
+
+        // The parsed data is no longer needed, free it while other chunks are still working
+        std::vector<ObjCorner>().swap(chunk.corners);
+        std::vector<ObjCorner>().swap(chunk.uniqueCorners);
+        std::vector<uint32_t>().swap(chunk.cornerVertex);
+    });
+
+    if (missingNormals)
+        ComputeVertexNormals(vertices, indices.data(), indices.size(), normalFlags);
+    if (options.generateTangents)
+        ComputeVertexTangents(vertices, indices.data(), indices.size());
+
+    auto parsed = std::chrono::steady_clock::now();
+    meshes.emplace_back(std::move(vertices), std::move(indices), vector<Texture>());
+    auto uploaded = std::chrono::steady_clock::now();
+
+    if (stats) {
+        stats->bytes += file.Size();
+        stats->vertices += vertexCount;
+        stats->triangles += indexCount / 3;
+        stats->meshes += 1;
+        stats->parseSeconds += std::chrono::duration<double>(parsed - start).count();
+        stats->uploadSeconds += std::chrono::duration<double>(uploaded - parsed).count();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// glTF 2.0
+// ---------------------------------------------------------------------------
+
+const int GLTF_BYTE = 5120;
+const int GLTF_UNSIGNED_BYTE = 5121;
+const int GLTF_SHORT = 5122;
+const int GLTF_UNSIGNED_SHORT = 5123;
+const int GLTF_UNSIGNED_INT = 5125;
+const int GLTF_FLOAT = 5126;
+const int GLTF_TRIANGLES = 4;
+
+// A validated view of one accessor inside a mapped buffer
+struct GltfAccessor {
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+
+    size_t ComponentSize() const
+    {
+        switch (componentType) {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        default: return 4;
+        }
+    }
+
+    // Component c of element i as a float, normalized integers are mapped to [0, 1] or [-1, 1]
+    float Float(size_t i, int c) const
+    {
+        const unsigned char* p = data + i * stride + c * ComponentSize();
+        switch (componentType) {
+        case GLTF_FLOAT: { float v; memcpy(&v, p, 4); return v; }
+        case GLTF_UNSIGNED_BYTE: return normalized ? *p / 255.0f : float(*p);
+        case GLTF_BYTE: { int8_t v; memcpy(&v, p, 1); return normalized ? std::max(v / 127.0f, -1.0f) : float(v); }
+        case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return normalized ? v / 65535.0f : float(v); }
+        case GLTF_SHORT: { int16_t v; memcpy(&v, p, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : float(v); }
+        default: { uint32_t v; memcpy(&v, p, 4); return float(v); }
+        }
+    }
+
+    uint32_t Index(size_t i) const
+    {
+        const unsigned char* p = data + i * stride;
+        switch (componentType) {
+        case GLTF_UNSIGNED_BYTE: return *p;
+        case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return v; }
+        default: { uint32_t v; memcpy(&v, p, 4); return v; }
+        }
+    }
+};
+
+// One primitive converted on a worker thread, turned into a Mesh on the calling thread
+struct GltfPrimitive {
+    const JsonValue* json = nullptr;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    const unsigned int* mappedIndices = nullptr; // packed 32 bit indices used straight from the mapping
+    size_t indexCount = 0;
+    std::string error;
+};
+
+class GltfImporter
+{
+public:
+    bool Import(const std::string& path, std::vector<Mesh>& meshes, const ModelImportOptions& options, ModelImportStats* stats)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MappedFile file;
+        if (!file.Open(path)) {
+            std::cout << "Failed to open model: " << path << std::endl;
+            return false;
+        }
+        size_t bytes = file.Size();
+
+        // A .glb holds the JSON chunk and a binary chunk, a .gltf is JSON only
+        const char* jsonText = reinterpret_cast<const char*>(file.Data());
+        size_t jsonLength = file.Size();
+        const unsigned char* binChunk = nullptr;
+        size_t binLength = 0;
+        if (file.Size() >= 12 && memcmp(file.Data(), "glTF", 4) == 0) {
+            if (!ReadGlb(file, jsonText, jsonLength, binChunk, binLength)) {
+                std::cout << "Malformed GLB file: " << path << std::endl;
+                return false;
+            }
+        }
+
+        JsonValue root;
+        JsonReader reader;
+        if (!reader.Parse(jsonText, jsonLength, root)) {
+            std::cout << "Failed to parse glTF JSON in " << path << ": " << reader.Error() << std::endl;
+            return false;
+        }
+
+        // Map every buffer, external .bin files are mapped next to the model
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        const JsonValue* bufferList = root.Find("buffers");
+        for (size_t i = 0; bufferList && i < bufferList->Size(); ++i) {
+            const JsonValue& buffer = bufferList->items[i];
+            std::string uri = buffer.String("uri");
+            size_t length = size_t(buffer.Number("byteLength", 0.0));
+            if (uri.empty()) {
+                if (i != 0 || !binChunk || binLength < length) {
+                    std::cout << "glTF buffer " << i << " has no data in " << path << std::endl;
+                    return false;
+                }
+                buffers.push_back({ binChunk, binLength });
+            }
+            else if (uri.compare(0, 5, "data:") == 0) {
+                std::cout << "Embedded glTF buffers are not supported, convert " << path << " to .glb" << std::endl;
+                return false;
+            }
+            else {
+                files.emplace_back();
+                if (!files.back().Open(directory + uri) || files.back().Size() < length) {
+                    std::cout << "Failed to open glTF buffer: " << directory + uri << std::endl;
+                    return false;
+                }
+                buffers.push_back({ files.back().Data(), files.back().Size() });
+                bytes += files.back().Size();
+            }
+        }
+
+        // Flatten the primitives of every mesh, then convert them in parallel
+        std::vector<GltfPrimitive> primitives;
+        const JsonValue* meshList = root.Find("meshes");
+        for (size_t m = 0; meshList && m < meshList->Size(); ++m) {
+            const JsonValue* primitiveList = meshList->items[m].Find("primitives");
+            for (size_t p = 0; primitiveList && p < primitiveList->Size(); ++p) {
+                primitives.emplace_back();
+                primitives.back().json = &primitiveList->items[p];
+            }
+        }
+
+        ParallelFor(primitives.size(), ModelImportThreads(options), [&](size_t i) {
+            Convert(root, primitives[i], options);
+        });
+
+        auto parsed = std::chrono::steady_clock::now();
+        size_t vertexCount = 0, indexCount = 0, meshCount = 0;
+        for (GltfPrimitive& primitive : primitives) {
+            if (!primitive.error.empty()) {
+                std::cout << "Skipping glTF primitive in " << path << ": " << primitive.error << std::endl;
+                continue;
+            }
+
+            vertexCount += primitive.vertices.size();
+            indexCount += primitive.indexCount;
+            ++meshCount;
+            if (primitive.mappedIndices)
+                meshes.emplace_back(primitive.vertices.data(), primitive.vertices.size(), primitive.mappedIndices, primitive.indexCount, vector<Texture>());
+            else
+                meshes.emplace_back(std::move(primitive.vertices), std::move(primitive.indices), vector<Texture>());
+        }
+        auto uploaded = std::chrono::steady_clock::now();
+
+        if (stats) {
+            stats->bytes += bytes;
+            stats->vertices += vertexCount;
+            stats->triangles += indexCount / 3;
+            stats->meshes += meshCount;
+            stats->parseSeconds += std::chrono::duration<double>(parsed - start).count();
+            stats->uploadSeconds += std::chrono::duration<double>(uploaded - parsed).count();
+        }
+        return true;
+    }
+
+private:
+    struct BufferData {
+        const unsigned char* data;
+        size_t size;
+    };
+
+    std::vector<MappedFile> files;
+    std::vector<BufferData> buffers;
+
+    static uint32_t ReadU32(const unsigned char* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static bool ReadGlb(const MappedFile& file, const char*& jsonText, size_t& jsonLength, const unsigned char*& binChunk, size_t& binLength)
+    {
+        const unsigned char* data = file.Data();
+        size_t size = std::min<size_t>(file.Size(), ReadU32(data + 8));
+        size_t offset = 12;
+        jsonText = nullptr;
+        while (offset + 8 <= size) {
+            uint32_t length = ReadU32(data + offset);
+            uint32_t type = ReadU32(data + offset + 4);
+            if (offset + 8 + length > size)
+                return false;
+            if (type == 0x4E4F534A) { // "JSON"
+                jsonText = reinterpret_cast<const char*>(data + offset + 8);
+                jsonLength = length;
+            }
+            else if (type == 0x004E4942) { // "BIN\0"
+                binChunk = data + offset + 8;
+                binLength = length;
+            }
+            offset += 8 + ((length + 3) & ~size_t(3));
+        }
+        return jsonText != nullptr;
+    }
+
+    // Resolves accessor index into a bounds checked view, false if it is sparse, missing, or out of range
+    bool Resolve(const JsonValue& root, double index, GltfAccessor& accessor, std::string& error) const
+    {
+        const JsonValue* accessors = root.Find("accessors");
+        const JsonValue* json = accessors ? accessors->At(size_t(index)) : nullptr;
+        if (!json || index < 0) {
+            error = "missing accessor";
+            return false;
+        }
+        if (json->Find("sparse") || !json->Find("bufferView")) {
+            error = "sparse accessors are not supported";
+            return false;
+        }
+
+        const JsonValue* views = root.Find("bufferViews");
+        const JsonValue* view = views ? views->At(size_t(json->Number("bufferView", -1.0))) : nullptr;
+        if (!view) {
+            error = "missing buffer view";
+            return false;
+        }
+        size_t bufferIndex = size_t(view->Number("buffer", -1.0));
+        if (bufferIndex >= buffers.size()) {
+            error = "missing buffer";
+            return false;
+        }
+
+        static const char* const types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+        std::string type = json->String("type");
+        accessor.components = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (type == types[i])
+                accessor.components = i + 1;
+        }
+        accessor.componentType = int(json->Number("componentType", 0.0));
+        accessor.count = size_t(json->Number("count", 0.0));
+        const JsonValue* normalized = json->Find("normalized");
+        accessor.normalized = normalized && normalized->boolean;
+        bool knownComponent = accessor.componentType == GLTF_BYTE || accessor.componentType == GLTF_UNSIGNED_BYTE || accessor.componentType == GLTF_SHORT
+            || accessor.componentType == GLTF_UNSIGNED_SHORT || accessor.componentType == GLTF_UNSIGNED_INT || accessor.componentType == GLTF_FLOAT;
+        if (accessor.components == 0 || !knownComponent) {
+            error = "unsupported accessor type";
+            return false;
+        }
+
+        size_t elementSize = accessor.ComponentSize() * accessor.components;
+        accessor.stride = size_t(view->Number("byteStride", 0.0));
+        if (accessor.stride == 0)
+            accessor.stride = elementSize;
+        size_t offset = size_t(view->Number("byteOffset", 0.0)) + size_t(json->Number("byteOffset", 0.0));
+        size_t viewEnd = size_t(view->Number("byteOffset", 0.0)) + size_t(view->Number("byteLength", 0.0));
+        if (viewEnd > buffers[bufferIndex].size || (accessor.count && offset + (accessor.count - 1) * accessor.stride + elementSize > viewEnd)) {
+            error = "accessor out of range";
+            return false;
+        }
+        accessor.data = buffers[bufferIndex].data + offset;
+        return true;
+    }
+
+    void Convert(const JsonValue& root, GltfPrimitive& primitive, const ModelImportOptions& options) const
+    {
+        const JsonValue& json = *primitive.json;
+        if (json.Number("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+            primitive.error = "only triangle lists are supported";
+            return;
+        }
+        const JsonValue* attributes = json.Find("attributes");
+        if (!attributes || !attributes->Find("POSITION")) {
+            primitive.error = "no positions";
+            return;
+        }
+
+        GltfAccessor positions, normals, texCoords, tangents;
+        if (!Resolve(root, attributes->Number("POSITION", -1.0), positions, primitive.error) || positions.components != 3)
+            return Failed(primitive, "positions must be VEC3");
+        bool hasNormals = attributes->Find("NORMAL") != nullptr;
+        bool hasTexCoords = attributes->Find("TEXCOORD_0") != nullptr;
+        bool hasTangents = options.generateTangents && attributes->Find("TANGENT") != nullptr;
+        if (hasNormals && (!Resolve(root, attributes->Number("NORMAL", -1.0), normals, primitive.error) || normals.components != 3 || normals.count != positions.count))
+            return Failed(primitive, "invalid normals");
+        if (hasTexCoords && (!Resolve(root, attributes->Number("TEXCOORD_0", -1.0), texCoords, primitive.error) || texCoords.components != 2 || texCoords.count != positions.count))
+            return Failed(primitive, "invalid texture coordinates");
+        if (hasTangents && (!Resolve(root, attributes->Number("TANGENT", -1.0), tangents, primitive.error) || tangents.components != 4 || tangents.count != positions.count))
+            return Failed(primitive, "invalid tangents");
+
+        primitive.vertices.resize(positions.count);
+        for (size_t i = 0; i < positions.count; ++i) {
+            Vertex& vertex = primitive.vertices[i];
+            vertex.Position = glm::vec3(positions.Float(i, 0), positions.Float(i, 1), positions.Float(i, 2));
+            vertex.Normal = hasNormals ? glm::vec3(normals.Float(i, 0), normals.Float(i, 1), normals.Float(i, 2)) : glm::vec3(0.0f);
+            vertex.TexCoords = hasTexCoords ? glm::vec2(texCoords.Float(i, 0), texCoords.Float(i, 1)) : glm::vec2(0.0f);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        }
+
+        // Packed 32 bit indices are used in place, anything else is widened
+        if (json.Find("indices")) {
+            GltfAccessor indexAccessor;
+            if (!Resolve(root, json.Number("indices", -1.0), indexAccessor, primitive.error) || indexAccessor.components != 1
+                || (indexAccessor.componentType != GLTF_UNSIGNED_BYTE && indexAccessor.componentType != GLTF_UNSIGNED_SHORT && indexAccessor.componentType != GLTF_UNSIGNED_INT))
+                return Failed(primitive, "invalid indices");
+
+            bool inPlace = indexAccessor.componentType == GLTF_UNSIGNED_INT && indexAccessor.stride == 4
+                && reinterpret_cast<uintptr_t>(indexAccessor.data) % alignof(unsigned int) == 0;
+            if (inPlace) {
+                primitive.mappedIndices = reinterpret_cast<const unsigned int*>(indexAccessor.data);
+            }
+            else {
+                primitive.indices.resize(indexAccessor.count);
+                for (size_t i = 0; i < indexAccessor.count; ++i)
+                    primitive.indices[i] = indexAccessor.Index(i);
+            }
+            primitive.indexCount = indexAccessor.count - indexAccessor.count % 3;
+        }
+        else {
+            primitive.indices.resize(positions.count - positions.count % 3);
+            for (size_t i = 0; i < primitive.indices.size(); ++i)
+                primitive.indices[i] = static_cast<unsigned int>(i);
+            primitive.indexCount = primitive.indices.size();
+        }
+
+        const unsigned int* indexData = primitive.mappedIndices ? primitive.mappedIndices : primitive.indices.data();
+        for (size_t i = 0; i < primitive.indexCount; ++i) {
+            if (indexData[i] >= positions.count)
+                return Failed(primitive, "index out of range");
+        }
+
+        if (!hasNormals)
+            ComputeVertexNormals(primitive.vertices, indexData, primitive.indexCount, std::vector<char>());
+
+        if (hasTangents) {
+            for (size_t i = 0; i < tangents.count; ++i) {
+                Vertex& vertex = primitive.vertices[i];
+                vertex.Tangent = glm::vec3(tangents.Float(i, 0), tangents.Float(i, 1), tangents.Float(i, 2));
+                vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * tangents.Float(i, 3);
+            }
+        }
+        else if (options.generateTangents) {
+            ComputeVertexTangents(primitive.vertices, indexData, primitive.indexCount);
+        }
+    }
+
+    static void Failed(GltfPrimitive& primitive, const char* message)
+    {
+        if (primitive.error.empty())
+            primitive.error = message;
+        primitive.vertices.clear();
+        primitive.indices.clear();
+        primitive.mappedIndices = nullptr;
+    }
+};
+
+/*
+* Imports an OBJ, glTF, or GLB file into meshes, picking the format from the extension
+* Must be called on the thread that owns the GL context
+* @params path: model file
+*         meshes: the imported meshes are appended here
+*         options: tangent generation and thread count
+*         stats: receives sizes and timings, may be nullptr
+* @return false if the file cannot be read or its format is not supported
+*/
+inline bool ImportModel(const std::string& path, std::vector<Mesh>& meshes, const ModelImportOptions& options = ModelImportOptions(), ModelImportStats* stats = nullptr)
+{
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+    if (extension == "obj")
+        return ImportObj(path, meshes, options, stats);
+    if (extension == "gltf" || extension == "glb")
+        return GltfImporter().Import(path, meshes, options, stats);
+
+    std::cout << "Unsupported model format: " << path << std::endl;
+    return false;
+}
+
+#endif
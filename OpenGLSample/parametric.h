@@ -0,0 +1,339 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Parametric surface generator
+* Every curved primitive in the scene is a (u, v) grid: the sphere, the torus and
+* the cylinder sides only differ in how a (u, v) pair maps to a position, normal
+* and texture coordinate. ParametricSurface<F> owns the shared work (grid topology,
+* indices, tangent frames and bounds) and F only supplies the mapping, so the
+* functor calls are inlined into one loop per primitive
+*
+* A surface functor provides, for u and v in [0, 1]:
+*   glm::vec3 Position(float u, float v) const
+*   glm::vec3 Normal(float u, float v) const
+*   glm::vec2 TexCoord(float u, float v) const
+* u runs along a row of the grid and v selects the row
+*/
+
+#ifndef PARAMETRIC_H
+#define PARAMETRIC_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <vector>
+
+// Interleaved vertex emitted by every parametric surface
+struct SurfaceVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec4 Tangent; // xyz points along increasing texture u, w is the bitangent sign
+};
+
+// Axis aligned box and bounding sphere of a surface
+struct SurfaceBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+};
+
+// Computes the box and bounding sphere of a vertex array
+inline SurfaceBounds ComputeBounds(const SurfaceVertex* vertices, size_t count) {
+    SurfaceBounds bounds = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f };
+    if (count == 0)
+        return bounds;
+
+    bounds.min = bounds.max = vertices[0].Position;
+    for (size_t i = 1; i < count; ++i) {
+        bounds.min = glm::min(bounds.min, vertices[i].Position);
+        bounds.max = glm::max(bounds.max, vertices[i].Position);
+    }
+
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    for (size_t i = 0; i < count; ++i)
+        bounds.radius = glm::max(bounds.radius, glm::length(vertices[i].Position - bounds.center));
+    return bounds;
+}
+
+/*
+* Computes per-vertex tangent frames from positions, normals and texture coordinates
+* Triangle tangents are accumulated per vertex, then orthogonalised against the normal
+* Vertices without a usable texture gradient (e.g. the sphere poles) get any tangent
+* perpendicular to their normal
+*/
+inline void ComputeTangentFrames(std::vector<SurfaceVertex>& vertices, const std::vector<GLuint>& indices) {
+    std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        GLuint i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        const SurfaceVertex& v0 = vertices[i0];
+        const SurfaceVertex& v1 = vertices[i1];
+        const SurfaceVertex& v2 = vertices[i2];
+
+        glm::vec3 edge1 = v1.Position - v0.Position;
+        glm::vec3 edge2 = v2.Position - v0.Position;
+        glm::vec2 duv1 = v1.TexCoords - v0.TexCoords;
+        glm::vec2 duv2 = v2.TexCoords - v0.TexCoords;
+
+        float det = duv1.x * duv2.y - duv2.x * duv1.y;
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        float r = 1.0f / det;
+
+        glm::vec3 t = (edge1 * duv2.y - edge2 * duv1.y) * r;
+        glm::vec3 b = (edge2 * duv1.x - edge1 * duv2.x) * r;
+        tangents[i0] += t; tangents[i1] += t; tangents[i2] += t;
+        bitangents[i0] += b; bitangents[i1] += b; bitangents[i2] += b;
+    }
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        glm::vec3 n = vertices[i].Normal;
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+
+        if (glm::dot(t, t) < 1e-12f) {
+            glm::vec3 axis = std::fabs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            t = glm::cross(axis, n);
+        }
+        t = glm::normalize(t);
+
+        float handedness = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+        vertices[i].Tangent = glm::vec4(t, handedness);
+    }
+}
+
+/*
+* Generic (u, v) grid generator
+* uSegments/vSegments are the number of quads along u and v; the grid has
+* (uSegments + 1) * (vSegments + 1) vertices so texture seams get their own copies
+*/
+template <typename F>
+class ParametricSurface
+{
+public:
+    ParametricSurface(const F& function, int uSegments, int vSegments) : function(function), uSegments(uSegments), vSegments(vSegments) {}
+
+    size_t VertexCount() const { return size_t(uSegments + 1) * (vSegments + 1); }
+    size_t IndexCount() const { return size_t(uSegments) * vSegments * 6; }
+
+    /*
+    * Fills vertices and indices with the surface and returns its bounds
+    * Both vectors are sized once up front and written in place
+    */
+    SurfaceBounds Generate(std::vector<SurfaceVertex>& vertices, std::vector<GLuint>& indices) const
+    {
+        vertices.resize(VertexCount());
+        indices.resize(IndexCount());
+
+        // Parameter values along a row are the same for every row
+        std::vector<float> us(uSegments + 1);
+        for (int j = 0; j <= uSegments; ++j)
+            us[j] = static_cast<float>(j) / uSegments;
+
+        SurfaceVertex* vertex = vertices.data();
+        for (int i = 0; i <= vSegments; ++i) {
+            float v = static_cast<float>(i) / vSegments;
+            for (int j = 0; j <= uSegments; ++j, ++vertex) {
+                vertex->Position = function.Position(us[j], v);
+                vertex->Normal = function.Normal(us[j], v);
+                vertex->TexCoords = function.TexCoord(us[j], v);
+            }
+        }
+
+        // Two triangles per quad; a/b are on row i, c/d are on row i + 1
+        const GLuint rowStride = uSegments + 1;
+        GLuint* index = indices.data();
+        for (int i = 0; i < vSegments; ++i) {
+            GLuint a = i * rowStride;
+            for (int j = 0; j < uSegments; ++j, ++a, index += 6) {
+                GLuint b = a + 1;
+                GLuint c = a + rowStride;
+                GLuint d = c + 1;
+                index[0] = a; index[1] = c; index[2] = b;
+                index[3] = c; index[4] = d; index[5] = b;
+            }
+        }
+
+        ComputeTangentFrames(vertices, indices);
+        return ComputeBounds(vertices.data(), vertices.size());
+    }
+
+private:
+    F function;
+    int uSegments;
+    int vSegments;
+};
+
+// Sphere centred at the origin, v runs from the top pole to the bottom pole
+struct SphereSurface {
+    float radius;
+
+    glm::vec3 Position(float u, float v) const { return radius * Normal(u, v); }
+    glm::vec3 Normal(float u, float v) const
+    {
+        float theta = v * glm::pi<float>();
+        float phi = u * glm::two_pi<float>();
+        return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(u, 1.0f - v); } // flip so 0 is at the top
+
+    // Analytic bounds for paths that never see the vertices on the CPU
+    SurfaceBounds Bounds() const { return { glm::vec3(-radius), glm::vec3(radius), glm::vec3(0.0f), radius }; }
+};
+
+// Torus in the XZ plane, u goes around the tube and v goes around the ring
+struct TorusSurface {
+    float innerRadius; // radius of the tube
+    float outerRadius; // distance from the centre to the middle of the tube
+
+    glm::vec3 Position(float u, float v) const
+    {
+        float theta = v * glm::two_pi<float>();
+        float phi = u * glm::two_pi<float>();
+        float ring = outerRadius + innerRadius * std::cos(phi);
+        return glm::vec3(ring * std::cos(theta), innerRadius * std::sin(phi), ring * std::sin(theta));
+    }
+    glm::vec3 Normal(float u, float v) const
+    {
+        float theta = v * glm::two_pi<float>();
+        float phi = u * glm::two_pi<float>();
+        return glm::vec3(std::cos(phi) * std::cos(theta), std::sin(phi), std::cos(phi) * std::sin(theta));
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(v, u); }
+
+    SurfaceBounds Bounds() const
+    {
+        float extent = outerRadius + innerRadius;
+        return { glm::vec3(-extent, -innerRadius, -extent), glm::vec3(extent, innerRadius, extent), glm::vec3(0.0f), extent };
+    }
+};
+
+// Open cylinder around the Y axis, centred at the origin
+struct CylinderSurface {
+    float radius;
+    float height;
+
+    glm::vec3 Position(float u, float v) const
+    {
+        float angle = u * glm::two_pi<float>();
+        return glm::vec3(radius * std::cos(angle), -height * 0.5f + v * height, radius * std::sin(angle));
+    }
+    glm::vec3 Normal(float u, float /*v*/) const
+    {
+        float angle = u * glm::two_pi<float>();
+        return glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(u, v); }
+
+    SurfaceBounds Bounds() const
+    {
+        glm::vec3 extent(radius, height * 0.5f, radius);
+        return { -extent, extent, glm::vec3(0.0f), std::sqrt(radius * radius + height * height * 0.25f) };
+    }
+};
+
+// Open cone around the Y axis with its apex at +height / 2
+struct ConeSurface {
+    float radius;
+    float height;
+
+    glm::vec3 Position(float u, float v) const
+    {
+        float angle = u * glm::two_pi<float>();
+        float r = radius * (1.0f - v);
+        return glm::vec3(r * std::cos(angle), -height * 0.5f + v * height, r * std::sin(angle));
+    }
+    glm::vec3 Normal(float u, float /*v*/) const
+    {
+        float angle = u * glm::two_pi<float>();
+        return glm::normalize(glm::vec3(height * std::cos(angle), radius, height * std::sin(angle)));
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(u, v); }
+};
+
+// Capsule around the Y axis: a cylinder of the given length capped by two hemispheres
+struct CapsuleSurface {
+    float radius;
+    float length; // length of the cylindrical part
+
+    glm::vec3 Position(float u, float v) const
+    {
+        float latitude, centerY;
+        Profile(v, latitude, centerY);
+        return glm::vec3(0.0f, centerY, 0.0f) + radius * Direction(u, latitude);
+    }
+    glm::vec3 Normal(float u, float v) const
+    {
+        float latitude, centerY;
+        Profile(v, latitude, centerY);
+        return Direction(u, latitude);
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(u, v); }
+
+private:
+    // Maps v to arc length along the profile so texels are evenly spread
+    void Profile(float v, float& latitude, float& centerY) const
+    {
+        float quarter = glm::half_pi<float>() * radius;
+        float s = v * (2.0f * quarter + length);
+        if (s < quarter) {
+            latitude = -glm::half_pi<float>() + s / radius;
+            centerY = -length * 0.5f;
+        }
+        else if (s < quarter + length) {
+            latitude = 0.0f;
+            centerY = -length * 0.5f + (s - quarter);
+        }
+        else {
+            latitude = (s - quarter - length) / radius;
+            centerY = length * 0.5f;
+        }
+    }
+
+    static glm::vec3 Direction(float u, float latitude)
+    {
+        float angle = u * glm::two_pi<float>();
+        return glm::vec3(std::cos(latitude) * std::cos(angle), std::sin(latitude), std::cos(latitude) * std::sin(angle));
+    }
+};
+
+// Superellipsoid, the exponents blend between a box (small values), sphere (1) and star shapes (> 2)
+struct SuperquadricSurface {
+    glm::vec3 radii;
+    float latitudeExponent;
+    float longitudeExponent;
+
+    glm::vec3 Position(float u, float v) const
+    {
+        float eta = -glm::half_pi<float>() + v * glm::pi<float>();
+        float omega = -glm::pi<float>() + u * glm::two_pi<float>();
+        float ce = SignedPow(std::cos(eta), latitudeExponent);
+        return glm::vec3(radii.x * ce * SignedPow(std::cos(omega), longitudeExponent),
+            radii.y * SignedPow(std::sin(eta), latitudeExponent),
+            radii.z * ce * SignedPow(std::sin(omega), longitudeExponent));
+    }
+    glm::vec3 Normal(float u, float v) const
+    {
+        float eta = -glm::half_pi<float>() + v * glm::pi<float>();
+        float omega = -glm::pi<float>() + u * glm::two_pi<float>();
+        float ce = SignedPow(std::cos(eta), 2.0f - latitudeExponent);
+        glm::vec3 n(ce * SignedPow(std::cos(omega), 2.0f - longitudeExponent) / radii.x,
+            SignedPow(std::sin(eta), 2.0f - latitudeExponent) / radii.y,
+            ce * SignedPow(std::sin(omega), 2.0f - longitudeExponent) / radii.z);
+        float len = glm::length(n);
+        return len > 0.0f ? n / len : glm::vec3(0.0f, eta > 0.0f ? 1.0f : -1.0f, 0.0f);
+    }
+    glm::vec2 TexCoord(float u, float v) const { return glm::vec2(u, v); }
+
+private:
+    static float SignedPow(float value, float exponent)
+    {
+        float magnitude = std::pow(std::fabs(value), exponent);
+        return value < 0.0f ? -magnitude : magnitude;
+    }
+};
+
+#endif
@@ -0,0 +1,246 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Program binary cache
+* The first launch links every shader program from its GLSL source and saves
+* the driver's binary with glGetProgramBinary. Later launches hand that binary
+* to glProgramBinary and skip compiling and linking altogether
+*
+* File layout:
+*   ProgramCacheHeader
+*   the binary, in the driver's own binaryFormat
+*
+* A cache file is named after the hash of the program's stage sources and the
+* driver's vendor, renderer and version strings, so editing a shader or
+* updating the driver simply misses and writes a new file. A driver may still
+* reject a binary it wrote itself; Load deletes such files and the caller
+* compiles from source as if the cache had missed
+*/
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+const char* const PROGRAM_CACHE_DIR = "programcache";
+const uint32_t PROGRAM_CACHE_MAGIC = 0x47525043; // "CPRG" read as little-endian bytes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t keyHash;
+    uint32_t binaryFormat; // as returned by glGetProgramBinary
+    uint32_t binarySize;
+};
+
+/*
+* Identifies one program: its stage sources and the driver that links it
+* Must be created on the GL thread, the driver strings are read from the current context
+*/
+class ProgramCacheKey
+{
+public:
+    ProgramCacheKey()
+    {
+        Add(PROGRAM_CACHE_VERSION);
+        AddString(glGetString(GL_VENDOR));
+        AddString(glGetString(GL_RENDERER));
+        AddString(glGetString(GL_VERSION));
+    }
+
+    // Adds one stage, its sources in the order they are passed to glShaderSource
+    ProgramCacheKey& AddStage(GLenum type, const char* const* sources, int count)
+    {
+        Add(uint32_t(type));
+        Add(uint32_t(count));
+        for (int i = 0; i < count; ++i) {
+            size_t length = strlen(sources[i]);
+            Add(uint32_t(length));
+            AddBytes(sources[i], length);
+        }
+        return *this;
+    }
+
+    ProgramCacheKey& AddStage(GLenum type, const char* source) { return AddStage(type, &source, 1); }
+
+    uint64_t Hash() const { return hash; }
+
+    // Path of the cache file for this key, e.g. programcache/0123456789abcdef.bin
+    std::string Path() const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return std::string(PROGRAM_CACHE_DIR) + "/" + hex + ".bin";
+    }
+
+private:
+    uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+
+    void Add(uint32_t value) { AddBytes(&value, sizeof(value)); }
+
+    void AddString(const GLubyte* text)
+    {
+        const char* string = text ? reinterpret_cast<const char*>(text) : "";
+        size_t length = strlen(string);
+        Add(uint32_t(length));
+        AddBytes(string, length);
+    }
+
+    void AddBytes(const void* bytes, size_t count)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ull; // FNV-1a prime
+        }
+    }
+};
+
+/*
+* Saves and restores linked programs, all on the GL thread
+* A program is only retrievable when GL_PROGRAM_BINARY_RETRIEVABLE_HINT was set
+* before it was linked, call PrepareLink on it first
+*/
+class ProgramCache
+{
+public:
+    // Cache statistics for the whole process
+    static inline unsigned int hits = 0;
+    static inline unsigned int misses = 0;
+
+    // Cleared by --no-program-cache, every program is then compiled from source
+    static inline bool enabled = true;
+
+    // Whether the driver offers any binary format, without one there is nothing to save
+    static bool Supported()
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    /*
+    * Creates a program from the cache file for key
+    * @params programId: receives the linked program on a hit, untouched on a miss
+    * @return false on a miss or when the driver rejected the binary, compile from source then
+    */
+    static bool Load(const ProgramCacheKey& key, GLuint& programId)
+    {
+        if (!enabled)
+            return false;
+
+        MappedFile file;
+        ProgramCacheHeader header;
+        if (!file.Open(key.Path()) || file.Size() < sizeof(header)) {
+            ++misses;
+            return false;
+        }
+        memcpy(&header, file.Data(), sizeof(header));
+        if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+            header.keyHash != key.Hash() || sizeof(header) + uint64_t(header.binarySize) != file.Size()) {
+            file.Close();
+            Remove(key);
+            ++misses;
+            return false;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, GLenum(header.binaryFormat), file.Data() + sizeof(header), GLsizei(header.binarySize));
+        file.Close();
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Usually a driver update that kept its version string, the next Store replaces the file
+            glDeleteProgram(program);
+            Remove(key);
+            ++misses;
+            return false;
+        }
+
+        programId = program;
+        ++hits;
+        return true;
+    }
+
+    // Asks the driver to keep the binary of a program about to be linked
+    static void PrepareLink(GLuint programId)
+    {
+        if (enabled)
+            glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /*
+    * Writes the binary of a linked program to the cache file for key
+    * Failure to write only costs the next launch a compile
+    */
+    static bool Store(const ProgramCacheKey& key, GLuint programId)
+    {
+        if (!enabled)
+            return false;
+
+        GLint length = 0;
+        glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+
+        std::vector<char> binary(size_t(length), 0);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(programId, length, &written, &format, binary.data());
+        if (written <= 0)
+            return false;
+
+        ProgramCacheHeader header = {};
+        header.magic = PROGRAM_CACHE_MAGIC;
+        header.version = PROGRAM_CACHE_VERSION;
+        header.keyHash = key.Hash();
+        header.binaryFormat = uint32_t(format);
+        header.binarySize = uint32_t(written);
+
+        std::error_code error;
+        std::filesystem::create_directories(PROGRAM_CACHE_DIR, error);
+
+        // Write to a temporary file and rename so a crash never leaves a truncated cache
+        std::string path = key.Path();
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), written);
+            if (!out)
+                return false;
+        }
+
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+    // Deletes every cache file, forcing the next Load calls to miss
+    static void Clear()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(PROGRAM_CACHE_DIR, error);
+    }
+
+private:
+    static void Remove(const ProgramCacheKey& key)
+    {
+        std::error_code error;
+        std::filesystem::remove(key.Path(), error);
+    }
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Shader export
+* Writes the stages of every shader program to a directory, one file per
+* stage holding exactly the text handed to glShaderSource, so the shaders can
+* be checked without a GL context. validateshaders.py compiles the files with
+* glslangValidator and can also write them out as SPIR-V for ARB_gl_spirv
+*
+* Files are named after the program with the extension glslangValidator takes
+* the stage from, e.g. object_textured_specular_3_lights.frag. A stage that a
+* file in shaderfiles replaces is exported with that file, as the reloader
+* compiles it; shaderfiles.txt lists those names so the validator does not also
+* compile them on their own, without the defines they expect
+*/
+
+#ifndef SHADEREXPORT_H
+#define SHADEREXPORT_H
+
+#include <glad/glad.h>
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "shaderlibrary.h"
+#include "shaderreloader.h"
+
+const char* const SHADER_EXPORT_LIST = "shaderfiles.txt"; // shaderfiles names the exported stages were read from
+
+class ShaderExport
+{
+public:
+    /*
+    * Starts an export into dir, creating it
+    * Stage files left there by an earlier export are deleted, so programs that no longer exist are not validated
+    * @return false if the directory cannot be created
+    */
+    bool Begin(const std::string& dir)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(dir, error);
+        if (!std::filesystem::is_directory(dir, error)) {
+            std::cout << "Shader export: cannot create " << dir << std::endl;
+            return false;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+            if (entry.is_regular_file(error) && IsStageExtension(entry.path().extension().string()))
+                std::filesystem::remove(entry.path(), error);
+        }
+
+        directory = dir;
+        programCount = 0;
+        stageCount = 0;
+        failed = false;
+        shaderFiles.clear();
+        return true;
+    }
+
+    // Writes the stages of a program compiled from inline sources only
+    void Add(const std::string& name, const std::vector<ShaderStage>& stages)
+    {
+        for (const ShaderStage& stage : stages) {
+            std::string text;
+            for (const char* source : stage.sources)
+                text += source;
+            Write(name, stage.type, text);
+        }
+        ++programCount;
+    }
+
+    // Writes the stages of a program shaderReloader watches, with the files in reloadDir that replace its sources
+    void AddReloadable(const std::string& name, const std::vector<ReloadableStage>& stages, const std::string& reloadDir = SHADER_RELOAD_DIR)
+    {
+        for (const ReloadableStage& stage : stages) {
+            std::string text;
+            for (const std::string& source : ShaderReloader::ReadStage(reloadDir, stage))
+                text += source;
+            Write(name, stage.type, text);
+            for (const ShaderSourceFile& part : stage.parts)
+                shaderFiles.insert(part.file);
+        }
+        ++programCount;
+    }
+
+    // Writes SHADER_EXPORT_LIST and reports the export, false if any file could not be written
+    bool Finish()
+    {
+        std::ofstream list(std::filesystem::path(directory) / SHADER_EXPORT_LIST, std::ios::binary | std::ios::trunc);
+        for (const std::string& file : shaderFiles)
+            list << file << "\n";
+        if (!list) {
+            std::cout << "Shader export: cannot write " << SHADER_EXPORT_LIST << std::endl;
+            failed = true;
+        }
+
+        std::cout << "Exported " << stageCount << " stages of " << programCount << " shader programs to " << directory << std::endl;
+        return !failed;
+    }
+
+    // Extension glslangValidator recognizes a stage by
+    static const char* StageExtension(GLenum type)
+    {
+        switch (type) {
+        case GL_VERTEX_SHADER: return ".vert";
+        case GL_TESS_CONTROL_SHADER: return ".tesc";
+        case GL_TESS_EVALUATION_SHADER: return ".tese";
+        case GL_GEOMETRY_SHADER: return ".geom";
+        case GL_FRAGMENT_SHADER: return ".frag";
+        case GL_COMPUTE_SHADER: return ".comp";
+        default: return ".glsl";
+        }
+    }
+
+    // Program name as a file name, e.g. "object TEXTURED+SPECULAR, 3 lights" becomes object_textured_specular_3_lights
+    static std::string FileName(const std::string& name)
+    {
+        std::string file;
+        for (char c : name) {
+            if (std::isalnum(static_cast<unsigned char>(c)))
+                file += char(std::tolower(static_cast<unsigned char>(c)));
+            else if (!file.empty() && file.back() != '_')
+                file += '_';
+        }
+        while (!file.empty() && file.back() == '_')
+            file.pop_back();
+        return file;
+    }
+
+private:
+    std::string directory;
+    unsigned int programCount = 0;
+    unsigned int stageCount = 0;
+    bool failed = false;
+    std::set<std::string> shaderFiles;
+
+    static bool IsStageExtension(const std::string& extension)
+    {
+        const char* extensions[] = { ".vert", ".tesc", ".tese", ".geom", ".frag", ".comp", ".glsl" };
+        for (const char* stage : extensions) {
+            if (extension == stage)
+                return true;
+        }
+        return false;
+    }
+
+    void Write(const std::string& name, GLenum type, const std::string& text)
+    {
+        std::filesystem::path path = std::filesystem::path(directory) / (FileName(name) + StageExtension(type));
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(text.data(), std::streamsize(text.size()));
+        if (!out) {
+            std::cout << "Shader export: cannot write " << path.string() << std::endl;
+            failed = true;
+            return;
+        }
+        ++stageCount;
+    }
+};
+
+#endif
@@ -0,0 +1,375 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Shader library
+* The one place shader programs are compiled, linked and deleted. Create
+* restores a program from the program cache or compiles its stages; when a
+* stage does not compile or the program does not link it prints the log and
+* deletes every object it created, so a failed program leaves nothing behind
+*
+* Every program is reflected once with glGetProgramResource*: its active
+* uniforms, uniform blocks and vertex inputs go into hash maps, so a location
+* is a map lookup instead of a driver query each time it is set. A uniform
+* name the reflection does not list, e.g. element 2 of an array listed as
+* name[0], is asked from the driver once and remembered
+*
+* Programs linked elsewhere, e.g. by the shader reloader, are reflected the
+* first time they are looked up. Delete every program through Destroy, so a
+* program name the driver hands out again never finds the reflection of the
+* program it used to name; Serial tells a reflection apart from the one of an
+* earlier program with the same name
+*
+* SamplerUnit gives the sampler uniforms of a program fixed texture units and
+* sets them once, so callers such as Mesh::Draw only bind textures
+*/
+
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "programcache.h"
+
+// One stage of a program, its sources concatenated like glShaderSource; the first one holds the #version line
+struct ShaderStage {
+    GLenum type;
+    std::vector<const char*> sources;
+};
+
+struct ShaderUniform {
+    GLint location;   // -1 for members of a uniform block
+    GLenum type;      // e.g. GL_FLOAT_VEC3, GL_NONE for names only the driver was asked about
+    GLint arraySize;  // 1 for a single value
+    GLint blockIndex; // uniform block it is a member of, -1 in the default block
+};
+
+struct ShaderUniformBlock {
+    GLuint index;
+    GLint binding;  // buffer binding point, set with glUniformBlockBinding or layout(binding)
+    GLint dataSize; // bytes the bound buffer range must hold
+};
+
+struct ShaderAttribute {
+    GLint location; // -1 for built in inputs such as gl_VertexID
+    GLenum type;
+    GLint arraySize;
+};
+
+// Active resources of one linked program
+class ProgramReflection
+{
+public:
+    // The map keys point into names, so a reflection stays where it was created
+    ProgramReflection() = default;
+    ProgramReflection(const ProgramReflection&) = delete;
+    ProgramReflection& operator=(const ProgramReflection&) = delete;
+
+    // Reads the resources of a linked program, replacing whatever was reflected before
+    void Reflect(GLuint programId)
+    {
+        program = programId;
+        serial = ++reflectionCount;
+        uniforms.clear();
+        uniformBlocks.clear();
+        attributes.clear();
+        samplerUnits.clear();
+        nextSamplerUnit = 0;
+        names.clear();
+
+        std::vector<char> name(NameLength(GL_UNIFORM));
+        for (GLint i = 0, count = ResourceCount(GL_UNIFORM); i < count; ++i) {
+            const GLenum properties[] = { GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+            GLint values[4] = { -1, GL_NONE, 1, -1 };
+            glGetProgramResourceiv(program, GL_UNIFORM, GLuint(i), 4, properties, 4, nullptr, values);
+            glGetProgramResourceName(program, GL_UNIFORM, GLuint(i), GLsizei(name.size()), nullptr, name.data());
+            Add(uniforms, name.data(), ShaderUniform{ values[0], GLenum(values[1]), values[2], values[3] });
+        }
+
+        name.assign(NameLength(GL_UNIFORM_BLOCK), '\0');
+        for (GLint i = 0, count = ResourceCount(GL_UNIFORM_BLOCK); i < count; ++i) {
+            const GLenum properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+            GLint values[2] = {};
+            glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, GLuint(i), 2, properties, 2, nullptr, values);
+            glGetProgramResourceName(program, GL_UNIFORM_BLOCK, GLuint(i), GLsizei(name.size()), nullptr, name.data());
+            Add(uniformBlocks, name.data(), ShaderUniformBlock{ GLuint(i), values[0], values[1] });
+        }
+
+        name.assign(NameLength(GL_PROGRAM_INPUT), '\0');
+        for (GLint i = 0, count = ResourceCount(GL_PROGRAM_INPUT); i < count; ++i) {
+            const GLenum properties[] = { GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+            GLint values[3] = { -1, GL_NONE, 1 };
+            glGetProgramResourceiv(program, GL_PROGRAM_INPUT, GLuint(i), 3, properties, 3, nullptr, values);
+            glGetProgramResourceName(program, GL_PROGRAM_INPUT, GLuint(i), GLsizei(name.size()), nullptr, name.data());
+            Add(attributes, name.data(), ShaderAttribute{ values[0], GLenum(values[1]), values[2] });
+        }
+    }
+
+    // Location of a uniform in the default block, -1 when it is not active
+    GLint Uniform(const char* name)
+    {
+        auto found = uniforms.find(std::string_view(name));
+        if (found != uniforms.end())
+            return found->second.location;
+
+        // Not listed by name, e.g. an array element past [0]; the answer, -1 included, is kept
+        GLint location = glGetUniformLocation(program, name);
+        Add(uniforms, name, ShaderUniform{ location, GL_NONE, 1, -1 });
+        return location;
+    }
+
+    /*
+    * Texture unit of a sampler uniform, numbered 0, 1, 2... in the order the samplers are first asked for
+    * The program's sampler is set to the unit with glProgramUniform1i on that first call only
+    * @return -1 when the sampler is not active
+    */
+    GLint SamplerUnit(const char* name)
+    {
+        auto found = samplerUnits.find(std::string_view(name));
+        if (found != samplerUnits.end())
+            return found->second;
+
+        GLint location = Uniform(name);
+        GLint unit = location >= 0 ? nextSamplerUnit++ : -1;
+        if (unit >= 0)
+            glProgramUniform1i(program, location, unit);
+        names.emplace_back(name);
+        samplerUnits.emplace(std::string_view(names.back()), unit);
+        return unit;
+    }
+
+    // Unique for every Reflect call, changes when a program name is reused by a new program
+    uint64_t Serial() const { return serial; }
+
+    // Index of a uniform block, GL_INVALID_INDEX when it is not active
+    GLuint UniformBlock(const char* name) const
+    {
+        auto found = uniformBlocks.find(std::string_view(name));
+        return found != uniformBlocks.end() ? found->second.index : GL_INVALID_INDEX;
+    }
+
+    // Location of a vertex input, -1 when it is not active
+    GLint Attribute(const char* name) const
+    {
+        auto found = attributes.find(std::string_view(name));
+        return found != attributes.end() ? found->second.location : -1;
+    }
+
+    // The reflected resources, null when not active
+    const ShaderUniform* FindUniform(const char* name) const { return Find(uniforms, name); }
+    const ShaderUniformBlock* FindUniformBlock(const char* name) const { return Find(uniformBlocks, name); }
+    const ShaderAttribute* FindAttribute(const char* name) const { return Find(attributes, name); }
+
+    size_t UniformCount() const { return uniforms.size(); }
+    size_t UniformBlockCount() const { return uniformBlocks.size(); }
+    size_t AttributeCount() const { return attributes.size(); }
+
+private:
+    static inline uint64_t reflectionCount = 0;
+
+    GLuint program = 0;
+    uint64_t serial = 0;
+    std::deque<std::string> names; // owns the map keys, a deque never moves its elements
+    std::unordered_map<std::string_view, ShaderUniform> uniforms;
+    std::unordered_map<std::string_view, ShaderUniformBlock> uniformBlocks;
+    std::unordered_map<std::string_view, ShaderAttribute> attributes;
+    std::unordered_map<std::string_view, GLint> samplerUnits; // -1 for samplers that are not active
+    GLint nextSamplerUnit = 0;
+
+    GLint ResourceCount(GLenum programInterface) const
+    {
+        GLint count = 0;
+        glGetProgramInterfaceiv(program, programInterface, GL_ACTIVE_RESOURCES, &count);
+        return count;
+    }
+
+    size_t NameLength(GLenum programInterface) const
+    {
+        GLint length = 0;
+        glGetProgramInterfaceiv(program, programInterface, GL_MAX_NAME_LENGTH, &length);
+        return size_t(std::max(length, 1));
+    }
+
+    // Adds a resource by name, an array listed as name[0] is found by its plain name too
+    template <typename T>
+    void Add(std::unordered_map<std::string_view, T>& map, const char* name, const T& resource)
+    {
+        names.emplace_back(name);
+        const std::string& key = names.back();
+        map[key] = resource;
+
+        size_t length = key.size();
+        if (length > 3 && key.compare(length - 3, 3, "[0]") == 0)
+            map.emplace(std::string_view(key.data(), length - 3), resource);
+    }
+
+    template <typename T>
+    static const T* Find(const std::unordered_map<std::string_view, T>& map, const char* name)
+    {
+        auto found = map.find(std::string_view(name));
+        return found != map.end() ? &found->second : nullptr;
+    }
+};
+
+class ShaderLibrary
+{
+public:
+    // Process wide library shared by Source.cpp, shader.cpp and the subsystems that set uniforms
+    static ShaderLibrary& Get()
+    {
+        static ShaderLibrary library;
+        return library;
+    }
+
+    /*
+    * Creates a program from its stages, restored from the program cache when it holds the binary
+    * @params name: shown in the error messages, e.g. "Tessellation", may be empty
+    *         stages: every stage of the program
+    *         programId: receives the linked program, untouched on failure
+    * @return false if a stage did not compile or the program did not link, nothing is left allocated then
+    */
+    bool Create(const char* name, const std::vector<ShaderStage>& stages, GLuint& programId)
+    {
+        ProgramCacheKey cacheKey;
+        for (const ShaderStage& stage : stages)
+            cacheKey.AddStage(stage.type, stage.sources.data(), int(stage.sources.size()));
+        GLuint program = 0;
+        if (ProgramCache::Load(cacheKey, program)) {
+            programs[program].Reflect(program);
+            programId = program;
+            return true;
+        }
+
+        std::vector<GLuint> shaders;
+        bool compiled = true;
+        for (const ShaderStage& stage : stages) {
+            GLuint shader = glCreateShader(stage.type);
+            shaders.push_back(shader);
+            glShaderSource(shader, GLsizei(stage.sources.size()), stage.sources.data(), nullptr);
+            glCompileShader(shader);
+
+            GLint success = GL_FALSE;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success) {
+                std::cout << StageName(stage.type) << " shader compilation failed" << (*name ? std::string(" (") + name + ")" : std::string())
+                    << ":\n" << Log(shader, true) << std::endl;
+                compiled = false;
+                break;
+            }
+        }
+
+        if (compiled) {
+            program = glCreateProgram();
+            for (GLuint shader : shaders)
+                glAttachShader(program, shader);
+            ProgramCache::PrepareLink(program);
+            glLinkProgram(program);
+            for (GLuint shader : shaders)
+                glDetachShader(program, shader);
+        }
+
+        // The program keeps what it linked, the shader objects are not needed either way
+        for (GLuint shader : shaders)
+            glDeleteShader(shader);
+        if (!compiled)
+            return false;
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::cout << (*name ? std::string(name) + " shader program" : std::string("Shader program")) << " linking failed:\n" << Log(program, false) << std::endl;
+            glDeleteProgram(program);
+            return false;
+        }
+
+        ProgramCache::Store(cacheKey, program);
+        programs[program].Reflect(program);
+        programId = program;
+        return true;
+    }
+
+    // Deletes a program and forgets its reflection, 0 is ignored
+    void Destroy(GLuint programId)
+    {
+        if (!programId)
+            return;
+        programs.erase(programId);
+        if (lastProgram == programId) {
+            lastProgram = 0;
+            last = nullptr;
+        }
+        glDeleteProgram(programId);
+    }
+
+    // Reflection of a program, read on the first call for programs linked outside Create
+    ProgramReflection& Reflection(GLuint programId)
+    {
+        // Draws usually look up several names of the same program in a row
+        if (last && lastProgram == programId)
+            return *last;
+
+        auto found = programs.find(programId);
+        if (found == programs.end()) {
+            found = programs.try_emplace(programId).first;
+            found->second.Reflect(programId);
+        }
+        lastProgram = programId;
+        last = &found->second;
+        return *last;
+    }
+
+    GLint Uniform(GLuint programId, const char* name) { return Reflection(programId).Uniform(name); }
+    GLuint UniformBlock(GLuint programId, const char* name) { return Reflection(programId).UniformBlock(name); }
+    GLint Attribute(GLuint programId, const char* name) { return Reflection(programId).Attribute(name); }
+
+    size_t ProgramCount() const { return programs.size(); }
+
+    // Info log of a shader or program object, empty when the driver wrote none
+    static std::string Log(GLuint object, bool shader)
+    {
+        GLint length = 0;
+        if (shader)
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        else
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        if (length <= 1)
+            return std::string();
+
+        std::string log(size_t(length), '\0');
+        if (shader)
+            glGetShaderInfoLog(object, length, nullptr, &log[0]);
+        else
+            glGetProgramInfoLog(object, length, nullptr, &log[0]);
+        log.resize(strlen(log.c_str()));
+        return log;
+    }
+
+    // Readable stage name for messages, e.g. "Vertex"
+    static const char* StageName(GLenum type)
+    {
+        switch (type) {
+        case GL_VERTEX_SHADER: return "Vertex";
+        case GL_TESS_CONTROL_SHADER: return "Tessellation control";
+        case GL_TESS_EVALUATION_SHADER: return "Tessellation evaluation";
+        case GL_GEOMETRY_SHADER: return "Geometry";
+        case GL_FRAGMENT_SHADER: return "Fragment";
+        case GL_COMPUTE_SHADER: return "Compute";
+        default: return "Unknown";
+        }
+    }
+
+private:
+    std::unordered_map<GLuint, ProgramReflection> programs; // elements never move, last stays valid until erased
+    GLuint lastProgram = 0;
+    ProgramReflection* last = nullptr;
+};
+
+#endif
@@ -0,0 +1,493 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Shader hot reload
+* Watches the shaderfiles directory and recompiles the programs whose sources
+* changed while the scene keeps running. Every stage of a watched program
+* names a file there, e.g. object.frag, which replaces the stage's inline
+* GLSL() source while it exists; deleting it goes back to the inline source.
+* The files are complete GLSL sources with their own #version line. A shader
+* variant watches the same files as its siblings with its own defines, which
+* are inserted after the #version line of the file as they are inline
+*
+* Compiling never blocks the render loop: with KHR_parallel_shader_compile
+* the driver compiles on its own threads and Update polls for completion,
+* otherwise a worker thread compiles in a hidden window sharing the render
+* context. The running program is only replaced once the new one linked, so
+* a typo prints its error and leaves the last good program on screen
+*
+* Changes are read from inotify on Linux and by comparing file times
+* elsewhere
+*/
+
+#ifndef SHADERRELOADER_H
+#define SHADERRELOADER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "glextensions.h"
+#include "programcache.h"
+#include "shaderlibrary.h"
+#include "shadervariants.h"
+
+const char* const SHADER_RELOAD_DIR = "shaderfiles";
+
+// One piece of a stage's source: a file in the watched directory and the inline source it replaces
+struct ShaderSourceFile {
+    const char* file;   // name inside the watched directory, e.g. "object.frag"
+    const char* source; // compiled while the file does not exist
+};
+
+// One stage of a reloadable program, its pieces concatenated in order like glShaderSource
+struct ReloadableStage {
+    GLenum type;
+    std::vector<ShaderSourceFile> parts;
+    std::string defines = ""; // inserted after the #version line of the first part, e.g. ShaderVariants::Defines
+};
+
+// Called on the GL thread with the new program before the old one is deleted
+typedef std::function<void(GLuint programId)> ProgramSwappedFunction;
+
+class ShaderReloader
+{
+public:
+    static constexpr int POLL_MILLISECONDS = 500; // how often file times are compared without inotify
+
+    ShaderReloader() = default;
+    ShaderReloader(const ShaderReloader&) = delete;
+    ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+    ~ShaderReloader()
+    {
+        Stop();
+    }
+
+    /*
+    * Starts watching directory, call once on the GL thread
+    * @params window: the render window, shared by the compile context when the driver cannot compile in parallel
+    * @return false if the directory does not exist
+    */
+    bool Start(const std::string& dir, GLFWwindow* window)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_directory(dir, error)) {
+            std::cout << "Shader hot reload: " << dir << " is not a directory" << std::endl;
+            return false;
+        }
+        directory = dir;
+
+#ifdef __linux__
+        notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify >= 0 && inotify_add_watch(notify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+            close(notify);
+            notify = -1;
+        }
+#endif
+
+        // Let the driver use as many compiler threads as it likes
+        if (HasGLExtension("GL_KHR_parallel_shader_compile") || HasGLExtension("GL_ARB_parallel_shader_compile")) {
+            typedef void (APIENTRYP MaxCompilerThreadsProc)(GLuint count);
+            MaxCompilerThreadsProc maxCompilerThreads = reinterpret_cast<MaxCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+            if (!maxCompilerThreads)
+                maxCompilerThreads = reinterpret_cast<MaxCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+            if (maxCompilerThreads) {
+                maxCompilerThreads(0xFFFFFFFF);
+                mode = PARALLEL;
+            }
+        }
+
+        // Otherwise compile in a hidden context sharing the render context's objects, it must match its version
+        if (mode != PARALLEL) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            compileWindow = glfwCreateWindow(1, 1, "shader compiler", nullptr, window);
+            glfwDefaultWindowHints();
+            if (compileWindow) {
+                mode = SHARED_CONTEXT;
+                stopping = false;
+                worker = std::thread(&ShaderReloader::Work, this);
+            }
+            else {
+                mode = SYNCHRONOUS;
+                std::cout << "Shader hot reload: no parallel compile or shared context, reloads will stall a frame" << std::endl;
+            }
+        }
+
+        const char* modeNames[] = { "driver threads", "shared context", "render thread" };
+        std::cout << "Shader hot reload: watching " << directory << (notify >= 0 ? " with inotify" : "")
+            << ", compiling on " << modeNames[mode] << std::endl;
+        started = true;
+        return true;
+    }
+
+    /*
+    * Stops watching and drops the programs still compiling, call on the GL thread before the context goes away
+    * The programs already swapped in are left to their owners
+    */
+    void Stop()
+    {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            worker.join();
+        }
+        for (Watched& watched : programs) {
+            if (watched.compile)
+                Discard(*watched.compile);
+            watched.compile.reset();
+        }
+        programs.clear();
+        if (compileWindow)
+            glfwDestroyWindow(compileWindow);
+        compileWindow = nullptr;
+        queued.clear();
+#ifdef __linux__
+        if (notify >= 0)
+            close(notify);
+#endif
+        notify = -1;
+        started = false;
+    }
+
+    /*
+    * Reloads program whenever one of its stage files changes
+    * A program whose files already exist is reloaded from them on the next Update
+    * @params name: shown in the messages
+    *         program: the caller's program variable, replaced on every successful reload
+    *         stages: every stage of the program with its files
+    *         swapped: restores the state the caller keeps in the program, e.g. sampler units, may be empty
+    */
+    void Watch(const std::string& name, GLuint* program, const std::vector<ReloadableStage>& stages, ProgramSwappedFunction swapped = nullptr)
+    {
+        if (!started)
+            return;
+
+        Watched watched;
+        watched.name = name;
+        watched.program = program;
+        watched.stages = stages;
+        watched.swapped = swapped;
+        for (const ReloadableStage& stage : stages) {
+            for (const ShaderSourceFile& part : stage.parts) {
+                std::error_code error;
+                std::filesystem::path path = Path(part.file);
+                bool exists = std::filesystem::exists(path, error);
+                watched.dirty = watched.dirty || exists;
+                fileTimes[part.file] = exists ? std::filesystem::last_write_time(path, error) : std::filesystem::file_time_type::min();
+            }
+        }
+        programs.push_back(std::move(watched));
+    }
+
+    /*
+    * Starts compiling the programs whose files changed and swaps in the ones that finished linking
+    * Call once per frame on the GL thread, outside of any draw that uses the watched programs
+    */
+    void Update()
+    {
+        if (!started)
+            return;
+
+        std::set<std::string> changed;
+        ReadChanges(changed);
+        for (Watched& watched : programs) {
+            for (const ReloadableStage& stage : watched.stages) {
+                for (const ShaderSourceFile& part : stage.parts)
+                    watched.dirty = watched.dirty || changed.count(part.file) > 0;
+            }
+        }
+
+        for (Watched& watched : programs) {
+            if (watched.compile && Finished(*watched.compile)) {
+                // A file saved again while compiling makes this result stale, the next one replaces it
+                std::shared_ptr<Compile> compile = std::move(watched.compile);
+                if (watched.dirty)
+                    Discard(*compile);
+                else
+                    Complete(watched, *compile);
+            }
+            if (watched.dirty && !watched.compile)
+                Begin(watched);
+        }
+    }
+
+    /*
+    * The sources of one stage as they are compiled: each part's file in dir, or its inline source
+    * while the file does not exist, with the stage's defines inserted into the first part
+    * Needs no GL context, ShaderExport reads the stages with it too
+    */
+    static std::vector<std::string> ReadStage(const std::string& dir, const ReloadableStage& stage)
+    {
+        std::vector<std::string> sources;
+        for (const ShaderSourceFile& part : stage.parts) {
+            std::ifstream in(std::filesystem::path(dir) / part.file, std::ios::binary);
+            if (in) {
+                std::stringstream text;
+                text << in.rdbuf();
+                sources.push_back(text.str());
+            }
+            else {
+                sources.push_back(part.source);
+            }
+        }
+        if (!stage.defines.empty() && !sources.empty())
+            sources[0] = InsertShaderDefines(sources[0], stage.defines);
+        return sources;
+    }
+
+private:
+    enum Mode { PARALLEL, SHARED_CONTEXT, SYNCHRONOUS };
+
+    // One program being compiled
+    struct Compile {
+        std::vector<GLenum> types;
+        std::vector<std::vector<std::string>> sources; // per stage, kept alive for the worker
+        std::vector<GLuint> shaders;
+        GLuint program = 0;
+        GLsync fence = nullptr;  // shared context: signals once the worker's link finished
+        bool submitted = false;  // shared context: the worker issued every call, fence is set
+        ProgramCacheKey key;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct Watched {
+        std::string name;
+        GLuint* program = nullptr;
+        std::vector<ReloadableStage> stages;
+        ProgramSwappedFunction swapped;
+        bool dirty = false;               // a file changed since the running compile started
+        std::shared_ptr<Compile> compile; // running compile, null while idle
+    };
+
+    std::string directory;
+    std::vector<Watched> programs;
+    Mode mode = SYNCHRONOUS;
+    bool started = false;
+    int notify = -1; // inotify descriptor, -1 when file times are polled
+    std::map<std::string, std::filesystem::file_time_type> fileTimes; // polled files, min() while missing
+    std::chrono::steady_clock::time_point lastPoll;
+
+    GLFWwindow* compileWindow = nullptr;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Compile>> queued; // waiting for the worker
+    bool stopping = false;
+
+    std::filesystem::path Path(const char* file) const
+    {
+        return std::filesystem::path(directory) / file;
+    }
+
+    // Collects the watched file names that were written, moved or deleted since the last call
+    void ReadChanges(std::set<std::string>& changed)
+    {
+#ifdef __linux__
+        if (notify >= 0) {
+            alignas(inotify_event) char buffer[4096];
+            for (;;) {
+                ssize_t length = read(notify, buffer, sizeof(buffer));
+                if (length <= 0)
+                    break;
+                for (ssize_t offset = 0; offset < length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    if (event->len > 0 && fileTimes.count(event->name))
+                        changed.insert(event->name);
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+            return;
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll < std::chrono::milliseconds(POLL_MILLISECONDS))
+            return;
+        lastPoll = now;
+        for (auto& file : fileTimes) {
+            std::error_code error;
+            std::filesystem::path path = Path(file.first.c_str());
+            auto time = std::filesystem::exists(path, error) ? std::filesystem::last_write_time(path, error) : std::filesystem::file_time_type::min();
+            if (time != file.second) {
+                file.second = time;
+                changed.insert(file.first);
+            }
+        }
+    }
+
+    // Reads every stage's files, falling back to the inline sources, and starts compiling them
+    void Begin(Watched& watched)
+    {
+        watched.dirty = false;
+        std::shared_ptr<Compile> compile = std::make_shared<Compile>();
+        compile->start = std::chrono::steady_clock::now();
+        for (const ReloadableStage& stage : watched.stages) {
+            std::vector<std::string> sources = ReadStage(directory, stage);
+            std::vector<const char*> pointers;
+            for (const std::string& source : sources)
+                pointers.push_back(source.c_str());
+            compile->key.AddStage(stage.type, pointers.data(), int(pointers.size()));
+            compile->types.push_back(stage.type);
+            compile->sources.push_back(std::move(sources));
+        }
+
+        // Going back to a version that was compiled before is only a cache lookup
+        GLuint cached = 0;
+        if (ProgramCache::Load(compile->key, cached)) {
+            Swap(watched, cached, *compile);
+            return;
+        }
+
+        if (mode == SHARED_CONTEXT) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued.push_back(compile);
+            }
+            wake.notify_one();
+        }
+        else {
+            Submit(*compile);
+        }
+        watched.compile = compile;
+    }
+
+    // Issues the compile and link calls, on the GL thread or on the worker in its shared context
+    static void Submit(Compile& compile)
+    {
+        compile.program = glCreateProgram();
+        for (size_t i = 0; i < compile.types.size(); ++i) {
+            std::vector<const char*> pointers;
+            for (const std::string& source : compile.sources[i])
+                pointers.push_back(source.c_str());
+            GLuint shader = glCreateShader(compile.types[i]);
+            glShaderSource(shader, GLsizei(pointers.size()), pointers.data(), nullptr);
+            glCompileShader(shader);
+            glAttachShader(compile.program, shader);
+            compile.shaders.push_back(shader);
+        }
+        ProgramCache::PrepareLink(compile.program);
+        glLinkProgram(compile.program);
+    }
+
+    void Work()
+    {
+        glfwMakeContextCurrent(compileWindow);
+        for (;;) {
+            std::shared_ptr<Compile> compile;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queued.empty(); });
+                if (stopping)
+                    break;
+                compile = queued.front();
+                queued.pop_front();
+            }
+
+            Submit(*compile);
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            compile->fence = fence;
+            compile->submitted = true;
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    // Checks without waiting whether a compile can be completed
+    bool Finished(Compile& compile)
+    {
+        if (mode == PARALLEL) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(compile.program, GL_COMPLETION_STATUS_KHR, &done);
+            return done != GL_FALSE;
+        }
+        if (mode == SHARED_CONTEXT) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!compile.submitted)
+                return false;
+            GLenum status = glClientWaitSync(compile.fence, 0, 0);
+            return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+        }
+        return true;
+    }
+
+    // Swaps in a program that linked, or prints why it did not and keeps the running one
+    void Complete(Watched& watched, Compile& compile)
+    {
+        GLint success = GL_FALSE;
+        glGetProgramiv(compile.program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::cout << "Shader hot reload: " << watched.name << " failed, keeping the running program" << std::endl;
+            for (size_t i = 0; i < compile.shaders.size(); ++i) {
+                GLint compiled = GL_FALSE;
+                glGetShaderiv(compile.shaders[i], GL_COMPILE_STATUS, &compiled);
+                if (!compiled)
+                    std::cout << ShaderLibrary::Log(compile.shaders[i], true);
+            }
+            std::cout << ShaderLibrary::Log(compile.program, false) << std::endl;
+            Discard(compile);
+            return;
+        }
+
+        GLuint program = compile.program;
+        compile.program = 0;
+        ProgramCache::Store(compile.key, program);
+        Discard(compile);
+        Swap(watched, program, compile);
+    }
+
+    void Swap(Watched& watched, GLuint program, const Compile& compile)
+    {
+        GLuint previous = *watched.program;
+        *watched.program = program;
+        if (watched.swapped)
+            watched.swapped(program);
+        ShaderLibrary::Get().Destroy(previous);
+
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compile.start).count();
+        std::cout << "Shader hot reload: " << watched.name << " reloaded in " << milliseconds << " ms" << std::endl;
+    }
+
+    // Deletes what is left of a compile, the program too unless it was swapped in
+    static void Discard(Compile& compile)
+    {
+        for (GLuint shader : compile.shaders)
+            glDeleteShader(shader);
+        compile.shaders.clear();
+        if (compile.program)
+            ShaderLibrary::Get().Destroy(compile.program);
+        compile.program = 0;
+        if (compile.fence)
+            glDeleteSync(compile.fence);
+        compile.fence = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Shader variants
+* Builds the programs of one vertex/fragment source pair for every feature
+* combination a material asks for. Each variant gets #define lines after the
+* source's #version line, one per feature set to 0 or 1, and LIGHT_COUNT,
+* followed by a library source both stages share.
+* The GLSL() sources are a single line, so they cannot hold #if blocks;
+* instead they turn the defines into constants, e.g.
+*   const bool textured = TEXTURED != 0;
+* and branch on those, which the GLSL compiler folds away. A variant only
+* pays for the features it has
+*
+* Variants are compiled the first time they are asked for and kept until
+* Destroy, and the program cache keeps their binaries across launches
+*
+* Lighting tiers trade lighting quality for fragment cost: the phong tier is
+* the reference per fragment Phong loop, blinn lights per fragment with
+* Blinn-Phong and the per light invariants hoisted out of the loop, and low
+* lights per vertex at half precision. A tier is a set of features added to
+* every lit variant, so switching tiers only picks other variants
+*/
+
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <glad/glad.h>
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "shaderlibrary.h"
+
+// Features of a scene shader variant, each one is defined as 0 or 1 under the name in SHADER_FEATURE_NAMES
+enum ShaderFeature : uint32_t {
+    SHADER_TEXTURED = 1u << 0,        // samples uTexture, otherwise the surface is baseColor
+    SHADER_SPECULAR = 1u << 1,        // adds the specular highlight of every light
+    SHADER_VIRTUAL_TEXTURE = 1u << 2, // samples through the virtual texture page table instead of uTexture
+    SHADER_BLINN_PHONG = 1u << 3,     // Blinn-Phong with the per light invariants hoisted, otherwise Phong
+    SHADER_VERTEX_LIGHTING = 1u << 4, // lights once per vertex, the fragments interpolate the result
+    SHADER_HALF_PRECISION = 1u << 5,  // declares floats mediump, honored by drivers with half precision ALUs
+};
+
+const char* const SHADER_FEATURE_NAMES[] = { "TEXTURED", "SPECULAR", "VIRTUAL_TEXTURE", "BLINN_PHONG", "VERTEX_LIGHTING", "HALF_PRECISION" };
+const int SHADER_FEATURE_COUNT = int(sizeof(SHADER_FEATURE_NAMES) / sizeof(SHADER_FEATURE_NAMES[0]));
+
+// Features that depend on a surface's material, the others come from the lighting tier
+const uint32_t SHADER_MATERIAL_FEATURES = SHADER_TEXTURED | SHADER_SPECULAR | SHADER_VIRTUAL_TEXTURE;
+
+struct LightingTier {
+    const char* name;
+    uint32_t features; // added to every lit variant
+};
+
+const LightingTier LIGHTING_TIERS[] = {
+    { "phong", 0 },
+    { "blinn", SHADER_BLINN_PHONG },
+    { "low", SHADER_BLINN_PHONG | SHADER_VERTEX_LIGHTING | SHADER_HALF_PRECISION }
+};
+const int LIGHTING_TIER_COUNT = int(sizeof(LIGHTING_TIERS) / sizeof(LIGHTING_TIERS[0]));
+const int DEFAULT_LIGHTING_TIER = 0; // phong
+
+// Index of the lighting tier called name, -1 if there is none
+inline int FindLightingTier(const std::string& name)
+{
+    for (int i = 0; i < LIGHTING_TIER_COUNT; ++i) {
+        if (name == LIGHTING_TIERS[i].name)
+            return i;
+    }
+    return -1;
+}
+
+// One compiled variant
+struct ShaderVariant {
+    GLuint program = 0;            // 0 when the variant failed to compile
+    unsigned int frame = UINT_MAX; // frame its per frame uniforms were last set in, kept by the caller
+};
+
+// Compiles and links a vertex/fragment source pair, e.g. CreateShaders through the shader library
+typedef bool (*CompileProgramFunction)(const char* vertexSource, const char* fragmentSource, GLuint& programId);
+
+// Called once for every variant that compiled, e.g. to set its sampler units
+typedef std::function<void(ShaderVariant& variant, const std::string& name, const std::string& header)> VariantCreatedFunction;
+
+/*
+* Inserts lines after the #version line of a GLSL source
+* A source without a version line gets them at the start
+*/
+inline std::string InsertShaderDefines(const std::string& source, const std::string& defines)
+{
+    size_t lineEnd = source.find('\n');
+    if (source.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos)
+        return defines + source;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+class ShaderVariants
+{
+public:
+    /*
+    * Sets the sources every variant is built from, call once before Get
+    * @params compile: builds one variant's program
+    *         library: GLSL_LIBRARY source both stages get after their defines, e.g. functions the stages share
+    */
+    void Create(const char* vertex, const char* fragment, CompileProgramFunction compile, const char* library = "")
+    {
+        vertexSource = vertex;
+        fragmentSource = fragment;
+        compileProgram = compile;
+        librarySource = library;
+    }
+
+    // Called for every variant compiled from now on
+    void SetCreated(VariantCreatedFunction function) { created = function; }
+
+    /*
+    * The variant for a feature set, compiled on the first call
+    * @params features: ShaderFeature flags
+    *         lightCount: point lights the variant shades with, 0 shows the surface color unlit
+    * @return null if the variant does not compile, it is not retried
+    */
+    ShaderVariant* Get(uint32_t features, int lightCount)
+    {
+        uint64_t key = (uint64_t(uint32_t(lightCount)) << 32) | features;
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return found->second.program ? &found->second : nullptr;
+
+        ShaderVariant& variant = variants[key];
+        std::string header = Header(features, lightCount);
+        std::string vertex = InsertShaderDefines(vertexSource, header);
+        std::string fragment = InsertShaderDefines(fragmentSource, header);
+        if (!compileProgram(vertex.c_str(), fragment.c_str(), variant.program)) {
+            std::cout << "Shader variant " << Name(features, lightCount) << " failed to compile" << std::endl;
+            variant.program = 0;
+            return nullptr;
+        }
+        if (created)
+            created(variant, Name(features, lightCount), header);
+        return &variant;
+    }
+
+    // Calls function with every variant that compiled, with the name and Header it was created with
+    void ForEach(const VariantCreatedFunction& function)
+    {
+        for (auto& entry : variants) {
+            if (!entry.second.program)
+                continue;
+            uint32_t features = uint32_t(entry.first);
+            int lightCount = int(entry.first >> 32);
+            function(entry.second, Name(features, lightCount), Header(features, lightCount));
+        }
+    }
+
+    size_t Count() const { return variants.size(); }
+
+    // Deletes every variant's program, call on the GL thread before the context goes away
+    void Destroy()
+    {
+        for (auto& entry : variants)
+            ShaderLibrary::Get().Destroy(entry.second.program);
+        variants.clear();
+    }
+
+    // The #define lines of a variant
+    static std::string Defines(uint32_t features, int lightCount)
+    {
+        std::string defines;
+        for (int i = 0; i < SHADER_FEATURE_COUNT; ++i)
+            defines += std::string("#define ") + SHADER_FEATURE_NAMES[i] + ((features & (1u << i)) ? " 1\n" : " 0\n");
+        defines += "#define LIGHT_COUNT " + std::to_string(lightCount) + "\n";
+
+        // Desktop GL accepts precision qualifiers for portability, drivers without half precision ignore them
+        if (features & SHADER_HALF_PRECISION)
+            defines += "precision mediump float;\n";
+        return defines;
+    }
+
+    // Everything inserted after the #version line of both stages: the defines, then the library
+    std::string Header(uint32_t features, int lightCount) const
+    {
+        return Defines(features, lightCount) + librarySource + "\n";
+    }
+
+    // Readable name of a variant for messages, e.g. "TEXTURED+SPECULAR, 3 lights"
+    static std::string Name(uint32_t features, int lightCount)
+    {
+        std::string name;
+        for (int i = 0; i < SHADER_FEATURE_COUNT; ++i) {
+            if (features & (1u << i))
+                name += (name.empty() ? "" : "+") + std::string(SHADER_FEATURE_NAMES[i]);
+        }
+        return (name.empty() ? "UNTEXTURED" : name) + ", " + std::to_string(lightCount) + " lights";
+    }
+
+private:
+    const char* vertexSource = "";
+    const char* fragmentSource = "";
+    const char* librarySource = "";
+    CompileProgramFunction compileProgram = nullptr;
+    VariantCreatedFunction created;
+    std::unordered_map<uint64_t, ShaderVariant> variants; // by light count and features, elements never move
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Hardware tessellation of the parametric surfaces
+* A surface is stored as a coarse grid of quad patches whose control points
+* are only (u, v) coordinates. The tessellation evaluation shader maps every
+* generated point through the same functions as the compute shader, so the
+* surface stays exact no matter how finely it is split
+*
+* The control shader picks the levels from the projected length of each patch
+* edge, aiming for a fixed number of pixels per edge. Close objects get more
+* triangles and small ones fewer, so the triangle rate stays roughly constant
+* Both patches on an edge compute its level from the same two control points,
+* so neighbouring patches agree and no cracks open between them
+* The shader programs are created in Source.cpp next to the other shaders
+*/
+
+#ifndef TESSELLATION_H
+#define TESSELLATION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "gpusurface.h"
+#include "shaderlibrary.h"
+
+const GLint SURFACE_PATCH_VERTICES = 4;
+
+// Coarse patch grid of one surface, drawn with SurfaceTessellator::Draw
+struct SurfacePatches {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLsizei indexCount = 0;
+    GpuSurfaceKind kind = GPU_SURFACE_SPHERE;
+    glm::vec4 params = glm::vec4(0.0f);
+};
+
+/*
+* Builds a grid of uSegments by vSegments quad patches over the unit parameter square
+* Control points are ordered (u0, v0), (u1, v0), (u1, v1), (u0, v1)
+* @params kind, params: the surface, with the same meaning as for GpuSurfaceGenerator
+*/
+inline SurfacePatches CreateSurfacePatches(GpuSurfaceKind kind, const glm::vec4& params, int uSegments, int vSegments)
+{
+    std::vector<glm::vec2> coords;
+    coords.reserve(size_t(uSegments + 1) * size_t(vSegments + 1));
+    for (int j = 0; j <= vSegments; ++j) {
+        for (int i = 0; i <= uSegments; ++i)
+            coords.push_back(glm::vec2(float(i) / float(uSegments), float(j) / float(vSegments)));
+    }
+
+    std::vector<GLuint> indices;
+    indices.reserve(size_t(uSegments) * size_t(vSegments) * SURFACE_PATCH_VERTICES);
+    GLuint columns = GLuint(uSegments + 1);
+    for (int j = 0; j < vSegments; ++j) {
+        for (int i = 0; i < uSegments; ++i) {
+            GLuint a = GLuint(j) * columns + GLuint(i);
+            indices.push_back(a);
+            indices.push_back(a + 1);
+            indices.push_back(a + 1 + columns);
+            indices.push_back(a + columns);
+        }
+    }
+
+    SurfacePatches patches;
+    patches.kind = kind;
+    patches.params = params;
+    patches.indexCount = static_cast<GLsizei>(indices.size());
+
+    glGenVertexArrays(1, &patches.vao);
+    glBindVertexArray(patches.vao);
+
+    glGenBuffers(1, &patches.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, patches.vbo);
+    glBufferData(GL_ARRAY_BUFFER, coords.size() * sizeof(glm::vec2), coords.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+
+    glGenBuffers(1, &patches.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patches.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return patches;
+}
+
+// Deletes the buffers of patches made by CreateSurfacePatches and empties them, patches that were never created are left alone
+inline void DestroySurfacePatches(SurfacePatches& patches)
+{
+    glDeleteVertexArrays(1, &patches.vao);
+    glDeleteBuffers(1, &patches.vbo);
+    glDeleteBuffers(1, &patches.ebo);
+    patches = SurfacePatches();
+}
+
+class SurfaceTessellator
+{
+public:
+    // Uses the linked tessellation program for every later Draw call
+    void SetProgram(GLuint tessellationProgram)
+    {
+        program = tessellationProgram;
+        kindLoc = ShaderLibrary::Get().Uniform(program, "surfaceKind");
+        paramsLoc = ShaderLibrary::Get().Uniform(program, "surfaceParams");
+        viewportLoc = ShaderLibrary::Get().Uniform(program, "viewportSize");
+        pixelsPerEdgeLoc = ShaderLibrary::Get().Uniform(program, "pixelsPerEdge");
+        maxLevelLoc = ShaderLibrary::Get().Uniform(program, "maxTessLevel");
+
+        GLint maxLevel = 64;
+        glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+        maxTessLevel = float(maxLevel);
+    }
+
+    bool IsReady() const { return program != 0; }
+
+    GLuint Program() const { return program; }
+
+    /*
+    * Sets the per frame target density, the program must be in use
+    * @params width, height: framebuffer size in pixels
+    *         pixelsPerEdge: target on screen length of a generated edge
+    */
+    void SetTarget(int width, int height, float pixelsPerEdge) const
+    {
+        glUniform2f(viewportLoc, float(width), float(height));
+        glUniform1f(pixelsPerEdgeLoc, pixelsPerEdge);
+        glUniform1f(maxLevelLoc, maxTessLevel);
+    }
+
+    // Draws the patches with the bound program, model/view/projection must already be set
+    void Draw(const SurfacePatches& patches) const
+    {
+        glUniform1i(kindLoc, patches.kind);
+        glUniform4f(paramsLoc, patches.params.x, patches.params.y, patches.params.z, patches.params.w);
+        glPatchParameteri(GL_PATCH_VERTICES, SURFACE_PATCH_VERTICES);
+        glBindVertexArray(patches.vao);
+        glDrawElements(GL_PATCHES, patches.indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+private:
+    GLuint program = 0;
+    GLint kindLoc = -1;
+    GLint paramsLoc = -1;
+    GLint viewportLoc = -1;
+    GLint pixelsPerEdgeLoc = -1;
+    GLint maxLevelLoc = -1;
+    float maxTessLevel = 64.0f;
+};
+
+#endif
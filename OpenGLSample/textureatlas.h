@@ -0,0 +1,302 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Texture atlas
+* Packs several images into one texture so surfaces that used to need their
+* own texture bind can share one, and meshes address their image through a
+* region that maps their 0..1 texture coords into the atlas
+*
+* The layout only needs the image sizes, so it is planned (and mesh UVs
+* rewritten) before any pixels are decoded; the pixels are composed later on
+* the texture loader's worker threads
+*
+* Every image is surrounded by a gutter of repeated edge texels and starts on
+* a multiple of the gutter size. The mip filter of MipGenerator reads past a
+* texel's footprint, further with every level, so the atlas only has levels
+* up to MAX_MIP_LEVEL, the last one whose taps stay inside the gutter; the
+* alignment keeps the images on whole texels of those levels, and 4x4
+* compression blocks never straddle two images either
+*/
+
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mipgenerator.h"
+
+/*
+* Skyline bottom-left rectangle packer
+* The skyline is the top edge of everything placed so far; each rectangle goes
+* where it ends lowest, which keeps the wasted space under the skyline small
+*/
+class SkylinePacker
+{
+public:
+    SkylinePacker(int width, int height) : width(width), height(height)
+    {
+        skyline.push_back({ 0, 0, width });
+    }
+
+    // Finds room for a width x height rectangle, false when it does not fit
+    bool Insert(int rectWidth, int rectHeight, int& x, int& y)
+    {
+        int bestIndex = -1, bestTop = INT_MAX, bestWidth = INT_MAX;
+        for (size_t i = 0; i < skyline.size(); ++i) {
+            int top;
+            if (!Fits(i, rectWidth, rectHeight, top))
+                continue;
+            if (top + rectHeight < bestTop || (top + rectHeight == bestTop && skyline[i].width < bestWidth)) {
+                bestIndex = int(i);
+                bestTop = top + rectHeight;
+                bestWidth = skyline[i].width;
+                x = skyline[i].x;
+                y = top;
+            }
+        }
+        if (bestIndex < 0)
+            return false;
+
+        // Raise the skyline over the new rectangle and trim the segments it covers
+        skyline.insert(skyline.begin() + bestIndex, { x, y + rectHeight, rectWidth });
+        for (size_t i = size_t(bestIndex) + 1; i < skyline.size();) {
+            Segment& segment = skyline[i];
+            int covered = x + rectWidth - segment.x;
+            if (covered <= 0)
+                break;
+            if (covered < segment.width) {
+                segment.x += covered;
+                segment.width -= covered;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+
+        // Merge neighbours at the same height
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            }
+            else {
+                ++i;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Segment {
+        int x;
+        int y;
+        int width;
+    };
+
+    int width;
+    int height;
+    std::vector<Segment> skyline;
+
+    // Lowest position a rectangle starting at segment i can rest at
+    bool Fits(size_t i, int rectWidth, int rectHeight, int& top) const
+    {
+        if (skyline[i].x + rectWidth > width)
+            return false;
+        top = 0;
+        int remaining = rectWidth;
+        for (size_t j = i; remaining > 0; ++j) {
+            if (j == skyline.size())
+                return false;
+            top = std::max(top, skyline[j].y);
+            if (top + rectHeight > height)
+                return false;
+            remaining -= skyline[j].width;
+        }
+        return true;
+    }
+};
+
+// Maps a mesh's 0..1 texture coords into its image inside an atlas
+struct AtlasRegion {
+    glm::vec2 offset = glm::vec2(0.0f);
+    glm::vec2 scale = glm::vec2(1.0f);
+
+    glm::vec2 Map(const glm::vec2& uv) const { return offset + uv * scale; }
+};
+
+// One image placed in the atlas
+struct AtlasEntry {
+    std::string name; // key the meshes look the image up by
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int x = 0;        // image origin in the atlas, inside its gutter
+    int y = 0;
+};
+
+class TextureAtlas
+{
+public:
+    static const int GUTTER = 32;       // texels of repeated edge around every image, also the placement alignment
+    static const int MAX_MIP_LEVEL = 3; // the last level whose filter taps stay inside the gutter, see MipGenerator::Reach
+
+    static_assert(MipGenerator::Reach(MAX_MIP_LEVEL) <= GUTTER, "the atlas mip levels would bleed between images");
+    static_assert(GUTTER % (1 << MAX_MIP_LEVEL) == 0, "images must start on whole texels of every atlas mip level");
+
+    // Adds an image to the next Plan, width and height are its size in texels
+    void Add(const std::string& name, const std::string& path, int width, int height)
+    {
+        AtlasEntry entry;
+        entry.name = name;
+        entry.path = path;
+        entry.width = width;
+        entry.height = height;
+        entries.push_back(entry);
+        planned = false;
+    }
+
+    /*
+    * Packs the added images into the smallest power of two atlas that holds them
+    * @params maxSize: largest allowed width/height, usually GL_MAX_TEXTURE_SIZE
+    * @return false if they do not fit, the atlas is not used then
+    */
+    bool Plan(int maxSize)
+    {
+        planned = false;
+        if (entries.empty())
+            return false;
+
+        // Tallest first packs a skyline tightest
+        std::vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return entries[a].height != entries[b].height ? entries[a].height > entries[b].height : entries[a].width > entries[b].width;
+        });
+
+        // Grow the shorter side first, starting from the smallest square that could hold the total area
+        uint64_t area = 0;
+        for (const AtlasEntry& entry : entries)
+            area += uint64_t(Padded(entry.width)) * uint64_t(Padded(entry.height));
+        int w = GUTTER, h = GUTTER;
+        while (uint64_t(w) * uint64_t(h) < area) {
+            if (w <= h) w *= 2;
+            else h *= 2;
+        }
+
+        while (w <= maxSize && h <= maxSize) {
+            if (TryPack(order, w, h)) {
+                width = w;
+                height = h;
+                planned = true;
+                return true;
+            }
+            if (w <= h) w *= 2;
+            else h *= 2;
+        }
+        return false;
+    }
+
+    bool IsPlanned() const { return planned; }
+
+    int Width() const { return width; }
+
+    int Height() const { return height; }
+
+    const std::vector<AtlasEntry>& Entries() const { return entries; }
+
+    // Region of the named image, the whole texture when the atlas is not planned or has no such image
+    AtlasRegion Region(const std::string& name) const
+    {
+        AtlasRegion region;
+        if (!planned)
+            return region;
+        for (const AtlasEntry& entry : entries) {
+            if (entry.name == name) {
+                region.offset = glm::vec2(float(entry.x) / float(width), float(entry.y) / float(height));
+                region.scale = glm::vec2(float(entry.width) / float(width), float(entry.height) / float(height));
+                break;
+            }
+        }
+        return region;
+    }
+
+    // Hash of the layout, so cached atlas pixels are rebuilt when it changes
+    uint64_t LayoutHash() const
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+        auto add = [&hash](int value) {
+            for (size_t i = 0; i < sizeof(value); ++i) {
+                hash ^= (unsigned(value) >> (i * 8)) & 0xFF;
+                hash *= 1099511628211ull; // FNV-1a prime
+            }
+        };
+        add(width);
+        add(height);
+        add(GUTTER);
+        for (const AtlasEntry& entry : entries) {
+            add(entry.x);
+            add(entry.y);
+            add(entry.width);
+            add(entry.height);
+        }
+        return hash;
+    }
+
+    /*
+    * Copies an entry's RGBA pixels into the atlas and fills its gutter with repeated edge texels
+    * @params rgba: entry.width x entry.height texels, in the same row order as atlasPixels
+    *         atlasPixels: Width() x Height() RGBA texels
+    */
+    void Blit(const AtlasEntry& entry, const unsigned char* rgba, unsigned char* atlasPixels) const
+    {
+        int x0 = std::max(0, entry.x - GUTTER), x1 = std::min(width, entry.x + entry.width + GUTTER);
+        int y0 = std::max(0, entry.y - GUTTER), y1 = std::min(height, entry.y + entry.height + GUTTER);
+        size_t imageRow = size_t(entry.width) * 4;
+
+        for (int y = y0; y < y1; ++y) {
+            int sy = std::min(std::max(y - entry.y, 0), entry.height - 1);
+            const unsigned char* src = rgba + size_t(sy) * imageRow;
+            unsigned char* dst = atlasPixels + (size_t(y) * width) * 4;
+
+            for (int x = x0; x < entry.x; ++x)
+                memcpy(dst + size_t(x) * 4, src, 4);
+            memcpy(dst + size_t(entry.x) * 4, src, imageRow);
+            for (int x = entry.x + entry.width; x < x1; ++x)
+                memcpy(dst + size_t(x) * 4, src + imageRow - 4, 4);
+        }
+    }
+
+private:
+    std::vector<AtlasEntry> entries;
+    int width = 0;
+    int height = 0;
+    bool planned = false;
+
+    // Size of an image with its gutter on both sides, rounded up to the alignment
+    static int Padded(int size)
+    {
+        return (size + 2 * GUTTER + GUTTER - 1) / GUTTER * GUTTER;
+    }
+
+    bool TryPack(const std::vector<size_t>& order, int w, int h)
+    {
+        SkylinePacker packer(w, h);
+        for (size_t i : order) {
+            AtlasEntry& entry = entries[i];
+            int x, y;
+            if (!packer.Insert(Padded(entry.width), Padded(entry.height), x, y))
+                return false;
+            entry.x = x + GUTTER;
+            entry.y = y + GUTTER;
+        }
+        return true;
+    }
+};
+
+#endif
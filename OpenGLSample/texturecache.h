@@ -0,0 +1,441 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Compressed texture cache
+* The first launch transcodes every imported texture to BC1 (opaque) or BC3
+* (with alpha) with a full mip chain and writes it as a KTX2 file. Later
+* launches memory map the file and hand each level straight to
+* glCompressedTexImage2D, skipping the PNG decode, the import stage and
+* the mip filter, and the texture takes 1/8 or 1/4 of the RGBA8 memory
+*
+* KTX2 layout written here (Khronos KTX 2.0, no supercompression):
+*   identifier, header, level index
+*   data format descriptor (basic block for BC1/BC3)
+*   key/value data holding the cache key hash
+*   levels, smallest first, each aligned to its block size
+*
+* A cache file is named after its source image and the hash of the source
+* size, modification time and import options, so editing the PNG or changing
+* an option simply misses and writes a new file
+*/
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "bcencoder.h"
+#include "glextensions.h"
+#include "mappedfile.h"
+#include "mipgenerator.h"
+#include "textureimport.h"
+
+const char* const TEXTURE_CACHE_DIR = "texturecache";
+const uint32_t TEXTURE_CACHE_VERSION = 4; // bump when the encoder or mip filter changes
+const char* const TEXTURE_CACHE_HASH_KEY = "CS330cacheKey";
+
+const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Vulkan formats KTX2 names its contents by
+enum Ktx2Format : uint32_t {
+    KTX2_BC1_RGB_UNORM = 131,
+    KTX2_BC1_RGB_SRGB = 132,
+    KTX2_BC3_UNORM = 137,
+    KTX2_BC3_SRGB = 138
+};
+
+struct Ktx2Header {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// One mip level of a compressed texture, pointing into its owner's storage
+struct CompressedLevel {
+    int width;
+    int height;
+    const unsigned char* data;
+    size_t size;
+};
+
+/*
+* A block compressed texture with its mip chain, level 0 first
+* The levels point either into the mapped cache file or into blocks
+*/
+struct CompressedTexture {
+    GLenum format = 0;
+    bool alpha = false;
+    std::vector<CompressedLevel> levels;
+    MappedFile file;                   // backing store on a cache hit
+    std::vector<unsigned char> blocks; // backing store right after transcoding
+
+    size_t Size() const
+    {
+        size_t total = 0;
+        for (const CompressedLevel& level : levels)
+            total += level.size;
+        return total;
+    }
+};
+
+/*
+* Identifies one source image and the options it was imported with
+* Every input that changes the compressed output must be added to the key
+*/
+class TextureCacheKey
+{
+public:
+    TextureCacheKey(const std::string& sourcePath, const TextureImportOptions& options)
+    {
+        name = std::filesystem::path(sourcePath).stem().string();
+        AddSource(sourcePath);
+        AddOptions(options);
+    }
+
+    // Key of an image composed from several sources, e.g. an atlas, with layout covering how they are arranged
+    TextureCacheKey(const std::string& imageName, const std::vector<std::string>& sourcePaths, uint64_t layout, const TextureImportOptions& options)
+        : name(imageName)
+    {
+        AddBytes(imageName.data(), imageName.size());
+        for (const std::string& sourcePath : sourcePaths)
+            AddSource(sourcePath);
+        Add(layout);
+        AddOptions(options);
+    }
+
+    uint64_t Hash() const { return hash; }
+
+    // Path of the cache file for this key, e.g. texturecache/marble_0123456789abcdef.ktx2
+    // Other files derived from the same source pass their own extension
+    std::string Path(const char* extension = ".ktx2") const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return std::string(TEXTURE_CACHE_DIR) + "/" + name + "_" + hex + extension;
+    }
+
+private:
+    std::string name;
+    uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+
+    void Add(uint64_t value) { AddBytes(&value, sizeof(value)); }
+
+    void AddSource(const std::string& sourcePath)
+    {
+        AddBytes(sourcePath.data(), sourcePath.size());
+
+        std::error_code error;
+        std::filesystem::path source(sourcePath);
+        uint64_t size = std::filesystem::file_size(source, error);
+        Add(error ? 0 : size);
+        int64_t modified = std::filesystem::last_write_time(source, error).time_since_epoch().count();
+        Add(uint64_t(error ? 0 : modified));
+    }
+
+    void AddOptions(const TextureImportOptions& options)
+    {
+        Add(uint64_t(options.premultiplyAlpha) | (uint64_t(options.srgb) << 1));
+        Add(uint64_t(TEXTURE_CACHE_VERSION));
+    }
+
+    void AddBytes(const void* bytes, size_t count)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ull; // FNV-1a prime
+        }
+    }
+};
+
+class TextureCache
+{
+public:
+    // Cache statistics for the whole process, updated from the texture loader's worker threads
+    static inline std::atomic<unsigned int> hits{ 0 };
+    static inline std::atomic<unsigned int> misses{ 0 };
+
+    /*
+    * Compresses an RGBA8 image and its mips down to 1x1, filtered by MipGenerator
+    * Images whose alpha is 255 everywhere become BC1, the rest BC3
+    * @params options: the options the pixels were imported with, selects sRGB formats
+    */
+    static void Transcode(const unsigned char* rgba, int width, int height, const TextureImportOptions& options, CompressedTexture& texture)
+    {
+        texture.file.Close();
+        texture.alpha = false;
+        size_t pixelCount = size_t(width) * size_t(height);
+        for (size_t i = 0; i < pixelCount && !texture.alpha; ++i)
+            texture.alpha = rgba[i * 4 + 3] != 255;
+        texture.format = GLFormat(VkFormat(texture.alpha, options.srgb));
+
+        // Size the whole chain first so level pointers stay valid
+        size_t total = 0;
+        for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+            total += BCImageSize(w, h, texture.alpha);
+            if (w == 1 && h == 1)
+                break;
+        }
+        texture.blocks.resize(total);
+        texture.levels.clear();
+
+        std::vector<MipLevel> mips;
+        MipGenerator::Generate(rgba, width, height, INT_MAX, MipOptions::For(options), mips);
+        unsigned char* out = texture.blocks.data();
+        for (size_t level = 0; level <= mips.size(); ++level) {
+            const unsigned char* pixels = level == 0 ? rgba : mips[level - 1].pixels.data();
+            int w = level == 0 ? width : mips[level - 1].width;
+            int h = level == 0 ? height : mips[level - 1].height;
+            size_t size = BCImageSize(w, h, texture.alpha);
+            EncodeBCImage(pixels, w, h, texture.alpha, out);
+            texture.levels.push_back({ w, h, out, size });
+            out += size;
+        }
+    }
+
+    /*
+    * Maps the cache file for key
+    * @return false on a miss or an invalid file, texture is left empty then
+    */
+    static bool Load(const TextureCacheKey& key, CompressedTexture& texture)
+    {
+        texture.levels.clear();
+        texture.blocks.clear();
+        if (!texture.file.Open(key.Path()) || !Validate(key, texture)) {
+            texture.file.Close();
+            texture.levels.clear();
+            ++misses;
+            return false;
+        }
+        ++hits;
+        return true;
+    }
+
+    /*
+    * Writes a transcoded texture to the cache file for key
+    * Failure to write only costs the next launch another transcode
+    */
+    static bool Store(const TextureCacheKey& key, const CompressedTexture& texture)
+    {
+        if (texture.levels.empty())
+            return false;
+
+        std::error_code error;
+        std::filesystem::create_directories(TEXTURE_CACHE_DIR, error);
+
+        const CompressedLevel& base = texture.levels.front();
+        uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+        uint32_t vkFormat = VkFormat(texture.alpha, IsSrgb(texture.format));
+
+        std::vector<uint32_t> dfd = DataFormatDescriptor(texture.alpha, IsSrgb(texture.format));
+        std::vector<unsigned char> kvd = KeyValueData(key.Hash());
+
+        Ktx2Header header = {};
+        memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+        header.vkFormat = vkFormat;
+        header.typeSize = 1;
+        header.pixelWidth = uint32_t(base.width);
+        header.pixelHeight = uint32_t(base.height);
+        header.faceCount = 1;
+        header.levelCount = levelCount;
+        header.dfdByteOffset = uint32_t(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level));
+        header.dfdByteLength = uint32_t(dfd.size() * sizeof(uint32_t));
+        header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+        header.kvdByteLength = uint32_t(kvd.size());
+
+        // Levels are stored smallest first, each aligned to the block size
+        uint64_t alignment = texture.alpha ? BC3_BLOCK_BYTES : BC1_BLOCK_BYTES;
+        std::vector<Ktx2Level> index(levelCount);
+        uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+        for (uint32_t i = levelCount; i-- > 0;) {
+            offset = (offset + alignment - 1) / alignment * alignment;
+            index[i].byteOffset = offset;
+            index[i].byteLength = texture.levels[i].size;
+            index[i].uncompressedByteLength = texture.levels[i].size;
+            offset += texture.levels[i].size;
+        }
+
+        // Write to a temporary file and rename so a crash never leaves a truncated cache
+        std::string path = key.Path();
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2Level));
+            out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+            out.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+
+            static const char padding[BC3_BLOCK_BYTES] = {};
+            uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+            for (uint32_t i = levelCount; i-- > 0;) {
+                out.write(padding, index[i].byteOffset - written);
+                out.write(reinterpret_cast<const char*>(texture.levels[i].data), texture.levels[i].size);
+                written = index[i].byteOffset + index[i].byteLength;
+            }
+            if (!out)
+                return false;
+        }
+
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+    // Deletes every cache file, forcing the next Load calls to miss
+    static void Clear()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(TEXTURE_CACHE_DIR, error);
+    }
+
+    // True if the context can sample the formats Transcode writes
+    static bool Supported()
+    {
+        return HasGLExtension("GL_EXT_texture_compression_s3tc");
+    }
+
+private:
+    static uint32_t VkFormat(bool alpha, bool srgb)
+    {
+        if (alpha)
+            return srgb ? KTX2_BC3_SRGB : KTX2_BC3_UNORM;
+        return srgb ? KTX2_BC1_RGB_SRGB : KTX2_BC1_RGB_UNORM;
+    }
+
+    static GLenum GLFormat(uint32_t vkFormat)
+    {
+        switch (vkFormat) {
+        case KTX2_BC1_RGB_UNORM: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case KTX2_BC1_RGB_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case KTX2_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case KTX2_BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        default: return 0;
+        }
+    }
+
+    static bool IsSrgb(GLenum format)
+    {
+        return format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    }
+
+    /*
+    * Basic data format descriptor for BC1 or BC3, as required by KTX2
+    * Words are laid out as in the Khronos Data Format specification, version 1.3
+    */
+    static std::vector<uint32_t> DataFormatDescriptor(bool alpha, bool srgb)
+    {
+        const uint32_t colorModel = alpha ? 130 : 128; // KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A
+        const uint32_t primaries = 1;                  // KHR_DF_PRIMARIES_BT709
+        const uint32_t transfer = srgb ? 2 : 1;        // KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR
+        uint32_t samples = alpha ? 2 : 1;
+        uint32_t blockSize = 24 + 16 * samples;
+
+        std::vector<uint32_t> words;
+        words.push_back(4 + blockSize);                    // dfdTotalSize
+        words.push_back(0);                                // vendorId 0 (Khronos), descriptorType 0 (basic)
+        words.push_back(2 | (blockSize << 16));            // versionNumber 2, descriptorBlockSize
+        words.push_back(colorModel | (primaries << 8) | (transfer << 16));
+        words.push_back(3 | (3 << 8));                     // texelBlockDimension 4x4x1x1, stored minus one
+        words.push_back(alpha ? 16u : 8u);                 // bytesPlane0
+        words.push_back(0);                                // bytesPlane4..7
+
+        // BC3 has its alpha block first, alpha is always linear so it carries KHR_DF_SAMPLE_DATATYPE_LINEAR under sRGB
+        if (alpha) {
+            words.push_back(0 | (63 << 16) | ((15u | (srgb ? 0x10u : 0u)) << 24)); // offset 0, 64 bits, KHR_DF_CHANNEL_BC3_ALPHA, 0x10 = LINEAR
+            words.push_back(0);
+            words.push_back(0);
+            words.push_back(0xFFFFFFFFu);
+        }
+        words.push_back((alpha ? 64u : 0u) | (63 << 16));  // color block, KHR_DF_CHANNEL_BC1A_COLOR / BC3_COLOR = 0
+        words.push_back(0);
+        words.push_back(0);
+        words.push_back(0xFFFFFFFFu);
+        return words;
+    }
+
+    // One key/value entry holding the cache key hash as 16 hex digits
+    static std::vector<unsigned char> KeyValueData(uint64_t hash)
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        std::string entry = std::string(TEXTURE_CACHE_HASH_KEY) + '\0' + hex + '\0';
+
+        uint32_t length = static_cast<uint32_t>(entry.size());
+        std::vector<unsigned char> kvd(sizeof(length));
+        memcpy(kvd.data(), &length, sizeof(length));
+        kvd.insert(kvd.end(), entry.begin(), entry.end());
+        kvd.resize((kvd.size() + 3) / 4 * 4, 0);
+        return kvd;
+    }
+
+    // Checks the mapped file against the key and builds level views into the mapping
+    static bool Validate(const TextureCacheKey& key, CompressedTexture& texture)
+    {
+        const MappedFile& file = texture.file;
+        if (file.Size() < sizeof(Ktx2Header))
+            return false;
+
+        Ktx2Header header;
+        memcpy(&header, file.Data(), sizeof(header));
+        GLenum format = GLFormat(header.vkFormat);
+        if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || format == 0 ||
+            header.pixelDepth != 0 || header.layerCount != 0 || header.faceCount != 1 ||
+            header.supercompressionScheme != 0 || header.levelCount == 0 || header.levelCount > 32)
+            return false;
+
+        uint64_t indexEnd = sizeof(Ktx2Header) + uint64_t(header.levelCount) * sizeof(Ktx2Level);
+        if (indexEnd > file.Size() || uint64_t(header.kvdByteOffset) + header.kvdByteLength > file.Size())
+            return false;
+        std::vector<unsigned char> expected = KeyValueData(key.Hash());
+        if (header.kvdByteLength != expected.size() || memcmp(file.Data() + header.kvdByteOffset, expected.data(), expected.size()) != 0)
+            return false;
+
+        texture.format = format;
+        texture.alpha = header.vkFormat == KTX2_BC3_UNORM || header.vkFormat == KTX2_BC3_SRGB;
+        const Ktx2Level* index = reinterpret_cast<const Ktx2Level*>(file.Data() + sizeof(Ktx2Header));
+        int w = int(header.pixelWidth), h = int(header.pixelHeight);
+        for (uint32_t i = 0; i < header.levelCount; ++i) {
+            Ktx2Level level;
+            memcpy(&level, &index[i], sizeof(level));
+            if (level.byteLength != BCImageSize(w, h, texture.alpha) || level.byteOffset + level.byteLength > file.Size())
+                return false;
+            texture.levels.push_back({ w, h, file.Data() + level.byteOffset, size_t(level.byteLength) });
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        return true;
+    }
+};
+
+#endif
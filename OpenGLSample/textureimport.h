@@ -0,0 +1,254 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Texture import stage
+* Turns freshly decoded images of any channel count into bottom-up RGBA8,
+* ready for glTexImage2D, in as few passes over the pixels as possible:
+* - rows are flipped with whole-row memcpy instead of byte swaps
+* - RGB is expanded to RGBA while it is flipped, with SSSE3 when the compiler targets it
+* - alpha can be premultiplied with SSE2, or in linear light for sRGB textures
+*
+* Images come from stb_image, which Source.cpp builds with its default malloc/free,
+* so buffers are replaced with malloc/free here and stay valid for stbi_image_free
+*/
+
+#ifndef TEXTUREIMPORT_H
+#define TEXTUREIMPORT_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTUREIMPORT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define TEXTUREIMPORT_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+struct TextureImportOptions {
+    bool premultiplyAlpha = false; // store color * alpha, for blending with GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+    bool srgb = false;             // colors are sRGB encoded: premultiply in linear light and upload as GL_SRGB8_ALPHA8
+};
+
+// Reverses the row order of an image in place, one memcpy per row
+inline void FlipRows(unsigned char* pixels, int width, int height, int bytesPerPixel)
+{
+    size_t rowBytes = size_t(width) * size_t(bytesPerPixel);
+    std::vector<unsigned char> scratch(rowBytes);
+    unsigned char* top = pixels;
+    unsigned char* bottom = pixels + (size_t(height) - 1) * rowBytes;
+    for (; top < bottom; top += rowBytes, bottom -= rowBytes) {
+        memcpy(scratch.data(), top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, scratch.data(), rowBytes);
+    }
+}
+
+// Converts count RGB pixels to RGBA with alpha 255, source and destination must not overlap
+inline void ExpandRgbToRgba(const unsigned char* src, unsigned char* dst, size_t count)
+{
+    size_t i = 0;
+#ifdef TEXTUREIMPORT_SSSE3
+    // Four pixels per step; the 16 byte load reads 4 bytes ahead, so stop 6 pixels short of the end
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    for (; i + 6 <= count; i += 4) {
+        __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+    }
+#endif
+    // One 32 bit load per pixel reads a byte ahead, so the last pixel is copied bytewise
+    // The top byte of the little endian word is the fourth channel, so or-ing it in sets alpha
+    for (; i + 1 < count; ++i) {
+        uint32_t pixel;
+        memcpy(&pixel, src + i * 3, 4);
+        pixel |= 0xFF000000u;
+        memcpy(dst + i * 4, &pixel, 4);
+    }
+    for (; i < count; ++i) {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 255;
+    }
+}
+
+// Converts count grey or grey+alpha pixels to RGBA
+inline void ExpandGreyToRgba(const unsigned char* src, unsigned char* dst, size_t count, int channels)
+{
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char grey = src[i * channels];
+        dst[i * 4] = grey;
+        dst[i * 4 + 1] = grey;
+        dst[i * 4 + 2] = grey;
+        dst[i * 4 + 3] = channels == 2 ? src[i * 2 + 1] : 255;
+    }
+}
+
+// x * a / 255 rounded to nearest, exact for all 8 bit inputs
+inline unsigned char MultiplyByAlpha(unsigned int x, unsigned int a)
+{
+    unsigned int t = x * a + 128;
+    return static_cast<unsigned char>((t + (t >> 8)) >> 8);
+}
+
+// Multiplies the color of count RGBA pixels by their alpha, treating the values as linear
+inline void PremultiplyAlpha(unsigned char* rgba, size_t count)
+{
+    size_t i = 0;
+#ifdef TEXTUREIMPORT_SSE2
+    // Four pixels per step in 16 bit lanes; the alpha lane is multiplied by 255 so it stays unchanged
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    const __m128i alphaOne = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero) };
+        for (__m128i& h : halves) {
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(h, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            alpha = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(h, alpha), half);
+            h = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+    for (; i < count; ++i) {
+        unsigned char* p = rgba + i * 4;
+        p[0] = MultiplyByAlpha(p[0], p[3]);
+        p[1] = MultiplyByAlpha(p[1], p[3]);
+        p[2] = MultiplyByAlpha(p[2], p[3]);
+    }
+}
+
+// Lookup tables between 8 bit sRGB and 12 bit linear values, built once
+struct SrgbTables {
+    uint16_t toLinear[256];    // sRGB byte to linear 0..4095
+    unsigned char toSrgb[4096]; // linear 0..4095 to sRGB byte
+    unsigned char premultiplied[256][256]; // [alpha][sRGB byte] to the sRGB byte multiplied by alpha in linear light
+
+    static const SrgbTables& Get()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+private:
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            double c = i / 255.0;
+            double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            toLinear[i] = static_cast<uint16_t>(linear * 4095.0 + 0.5);
+        }
+        for (int i = 0; i < 4096; ++i) {
+            double linear = i / 4095.0;
+            double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            toSrgb[i] = static_cast<unsigned char>(c * 255.0 + 0.5);
+        }
+        for (unsigned int a = 0; a < 256; ++a) {
+            for (int i = 0; i < 256; ++i)
+                premultiplied[a][i] = toSrgb[(toLinear[i] * a + 127) / 255];
+        }
+    }
+};
+
+/*
+* Premultiplies sRGB encoded pixels in linear light, so edges do not darken when filtered
+* SSE2 has no gather for the table lookups, so it only takes the pixels that need none: groups of
+* four opaque pixels are left as they are and fully transparent pixels are cleared with a mask
+*/
+inline void PremultiplyAlphaSrgb(unsigned char* rgba, size_t count)
+{
+    const SrgbTables& tables = SrgbTables::Get();
+    size_t i = 0;
+#ifdef TEXTUREIMPORT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000u));
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        __m128i alpha = _mm_and_si128(pixels, alphaMask);
+        __m128i clear = _mm_cmpeq_epi32(alpha, zero);
+        int opaqueBits = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask));
+        if (opaqueBits == 0xFFFF)
+            continue;
+        // Only opaque and transparent pixels, the transparent ones become 0 in all four channels
+        if ((opaqueBits | _mm_movemask_epi8(clear)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_andnot_si128(clear, pixels));
+            continue;
+        }
+        // A mix of alpha values, the lookups are done one pixel at a time
+        for (size_t k = i; k < i + 4; ++k) {
+            unsigned char* p = rgba + k * 4;
+            if (p[3] == 255)
+                continue;
+            const unsigned char* row = tables.premultiplied[p[3]];
+            p[0] = row[p[0]];
+            p[1] = row[p[1]];
+            p[2] = row[p[2]];
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        unsigned char* p = rgba + i * 4;
+        if (p[3] == 255)
+            continue;
+        const unsigned char* row = tables.premultiplied[p[3]];
+        p[0] = row[p[0]];
+        p[1] = row[p[1]];
+        p[2] = row[p[2]];
+    }
+}
+
+/*
+* Converts a decoded image to bottom-up RGBA8 and applies the import options
+* @params pixels: top-down image with channels bytes per pixel, replaced when it has to grow
+*         channels: 1 to 4
+* @return false for an unsupported channel count, pixels is left untouched then
+*/
+inline bool ImportTexturePixels(unsigned char*& pixels, int width, int height, int channels, const TextureImportOptions& options)
+{
+    if (channels < 1 || channels > 4)
+        return false;
+
+    size_t pixelCount = size_t(width) * size_t(height);
+    if (channels == 4) {
+        FlipRows(pixels, width, height, 4);
+    }
+    else {
+        // Expand straight into the flipped row, so the image is only walked once
+        unsigned char* rgba = static_cast<unsigned char*>(malloc(pixelCount * 4));
+        if (!rgba)
+            return false;
+        size_t srcRow = size_t(width) * size_t(channels);
+        size_t dstRow = size_t(width) * 4;
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* src = pixels + size_t(y) * srcRow;
+            unsigned char* dst = rgba + size_t(height - 1 - y) * dstRow;
+            if (channels == 3)
+                ExpandRgbToRgba(src, dst, size_t(width));
+            else
+                ExpandGreyToRgba(src, dst, size_t(width), channels);
+        }
+        free(pixels);
+        pixels = rgba;
+    }
+
+    // Only images that carried alpha can change
+    if (options.premultiplyAlpha && (channels == 2 || channels == 4)) {
+        if (options.srgb)
+            PremultiplyAlphaSrgb(pixels, pixelCount);
+        else
+            PremultiplyAlpha(pixels, pixelCount);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,360 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Asynchronous texture loader
+* Image files are decoded on a pool of worker threads while the render loop
+* runs. Load returns a texture key straight away whose texture holds a one
+* texel placeholder, and Poll uploads the decoded images on the GL thread
+*
+* Every upload goes into a new texture with immutable storage sized for the
+* image, which then replaces the texture behind the key, so meshes keep the
+* key they were created with and bind Name(key)
+*
+* Startup only waits for the slowest decode instead of the sum of all of them
+*/
+
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct CompressedTexture;
+struct StagedTexture;
+
+// Pixels decoded on a worker thread, waiting to be uploaded on the GL thread
+struct DecodedImage {
+    GLuint textureId = 0;              // key returned by AsyncTextureLoader::Load
+    std::string path;
+    unsigned char* pixels = nullptr; // owned by the decode/upload functions, released by the upload function
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    GLenum internalFormat = GL_RGBA8; // format the upload function allocates the texture with
+    CompressedTexture* compressed = nullptr; // block compressed levels used instead of pixels, owned like pixels
+    StagedTexture* staged = nullptr;   // every mip level ready to upload, replaces pixels and compressed, owned like pixels
+    int maxLevel = -1;                 // highest mip level the texture may sample, -1 for the whole chain
+    int skipLevels = 0;                // top mip levels the decode function leaves out, to save memory
+    bool reload = false;               // replaces the image of a texture that was already uploaded, see Reload
+    bool (*decode)(DecodedImage& image) = nullptr; // replaces the loader's decode function for this image
+};
+
+// Decodes image.path into image, runs on a worker thread and must not call GL
+typedef bool (*DecodeImageFunction)(DecodedImage& image);
+
+// Allocates the storage of the bound texture, uploads image into it and frees its pixels, runs on the GL thread
+typedef void (*UploadImageFunction)(DecodedImage& image);
+
+// Frees the pixels of an image that was decoded but never uploaded
+typedef void (*FreeImageFunction)(DecodedImage& image);
+
+class AsyncTextureLoader
+{
+public:
+    // threads = 0 uses one worker per hardware thread, leaving one for the render loop
+    AsyncTextureLoader(DecodeImageFunction decode, UploadImageFunction upload, FreeImageFunction release, unsigned int threads = 0)
+        : decode(decode), upload(upload), release(release), start(std::chrono::steady_clock::now())
+    {
+        if (threads == 0)
+            threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.emplace_back(&AsyncTextureLoader::Work, this);
+    }
+
+    // Stops the workers; textures are left to their owners (see Delete)
+    ~AsyncTextureLoader()
+    {
+        Stop();
+    }
+
+    AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+    /*
+    * Creates a texture holding a placeholder and queues path for decoding
+    * Must be called on the GL thread
+    * @return the texture key, valid immediately and for the final image, see Name
+    */
+    GLuint Load(const std::string& path)
+    {
+        return Load(path, nullptr);
+    }
+
+    /*
+    * Like Load, but decodes this image with its own function, e.g. to compose an atlas
+    * @params path: passed to decodeWith in image.path, does not have to be a file
+    */
+    GLuint Load(const std::string& path, DecodeImageFunction decodeWith)
+    {
+        GLuint textureId = nextKey++;
+        names[textureId] = CreatePlaceholder();
+
+        DecodedImage job;
+        job.textureId = textureId;
+        job.path = path;
+        job.decode = decodeWith;
+        Queue(job);
+        return textureId;
+    }
+
+    // GL texture currently holding the image of a key, 0 for unknown keys
+    GLuint Name(GLuint textureId) const
+    {
+        auto found = names.find(textureId);
+        return found != names.end() ? found->second : 0;
+    }
+
+    // Replaces the texture of a key with a placeholder, freeing its memory; Reload brings the image back
+    void Clear(GLuint textureId)
+    {
+        if (names.count(textureId))
+            Replace(textureId, CreatePlaceholder());
+    }
+
+    // Deletes the texture of a key and drops its pending images, the key is invalid afterwards
+    void Delete(GLuint textureId)
+    {
+        auto found = names.find(textureId);
+        if (found == names.end())
+            return;
+        Forget(textureId);
+        glDeleteTextures(1, &found->second);
+        names.erase(found);
+    }
+
+    /*
+    * Decodes path again into a texture created by Load, e.g. at a different size
+    * The texture keeps its current image until Poll uploads the new one
+    * @params skipLevels: top mip levels to leave out, 0 for the full image
+    */
+    void Reload(GLuint textureId, const std::string& path, DecodeImageFunction decodeWith, int skipLevels)
+    {
+        DecodedImage job;
+        job.textureId = textureId;
+        job.path = path;
+        job.decode = decodeWith;
+        job.skipLevels = skipLevels;
+        job.reload = true;
+        Queue(job);
+    }
+
+    /*
+    * Drops every queued, decoding or decoded image of a texture
+    * Must be called on the GL thread
+    */
+    void Forget(GLuint textureId)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = queued.begin(); it != queued.end();) {
+            if (it->textureId == textureId) {
+                it = queued.erase(it);
+                Finished();
+            }
+            else {
+                ++it;
+            }
+        }
+        for (auto it = decoded.begin(); it != decoded.end();) {
+            if (it->textureId == textureId) {
+                release(*it);
+                it = decoded.erase(it);
+                Finished();
+            }
+            else {
+                ++it;
+            }
+        }
+        // Images a worker is decoding right now are dropped when it is done
+        forgotten.insert(forgotten.end(), std::count(decoding.begin(), decoding.end(), textureId), textureId);
+    }
+
+    /*
+    * Uploads up to maxUploads decoded images, call once per frame on the GL thread
+    * Keeping the count small spreads large uploads over several frames
+    * @return the number of textures that became ready
+    */
+    size_t Poll(size_t maxUploads = SIZE_MAX)
+    {
+        size_t uploaded = 0;
+        while (uploaded < maxUploads) {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty())
+                    break;
+                image = decoded.front();
+                decoded.pop_front();
+            }
+
+            if (image.pixels || image.compressed || image.staged) {
+                GLuint texture = CreateTexture();
+                glBindTexture(GL_TEXTURE_2D, texture);
+                upload(image);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                Replace(image.textureId, texture);
+            }
+            ++uploaded;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            Finished();
+        }
+        return uploaded;
+    }
+
+    // Blocks until every queued image is decoded and uploaded, for tools that need the final textures
+    void Finish()
+    {
+        while (!Idle()) {
+            if (Poll() == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /*
+    * Waits for the images being decoded and stops the workers, images not uploaded yet are dropped
+    * Call before destroying anything the decode functions write to
+    */
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+        for (DecodedImage& image : decoded)
+            release(image);
+        decoded.clear();
+    }
+
+    // True once every texture requested so far has its final image (or failed to decode)
+    bool Idle() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending == 0;
+    }
+
+    // Milliseconds from construction until the last texture was uploaded, only meaningful when Idle
+    double MillisecondsToIdle() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::chrono::duration<double, std::milli>(finished - start).count();
+    }
+
+private:
+    DecodeImageFunction decode;
+    UploadImageFunction upload;
+    FreeImageFunction release;
+
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<DecodedImage> queued;   // waiting for a worker
+    std::deque<DecodedImage> decoded;  // waiting for Poll, failed decodes have no pixels, compressed or staged levels
+    std::vector<GLuint> decoding;      // textures a worker is decoding an image for
+    std::vector<GLuint> forgotten;     // textures whose image in decoding is dropped when it is done
+    size_t pending = 0;                // requested but not yet uploaded
+    bool stopping = false;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point finished;
+
+    std::unordered_map<GLuint, GLuint> names; // key to current texture, GL thread only
+    GLuint nextKey = 1;
+
+    // Texture object without storage yet, it is sampled through the sampler bound to its unit, see TextureSamplers
+    static GLuint CreateTexture()
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        return texture;
+    }
+
+    static GLuint CreatePlaceholder()
+    {
+        // Mid grey so untextured surfaces still show their lighting
+        static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+
+        GLuint texture = CreateTexture();
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // Points a key at a new texture and deletes the old one; a key deleted meanwhile takes the texture with it
+    void Replace(GLuint textureId, GLuint texture)
+    {
+        auto found = names.find(textureId);
+        if (found == names.end()) {
+            glDeleteTextures(1, &texture);
+            return;
+        }
+        glDeleteTextures(1, &found->second);
+        found->second = texture;
+    }
+
+    // Counts one requested image as done, the mutex must be held
+    void Finished()
+    {
+        if (--pending == 0)
+            finished = std::chrono::steady_clock::now();
+    }
+
+    void Queue(const DecodedImage& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back(job);
+            ++pending;
+        }
+        wake.notify_one();
+    }
+
+    void Work()
+    {
+        for (;;) {
+            DecodedImage image;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queued.empty(); });
+                if (stopping)
+                    return;
+                image = queued.front();
+                queued.pop_front();
+                decoding.push_back(image.textureId);
+            }
+
+            if (!(image.decode ? image.decode : decode)(image)) {
+                image.pixels = nullptr;
+                image.compressed = nullptr;
+                image.staged = nullptr;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoding.erase(std::find(decoding.begin(), decoding.end(), image.textureId));
+            auto dropped = std::find(forgotten.begin(), forgotten.end(), image.textureId);
+            if (dropped != forgotten.end()) {
+                forgotten.erase(dropped);
+                release(image);
+                Finished();
+                continue;
+            }
+            decoded.push_back(image);
+        }
+    }
+};
+
+#endif
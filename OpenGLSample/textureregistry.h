@@ -0,0 +1,218 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Texture registry
+* Hands out reference counted handles to the textures of the AsyncTextureLoader,
+* so every image is decoded and uploaded once however many meshes use it
+*
+* Textures are looked up by path, size and modification time, so a file that
+* changed on disk is loaded again. A new file is only read here when a file of
+* the same size is already loaded under another path, and shares its texture if
+* the bytes match, so the same image under two paths (or a copy of it) still
+* shares one GL texture. A texture is deleted when its last handle goes away
+*
+* Handles may outlive the registry: once it is destroyed they only keep their
+* id, the GL texture has been deleted by then
+*/
+
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mappedfile.h"
+#include "textureloader.h"
+#include "textureresidency.h"
+
+class TextureRegistry;
+
+// One loaded texture, shared by all of its handles
+struct TextureRecord {
+    GLuint textureId = 0;
+    std::string file;                   // normalized path, empty for images that are not read from a single file
+    uintmax_t fileSize = 0;             // 0 for images that are not read from a single file
+    TextureRegistry* registry = nullptr; // deletes the texture with the last handle, null once the registry is gone
+};
+
+class TextureHandle
+{
+public:
+    TextureHandle() = default;
+
+    GLuint Id() const { return record ? record->textureId : 0; }
+
+    // Lets handles be passed wherever a texture name is expected
+    operator GLuint() const { return Id(); }
+
+    // Handles to the same texture, this one included
+    long UseCount() const { return record.use_count(); }
+
+private:
+    friend class TextureRegistry;
+
+    std::shared_ptr<TextureRecord> record;
+
+    explicit TextureHandle(std::shared_ptr<TextureRecord> record) : record(std::move(record)) {}
+};
+
+class TextureRegistry
+{
+public:
+    /*
+    * @params loader: decodes and uploads the textures, must outlive the registry
+    *         residency: tracks the textures for the memory budget, may be null
+    */
+    TextureRegistry(AsyncTextureLoader& loader, TextureResidency* residency = nullptr) : loader(loader), residency(residency) {}
+
+    // Deletes the textures still referenced, must run while the GL context is current
+    ~TextureRegistry()
+    {
+        std::vector<std::shared_ptr<TextureRecord>> live; // Destroy edits byPath, so collect first
+        for (auto& item : byPath) {
+            if (std::shared_ptr<TextureRecord> record = item.second.lock())
+                live.push_back(record);
+        }
+        for (std::shared_ptr<TextureRecord>& record : live) {
+            if (record->registry) {
+                Destroy(*record);
+                record->registry = nullptr;
+            }
+        }
+    }
+
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    /*
+    * Returns a handle to the texture loaded from path, loading it on first use
+    * Must be called on the GL thread
+    * @params path: image file, or a key for decodeWith, which is not read
+    *         decodeWith: decode function for images that are not a plain file, e.g. an atlas
+    */
+    TextureHandle Acquire(const std::string& path, DecodeImageFunction decodeWith = nullptr)
+    {
+        ++requests;
+        std::string file = decodeWith ? std::string() : NormalizePath(path);
+        uintmax_t fileSize = 0;
+        std::string key = decodeWith ? path : FileKey(file, fileSize);
+        auto found = byPath.find(key);
+        if (found != byPath.end()) {
+            if (std::shared_ptr<TextureRecord> record = found->second.lock())
+                return TextureHandle(record);
+        }
+
+        // A file already loaded under another path shares its texture, only files of the same size are compared
+        if (fileSize != 0) {
+            auto same = bySize.equal_range(fileSize);
+            for (auto it = same.first; it != same.second; ++it) {
+                std::shared_ptr<TextureRecord> record = it->second.lock();
+                if (record && record->file != file && SameContents(record->file, file)) {
+                    byPath[key] = record;
+                    ++duplicates;
+                    return TextureHandle(record);
+                }
+            }
+        }
+
+        std::shared_ptr<TextureRecord> record(new TextureRecord, [](TextureRecord* record) {
+            if (record->registry)
+                record->registry->Destroy(*record);
+            delete record;
+        });
+        record->textureId = loader.Load(path, decodeWith);
+        record->file = file;
+        record->fileSize = fileSize;
+        record->registry = this;
+        byPath[key] = record;
+        if (fileSize != 0)
+            bySize.emplace(fileSize, record);
+        if (residency)
+            residency->Track(record->textureId, path, decodeWith);
+        ++loads;
+        return TextureHandle(record);
+    }
+
+    // Prints how many requests were served by existing textures
+    void Report(std::ostream& out) const
+    {
+        out << "Texture registry: " << requests << " requests, " << loads << " textures loaded, "
+            << duplicates << " duplicate files shared" << std::endl;
+    }
+
+private:
+    AsyncTextureLoader& loader;
+    TextureResidency* residency;
+    std::unordered_map<std::string, std::weak_ptr<TextureRecord>> byPath;   // every file key a texture was requested by
+    std::unordered_multimap<uintmax_t, std::weak_ptr<TextureRecord>> bySize; // textures loaded from a file, by its size
+    unsigned int requests = 0;
+    unsigned int loads = 0;
+    unsigned int duplicates = 0;
+
+    // Called with the last handle, so lookups stop finding the texture before its name is reused
+    void Destroy(const TextureRecord& record)
+    {
+        for (auto it = byPath.begin(); it != byPath.end();) {
+            if (it->second.expired() || it->second.lock().get() == &record)
+                it = byPath.erase(it);
+            else
+                ++it;
+        }
+        auto same = bySize.equal_range(record.fileSize);
+        for (auto it = same.first; it != same.second;) {
+            if (it->second.expired() || it->second.lock().get() == &record)
+                it = bySize.erase(it);
+            else
+                ++it;
+        }
+
+        if (residency)
+            residency->Untrack(record.textureId);
+        loader.Delete(record.textureId);
+    }
+
+    // Absolute path with . and .. resolved, so relative spellings of one file match
+    static std::string NormalizePath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        return error ? path : absolute.lexically_normal().generic_string();
+    }
+
+    /*
+    * Key of a file in byPath: its path with its size and modification time, so a changed file is a new texture
+    * @params file: normalized path
+    *         size: receives the file size, 0 when it cannot be read
+    */
+    static std::string FileKey(const std::string& file, uintmax_t& size)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(file, error);
+        if (error) {
+            size = 0;
+            return file;
+        }
+        auto modified = std::filesystem::last_write_time(file, error);
+        long long ticks = error ? 0 : (long long)modified.time_since_epoch().count();
+        return file + "|" + std::to_string(size) + "|" + std::to_string(ticks);
+    }
+
+    // True if both files can be read and hold the same bytes, usually decided by the first few bytes
+    static bool SameContents(const std::string& a, const std::string& b)
+    {
+        MappedFile first;
+        MappedFile second;
+        if (!first.Open(a) || !second.Open(b) || first.Size() != second.Size())
+            return false;
+        return memcmp(first.Data(), second.Data(), first.Size()) == 0;
+    }
+};
+
+#endif
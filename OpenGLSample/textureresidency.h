@@ -0,0 +1,289 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Texture residency manager
+* Keeps the estimated video memory of the loader's textures under a budget
+*
+* Every frame the render code touches the textures it binds. When the resident
+* total is over budget, textures are shrunk in least recently used order: a
+* texture first drops its top mip levels (each level roughly quarters its
+* size) down to MIN_RESIDENT_SIZE, and a texture that was not used this frame
+* is evicted to a one texel placeholder when dropping levels is not enough
+* Textures that are touched again while shrunk or evicted are streamed back
+* through the AsyncTextureLoader, a few per frame, as long as they fit; when
+* they do not, textures out of view are shrunk to make room for them
+*
+* Shrinking goes through the loader as well, so memory is released when the
+* smaller image is uploaded; evictions release it immediately
+* All methods must be called on the GL thread
+*/
+
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glextensions.h"
+#include "textureloader.h"
+
+class TextureResidency
+{
+public:
+    static const int MIN_RESIDENT_SIZE = 128;    // texels on the longer side a dropped texture keeps at least
+    static const size_t RESTREAMS_PER_FRAME = 2; // textures queued for streaming back in per frame
+
+    /*
+    * Sets the budget in bytes, 0 disables it
+    * Shrinking stops at the budget, streaming back in stops at 90% of it so the two do not alternate
+    */
+    void SetBudget(size_t bytes) { budget = bytes; }
+
+    size_t Budget() const { return budget; }
+
+    /*
+    * Budget from what the driver reports, 0 when it reports nothing
+    * NVX_gpu_memory_info: half of the dedicated video memory
+    * ATI_meminfo: half of the texture pool memory free at the time of the call, which shrinks as textures
+    * are allocated, so call it before creating any, as main does before the scene textures load
+    * Neither extension is loaded by glad
+    */
+    static size_t DefaultBudget()
+    {
+        if (HasGLExtension("GL_NVX_gpu_memory_info")) {
+            GLint kilobytes = 0;
+            glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &kilobytes);
+            return size_t(kilobytes) * 1024 / 2;
+        }
+        if (HasGLExtension("GL_ATI_meminfo")) {
+            GLint info[4] = {}; // currently free kilobytes first, not the size of the pool
+            glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+            return size_t(info[0]) * 1024 / 2;
+        }
+        return 0;
+    }
+
+    /*
+    * Starts managing a texture created by AsyncTextureLoader::Load
+    * @params path, decodeWith: what the loader was given, used to stream the texture back in
+    */
+    void Track(GLuint textureId, const std::string& path, DecodeImageFunction decodeWith = nullptr)
+    {
+        if (textureId == 0 || entries.count(textureId))
+            return;
+        Entry entry;
+        entry.path = path;
+        entry.decode = decodeWith;
+        entries[textureId] = entry;
+    }
+
+    // Stops managing a texture, call before deleting it
+    void Untrack(GLuint textureId) { entries.erase(textureId); }
+
+    // Records that a texture is drawn this frame
+    void Touch(GLuint textureId)
+    {
+        auto found = entries.find(textureId);
+        if (found != entries.end())
+            found->second.lastUsed = frame;
+    }
+
+    /*
+    * Records an image uploaded into a tracked texture, called by the upload function
+    * @params bytes: memory of the uploaded mip chain
+    *         droppedLevels: how many top levels the image was decoded without
+    */
+    void Uploaded(GLuint textureId, int width, int height, size_t bytes, int droppedLevels)
+    {
+        auto found = entries.find(textureId);
+        if (found == entries.end())
+            return;
+        Entry& entry = found->second;
+        entry.state = RESIDENT;
+        entry.dropped = droppedLevels;
+        entry.bytes = bytes;
+        entry.fullBytes = bytes << (2 * droppedLevels);
+        entry.maxDropped = 0;
+        while (std::max(width << droppedLevels, height << droppedLevels) >> (entry.maxDropped + 1) >= MIN_RESIDENT_SIZE)
+            ++entry.maxDropped;
+    }
+
+    // Bytes held by the tracked textures, or expected to once queued streaming lands
+    size_t ProjectedBytes() const
+    {
+        size_t total = 0;
+        for (const auto& item : entries)
+            total += Projected(item.second);
+        return total;
+    }
+
+    /*
+    * Applies the budget after the frame's draws, then starts the next frame
+    * @params loader: the loader the tracked textures came from, shrinking and streaming go through it
+    */
+    void Update(AsyncTextureLoader& loader)
+    {
+        if (budget > 0) {
+            Shrink(loader, budget, false);
+
+            // Make room for textures in view that are waiting to grow, at the cost of textures out of view only
+            if (demand > 0)
+                Shrink(loader, RestreamLimit() - std::min(demand, RestreamLimit()), true);
+            demand = 0;
+            Restream(loader);
+        }
+        ++frame;
+    }
+
+    // Prints the budget, the resident bytes and what the manager did so far
+    void Report(std::ostream& out) const
+    {
+        out << "Texture residency: " << ProjectedBytes() / (1024.0 * 1024.0) << " MB of " << budget / (1024.0 * 1024.0)
+            << " MB budget, " << dropCount << " mip drops, " << evictionCount << " evictions, " << restreamCount << " textures streamed back" << std::endl;
+    }
+
+private:
+    enum State { LOADING, RESIDENT, STREAMING, EVICTED };
+
+    struct Entry {
+        std::string path;
+        DecodeImageFunction decode = nullptr;
+        State state = LOADING;
+        int dropped = 0;      // top mip levels missing from the resident image
+        int target = 0;       // levels missing once the queued stream lands
+        int maxDropped = 0;   // most levels that can be dropped before the texture gets smaller than MIN_RESIDENT_SIZE
+        size_t bytes = 0;     // memory of the resident image
+        size_t fullBytes = 0; // memory of the full mip chain
+        unsigned long long lastUsed = 0;
+    };
+
+    std::unordered_map<GLuint, Entry> entries;
+    size_t budget = 0;
+    unsigned long long frame = 1;
+    size_t demand = 0; // bytes textures in view needed to grow a level last frame but did not fit
+    unsigned int dropCount = 0;
+    unsigned int evictionCount = 0;
+    unsigned int restreamCount = 0;
+
+    // Approximate memory with the top levels dropped, each level is a quarter of the one above
+    static size_t BytesAt(const Entry& entry, int dropped)
+    {
+        return std::max<size_t>(entry.fullBytes >> (2 * dropped), 1);
+    }
+
+    // Streaming back in stops below the budget, so Shrink does not undo it the next frame
+    size_t RestreamLimit() const { return budget / 10 * 9; }
+
+    static size_t Projected(const Entry& entry)
+    {
+        switch (entry.state) {
+        case RESIDENT: return entry.bytes;
+        case STREAMING: return std::max(entry.bytes, BytesAt(entry, entry.target)); // old image stays until the upload
+        default: return 0;
+        }
+    }
+
+    void Queue(AsyncTextureLoader& loader, GLuint textureId, Entry& entry, int dropped)
+    {
+        entry.state = STREAMING;
+        entry.target = dropped;
+        loader.Reload(textureId, entry.path, entry.decode, dropped);
+    }
+
+    // Replaces the texture with a one texel placeholder, freeing its memory now
+    static void Evict(AsyncTextureLoader& loader, GLuint textureId, Entry& entry)
+    {
+        loader.Clear(textureId);
+        entry.state = EVICTED;
+        entry.bytes = 0;
+    }
+
+    // Least recently used first, the larger texture first among equally old ones
+    std::vector<GLuint> VictimOrder() const
+    {
+        std::vector<GLuint> order;
+        for (const auto& item : entries) {
+            if (item.second.state == RESIDENT)
+                order.push_back(item.first);
+        }
+        std::sort(order.begin(), order.end(), [this](GLuint a, GLuint b) {
+            const Entry& ea = entries.at(a);
+            const Entry& eb = entries.at(b);
+            return ea.lastUsed != eb.lastUsed ? ea.lastUsed < eb.lastUsed : ea.bytes > eb.bytes;
+        });
+        return order;
+    }
+
+    /*
+    * Drops levels and evicts in least recently used order until the projected total is under target
+    * @params idleOnly: leave the textures used this frame alone
+    */
+    void Shrink(AsyncTextureLoader& loader, size_t target, bool idleOnly)
+    {
+        size_t projected = ProjectedBytes();
+        if (projected <= target)
+            return;
+
+        for (GLuint textureId : VictimOrder()) {
+            Entry& entry = entries[textureId];
+            if (idleOnly && entry.lastUsed == frame)
+                break; // the order puts the textures used this frame last
+
+            // Drop as many top levels as needed, as far as MIN_RESIDENT_SIZE allows
+            int dropped = entry.dropped;
+            while (dropped < entry.maxDropped && projected - entry.bytes + BytesAt(entry, dropped) > target)
+                ++dropped;
+            size_t remaining = projected - entry.bytes + BytesAt(entry, dropped);
+
+            if (remaining > target && entry.lastUsed < frame) {
+                projected -= entry.bytes;
+                Evict(loader, textureId, entry);
+                ++evictionCount;
+            }
+            else if (dropped > entry.dropped) {
+                Queue(loader, textureId, entry, dropped);
+                projected = remaining;
+                ++dropCount;
+            }
+            if (projected <= target)
+                return;
+        }
+    }
+
+    void Restream(AsyncTextureLoader& loader)
+    {
+        size_t projected = ProjectedBytes();
+        size_t limit = RestreamLimit();
+        size_t queued = 0;
+
+        for (auto& item : entries) {
+            Entry& entry = item.second;
+            bool shrunk = entry.state == EVICTED || (entry.state == RESIDENT && entry.dropped > 0);
+            if (!shrunk || entry.lastUsed != frame || queued == RESTREAMS_PER_FRAME)
+                continue;
+
+            // Come back as large as fits; an evicted texture in view comes back even when nothing fits,
+            // the next Shrink then makes room among the textures used less recently
+            int dropped = entry.state == EVICTED ? entry.maxDropped : entry.dropped;
+            size_t current = Projected(entry);
+            while (dropped > 0 && projected - current + BytesAt(entry, dropped - 1) <= limit)
+                --dropped;
+            if (dropped > 0)
+                demand += BytesAt(entry, dropped - 1) - BytesAt(entry, dropped);
+            if (entry.state == RESIDENT && dropped == entry.dropped)
+                continue;
+
+            projected = projected - current + BytesAt(entry, dropped);
+            Queue(loader, item.first, entry, dropped);
+            ++restreamCount;
+            ++queued;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Shared texture samplers
+* One sampler object holds the wrap and filter state every scene texture is
+* sampled with, bound once to its texture unit, so the textures themselves
+* carry no sampling state and the filtering can change without touching them
+*
+* Quality tiers trade texture bandwidth for quality: the low tier filters the
+* nearest mip level bilinearly and biases towards smaller levels, the higher
+* tiers blend levels trilinearly and add anisotropic filtering. Switching a
+* tier only updates the sampler, nothing is reloaded
+*/
+
+#ifndef TEXTURESAMPLER_H
+#define TEXTURESAMPLER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <string>
+
+#include "glextensions.h"
+
+struct TextureQualityTier {
+    const char* name;
+    bool trilinear;   // blend the two nearest mip levels, otherwise filter the nearest one bilinearly
+    float anisotropy; // samples along the axis of anisotropy, 1 turns it off; clamped to what the GPU supports
+    float lodBias;    // added to the mip level, positive values sample smaller levels
+};
+
+const TextureQualityTier TEXTURE_QUALITY_TIERS[] = {
+    { "low", false, 1.0f, 0.5f },
+    { "medium", true, 1.0f, 0.0f },
+    { "high", true, 4.0f, 0.0f },
+    { "ultra", true, 16.0f, 0.0f }
+};
+const int TEXTURE_QUALITY_TIER_COUNT = int(sizeof(TEXTURE_QUALITY_TIERS) / sizeof(TEXTURE_QUALITY_TIERS[0]));
+const int DEFAULT_TEXTURE_QUALITY_TIER = 2; // high
+
+class TextureSamplers
+{
+public:
+    /*
+    * Creates the scene sampler, call once on the GL thread
+    * @params wrapMode: wrap mode on both axes, e.g. GL_REPEAT
+    *         tier: index into TEXTURE_QUALITY_TIERS
+    */
+    void Create(GLint wrapMode, int tier)
+    {
+        // Core in GL 4.6, an extension before
+        if (HasGLExtension("GL_ARB_texture_filter_anisotropic") || HasGLExtension("GL_EXT_texture_filter_anisotropic"))
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+
+        glGenSamplers(1, &sceneSampler);
+        glSamplerParameteri(sceneSampler, GL_TEXTURE_WRAP_S, wrapMode);
+        glSamplerParameteri(sceneSampler, GL_TEXTURE_WRAP_T, wrapMode);
+        glSamplerParameteri(sceneSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        SetTier(tier);
+    }
+
+    void Destroy()
+    {
+        if (sceneSampler)
+            glDeleteSamplers(1, &sceneSampler);
+        sceneSampler = 0;
+    }
+
+    // Samples every texture bound to unit with the scene sampler, until another sampler is bound there
+    void Bind(GLuint unit) const { glBindSampler(unit, sceneSampler); }
+
+    // Applies a quality tier to the scene sampler, the units it is bound to follow at once
+    void SetTier(int index)
+    {
+        tier = std::min(std::max(index, 0), TEXTURE_QUALITY_TIER_COUNT - 1);
+        const TextureQualityTier& quality = TEXTURE_QUALITY_TIERS[tier];
+        glSamplerParameteri(sceneSampler, GL_TEXTURE_MIN_FILTER, quality.trilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST);
+        glSamplerParameterf(sceneSampler, GL_TEXTURE_LOD_BIAS, quality.lodBias);
+        if (maxAnisotropy > 1.0f)
+            glSamplerParameterf(sceneSampler, GL_TEXTURE_MAX_ANISOTROPY, std::min(quality.anisotropy, maxAnisotropy));
+    }
+
+    int Tier() const { return tier; }
+
+    const char* TierName() const { return TEXTURE_QUALITY_TIERS[tier].name; }
+
+    // Index of the tier called name, -1 if there is none
+    static int FindTier(const std::string& name)
+    {
+        for (int i = 0; i < TEXTURE_QUALITY_TIER_COUNT; ++i) {
+            if (name == TEXTURE_QUALITY_TIERS[i].name)
+                return i;
+        }
+        return -1;
+    }
+
+private:
+    GLuint sceneSampler = 0;
+    float maxAnisotropy = 1.0f; // 1 when anisotropic filtering is not supported
+    int tier = DEFAULT_TEXTURE_QUALITY_TIER;
+};
+
+#endif
@@ -0,0 +1,204 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Texture upload ring
+* One persistently mapped pixel unpack buffer that the texture loader's worker
+* threads copy decoded mip levels into, so the GL thread only issues
+* glTexSubImage2D calls that read from the buffer instead of from client memory
+*
+* Space is handed out in order around the ring. The GL thread fences every
+* region it copies from, and Reclaim frees regions once their fence has
+* signalled; regions are only reused in the order they were handed out, so a
+* slow upload holds back the ones after it
+*
+* Allocate never waits: when the ring is full the caller keeps its pixels in
+* client memory and they are uploaded from there
+*/
+
+#ifndef TEXTUREUPLOADRING_H
+#define TEXTUREUPLOADRING_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class PixelUploadRing
+{
+public:
+    static const size_t ALIGNMENT = 256; // start of every region, enough for any pixel row or compressed block
+
+    /*
+    * Creates and maps the buffer, call once on the GL thread
+    * @return false if the buffer could not be created, Allocate always fails then
+    */
+    bool Create(size_t bytes)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(bytes), nullptr, flags);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(bytes), flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mapped) {
+            Destroy();
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        data = static_cast<unsigned char*>(mapped);
+        capacity = bytes;
+        return true;
+    }
+
+    /*
+    * Unmaps and deletes the buffer, waiting for the copies still reading from it
+    * Must run on the GL thread before the context goes away, once no image is staged in the ring
+    */
+    void Destroy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Region& region : regions) {
+            if (region.fence) {
+                glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+                glDeleteSync(region.fence);
+            }
+        }
+        regions.clear();
+        if (buffer) {
+            if (data) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        data = nullptr;
+        capacity = 0;
+    }
+
+    GLuint Buffer() const { return buffer; }
+
+    /*
+    * Reserves bytes of the ring, safe to call from any thread
+    * @params offset: receives the start of the region, write it through Data(offset)
+    * @return false when the ring has no room, nothing is reserved then
+    */
+    bool Allocate(size_t bytes, size_t& offset)
+    {
+        bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (bytes == 0 || bytes > capacity)
+            return false;
+
+        if (regions.empty()) {
+            offset = 0;
+        }
+        else {
+            size_t tail = regions.front().offset;
+            size_t head = regions.back().offset + regions.back().size;
+            if (head > tail) {
+                // In use: [tail, head), free: [head, capacity) and [0, tail)
+                if (head + bytes <= capacity)
+                    offset = head;
+                else if (bytes <= tail)
+                    offset = 0;
+                else
+                    return false;
+            }
+            else {
+                // Wrapped, free: [head, tail)
+                if (head + bytes > tail)
+                    return false;
+                offset = head;
+            }
+        }
+        regions.push_back({ offset, bytes, nullptr, false });
+        return true;
+    }
+
+    unsigned char* Data(size_t offset) const { return data + offset; }
+
+    /*
+    * Ends the use of a region
+    * @params fence: signals when the GPU has read the region, null if it was never read
+    *         (the ring takes ownership of the fence)
+    */
+    void Release(size_t offset, GLsync fence)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Region& region : regions) {
+            if (region.offset == offset && !region.released) {
+                region.fence = fence;
+                region.released = true;
+                return;
+            }
+        }
+    }
+
+    // Frees the oldest regions whose copies have finished, call on the GL thread once per frame
+    void Reclaim()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!regions.empty() && regions.front().released) {
+            Region& region = regions.front();
+            if (region.fence) {
+                GLenum status = glClientWaitSync(region.fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    break;
+                glDeleteSync(region.fence);
+            }
+            regions.pop_front();
+        }
+    }
+
+private:
+    struct Region {
+        size_t offset;
+        size_t size;
+        GLsync fence;  // set by Release when the GPU reads the region
+        bool released; // the owner is done with it, only the fence may still be pending
+    };
+
+    GLuint buffer = 0;
+    unsigned char* data = nullptr;
+    size_t capacity = 0;
+    std::deque<Region> regions; // in the order they were handed out
+    mutable std::mutex mutex;
+};
+
+// One mip level of a StagedTexture
+struct StagedLevel {
+    int width = 0;
+    int height = 0;
+    size_t offset = 0; // from the start of the texture's levels
+    size_t size = 0;
+};
+
+// Every mip level of a texture, laid out for upload in a PixelUploadRing region or in client memory
+struct StagedTexture {
+    GLenum internalFormat = GL_RGBA8;
+    bool compressed = false;              // levels are S3TC blocks in internalFormat, otherwise RGBA8 texels
+    std::vector<StagedLevel> levels;      // level 0 first
+    PixelUploadRing* ring = nullptr;      // ring holding the levels, null when they are in memory
+    size_t ringOffset = 0;
+    std::vector<unsigned char> memory;    // the levels when the ring had no room
+
+    size_t Size() const
+    {
+        return levels.empty() ? 0 : levels.back().offset + levels.back().size;
+    }
+
+    // Pointer argument for glTexSubImage2D, an offset into the bound unpack buffer for ring levels
+    const void* Source(const StagedLevel& level) const
+    {
+        if (ring)
+            return reinterpret_cast<const void*>(uintptr_t(ringOffset + level.offset));
+        return memory.data() + level.offset;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+"""
+CS330 - SNHU Comp Graphics and Visualization
+Shader validation
+Compiles every shader offline with glslangValidator so GLSL errors are found
+when building instead of when CreateShaders prints its info log at startup.
+
+Checks two sets of sources:
+  the export directory written by FinalProject --export-shaders <dir>, one
+  file per stage of every program the scene compiles, with the variant
+  defines and any shaderfiles replacements already in place
+  the standalone sources in shaderfiles, except the replacement files the
+  export lists in shaderfiles.txt, which only compile with their defines
+
+With --spirv <dir> the exported stages are also compiled to SPIR-V for
+ARB_gl_spirv (glslangValidator -G), one <stage file>.spv each. Locations and
+bindings the sources leave out are assigned automatically
+
+usage: python validateshaders.py <export dir> [--shaderfiles <dir>] [--spirv <dir>]
+                                 [--validator <glslangValidator>] [--require-validator]
+Exits with 1 if any shader fails, and 0 without glslangValidator unless
+--require-validator is given
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+EXPORT_LIST = "shaderfiles.txt"  # SHADER_EXPORT_LIST in shaderexport.h
+
+# Stage of a source by extension, the export uses the glslangValidator ones, shaderfiles also the older ones
+STAGE_EXTENSIONS = {
+    ".vert": "vert", ".vs": "vert", ".vertexshader": "vert",
+    ".tesc": "tesc",
+    ".tese": "tese",
+    ".geom": "geom",
+    ".frag": "frag", ".fs": "frag", ".fragmentshader": "frag",
+    ".comp": "comp",
+}
+
+
+def find_validator(path):
+    """glslangValidator from --validator, the PATH, or the Vulkan SDK, None if there is none"""
+    if path:
+        return path if shutil.which(path) else None
+    found = shutil.which("glslangValidator")
+    if found:
+        return found
+    sdk = os.environ.get("VULKAN_SDK")
+    if sdk:
+        for folder in ("Bin", "bin"):
+            found = shutil.which("glslangValidator", path=os.path.join(sdk, folder))
+            if found:
+                return found
+    return None
+
+
+def stage_files(directory, skip=()):
+    """(path, stage) of every shader source in directory, by name"""
+    files = []
+    for name in sorted(os.listdir(directory)):
+        stage = STAGE_EXTENSIONS.get(os.path.splitext(name)[1].lower())
+        if stage and name not in skip:
+            files.append((os.path.join(directory, name), stage))
+    return files
+
+
+def run(command):
+    """Runs glslangValidator, returns (succeeded, its output)"""
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    return result.returncode == 0, result.stdout.strip()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Validate the project's GLSL with glslangValidator")
+    parser.add_argument("export", help="directory written by --export-shaders")
+    parser.add_argument("--shaderfiles", default="shaderfiles", help="standalone shader directory, default shaderfiles")
+    parser.add_argument("--spirv", help="also write SPIR-V for ARB_gl_spirv of every exported stage here")
+    parser.add_argument("--validator", help="glslangValidator to run, found on the PATH or in VULKAN_SDK otherwise")
+    parser.add_argument("--require-validator", action="store_true", help="fail when glslangValidator is not found")
+    args = parser.parse_args()
+
+    validator = find_validator(args.validator)
+    if not validator:
+        print("Shader validation: glslangValidator not found, install the Vulkan SDK or pass --validator")
+        return 1 if args.require_validator else 0
+    if not os.path.isdir(args.export):
+        print("Shader validation: " + args.export + " does not exist, run FinalProject --export-shaders " + args.export + " first")
+        return 1
+
+    # Replacement files are already part of the exported stages
+    skip = set()
+    list_path = os.path.join(args.export, EXPORT_LIST)
+    if os.path.exists(list_path):
+        with open(list_path) as names:
+            skip = set(line.strip() for line in names if line.strip())
+
+    exported = stage_files(args.export)
+    standalone = stage_files(args.shaderfiles, skip) if os.path.isdir(args.shaderfiles) else []
+
+    # One glslangValidator run per file, the source extension may not be one it knows so the stage is always given
+    jobs = []
+    for path, stage in exported + standalone:
+        jobs.append((path, "GLSL", [validator, "-S", stage, path]))
+    if args.spirv:
+        os.makedirs(args.spirv, exist_ok=True)
+        for path, stage in exported:
+            output = os.path.join(args.spirv, os.path.basename(path) + ".spv")
+            jobs.append((path, "SPIR-V", [validator, "-G", "-S", stage, "--auto-map-locations", "--auto-map-bindings", "-o", output, path]))
+
+    with ThreadPoolExecutor(max_workers=os.cpu_count() or 4) as pool:
+        results = list(pool.map(lambda job: run(job[2]), jobs))
+
+    failures = 0
+    for (path, kind, _), (succeeded, output) in zip(jobs, results):
+        if not succeeded:
+            failures += 1
+            print(kind + " compilation failed: " + path + "\n" + output + "\n")
+
+    print("Validated " + str(len(exported)) + " exported and " + str(len(standalone)) + " shaderfiles stages" +
+          (", wrote SPIR-V to " + args.spirv if args.spirv else "") + ": " + str(failures) + " failed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,862 @@
+/*
+* CS330 - SNHU Comp Graphics and Visualization
+* Virtual texturing
+* Very large textures are cut into pages of PAGE_SIZE texels for every mip
+* level and written to a tiled file next to the texture cache. Only the pages
+* the camera sees are kept in one physical cache texture:
+* - a feedback pass renders the virtual textured meshes into a small target,
+*   each pixel naming the page and level it would sample
+* - the target is read back through a pixel pack buffer a frame or two later,
+*   and the missing pages are requested coarsest first
+* - a worker thread copies the requested pages from the memory mapped file
+*   into the texture upload ring, and Update copies them into free or least
+*   recently used physical pages
+* - every virtual texture has a page table texture, one texel per page and
+*   level, which the fragment shader reads to find the physical page; pages
+*   that are not resident point at their closest resident ancestor
+*
+* The pages of the coarsest level are loaded first and never evicted, so
+* every texel has something to show while the finer pages stream in
+* Every page carries a PAGE_BORDER of its neighbours, so bilinear filtering
+* inside the physical cache never reads another page. Levels are picked per
+* pixel without trilinear blending between them
+*/
+
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "bcencoder.h"
+#include "glextensions.h"
+#include "mappedfile.h"
+#include "mipgenerator.h"
+#include "shaderlibrary.h"
+#include "textureloader.h"
+#include "textureuploadring.h"
+
+const uint32_t VIRTUAL_TEXTURE_VERSION = 2; // bump when the page layout or the mip filter changes
+
+// Start of a tiled virtual texture file, followed by the pages of every level, level 0 first and each level row by row
+struct VirtualTextureHeader {
+    char magic[4];       // "VTEX"
+    uint32_t version;
+    uint32_t width;      // texels of level 0
+    uint32_t height;
+    uint32_t levels;
+    uint32_t pageSize;
+    uint32_t pageBorder;
+    uint32_t compressed; // pages are BC3 blocks, otherwise RGBA8 texels
+};
+
+/*
+* Read side of a tiled virtual texture file, plus the builder that writes one from an RGBA8 image
+* Page (x, y) of a level holds the level's texels [x * PAGE_SIZE, (x + 1) * PAGE_SIZE) on each axis,
+* with PAGE_BORDER extra texels around them that wrap around the level like GL_REPEAT
+*/
+class VirtualTextureFile
+{
+public:
+    static const int PAGE_SIZE = 128;
+    static const int PAGE_BORDER = 4; // a BC block, so padded pages stay block aligned
+    static const int PADDED_PAGE_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+    static const int MAX_PAGES = 256; // per side of level 0, the feedback pass writes page coordinates as bytes
+
+    static size_t PageBytes(bool compressed)
+    {
+        return compressed ? BCImageSize(PADDED_PAGE_SIZE, PADDED_PAGE_SIZE, true) : size_t(PADDED_PAGE_SIZE) * PADDED_PAGE_SIZE * 4;
+    }
+
+    // Levels down to the first one that fits in a single page, or maxLevel + 1 when that comes first
+    static int LevelCount(int width, int height, int maxLevel)
+    {
+        int levels = 1;
+        while (levels <= maxLevel && std::max(width >> (levels - 1), height >> (levels - 1)) > PAGE_SIZE)
+            ++levels;
+        return levels;
+    }
+
+    static int LevelSize(int size, int level) { return std::max(1, size >> level); }
+    static int PageCount(int size, int level) { return (LevelSize(size, level) + PAGE_SIZE - 1) / PAGE_SIZE; }
+
+    /*
+    * Maps a file written by Build
+    * @params compressed: the page format the caller expects, a file in the other format does not open
+    * @return false if the file is missing, truncated or from another version
+    */
+    bool Open(const std::string& path, bool compressed)
+    {
+        if (!file.Open(path))
+            return false;
+        if (file.Size() < sizeof(VirtualTextureHeader)) {
+            file.Close();
+            return false;
+        }
+        memcpy(&header, file.Data(), sizeof(header));
+        if (memcmp(header.magic, "VTEX", 4) != 0 || header.version != VIRTUAL_TEXTURE_VERSION || header.pageSize != PAGE_SIZE ||
+            header.pageBorder != PAGE_BORDER || header.compressed != uint32_t(compressed) || header.levels == 0) {
+            file.Close();
+            return false;
+        }
+
+        levelStart.clear();
+        size_t pages = 0;
+        for (int level = 0; level < Levels(); ++level) {
+            levelStart.push_back(pages);
+            pages += size_t(PagesX(level)) * size_t(PagesY(level));
+        }
+        if (file.Size() != sizeof(VirtualTextureHeader) + pages * PageBytes(compressed)) {
+            file.Close();
+            return false;
+        }
+        return true;
+    }
+
+    int Width() const { return int(header.width); }
+    int Height() const { return int(header.height); }
+    int Levels() const { return int(header.levels); }
+    bool Compressed() const { return header.compressed != 0; }
+    int PagesX(int level) const { return PageCount(Width(), level); }
+    int PagesY(int level) const { return PageCount(Height(), level); }
+
+    const unsigned char* Page(int level, int x, int y) const
+    {
+        size_t index = levelStart[level] + size_t(y) * PagesX(level) + x;
+        return file.Data() + sizeof(VirtualTextureHeader) + index * PageBytes(Compressed());
+    }
+
+    /*
+    * Writes the pages of an image and its mips to path
+    * @params maxLevel: deepest level to write, e.g. where an atlas starts bleeding between its images
+    *         compressed: BC3 pages instead of RGBA8
+    * @return false if the image has more than MAX_PAGES pages per side or the file cannot be written
+    */
+    static bool Build(const std::string& path, const unsigned char* rgba, int width, int height, int maxLevel, bool compressed, const MipOptions& mipOptions)
+    {
+        if (PageCount(width, 0) > MAX_PAGES || PageCount(height, 0) > MAX_PAGES) {
+            std::cerr << "Virtual texture " << path << " is larger than " << MAX_PAGES * PAGE_SIZE << " texels" << std::endl;
+            return false;
+        }
+
+        VirtualTextureHeader header = {};
+        memcpy(header.magic, "VTEX", 4);
+        header.version = VIRTUAL_TEXTURE_VERSION;
+        header.width = uint32_t(width);
+        header.height = uint32_t(height);
+        header.levels = uint32_t(LevelCount(width, height, maxLevel));
+        header.pageSize = PAGE_SIZE;
+        header.pageBorder = PAGE_BORDER;
+        header.compressed = compressed;
+
+        std::vector<MipLevel> mips;
+        MipGenerator::Generate(rgba, width, height, int(header.levels) - 1, mipOptions, mips);
+
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+        // Write to a temporary file and rename so a crash never leaves a truncated file
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            std::vector<unsigned char> padded(size_t(PADDED_PAGE_SIZE) * PADDED_PAGE_SIZE * 4);
+            std::vector<unsigned char> blocks(PageBytes(true));
+            for (int level = 0; level < int(header.levels); ++level) {
+                const unsigned char* pixels = level == 0 ? rgba : mips[level - 1].pixels.data();
+                int w = LevelSize(width, level), h = LevelSize(height, level);
+                for (int py = 0; py < PageCount(height, level); ++py) {
+                    for (int px = 0; px < PageCount(width, level); ++px) {
+                        for (int y = 0; y < PADDED_PAGE_SIZE; ++y) {
+                            int sy = Wrap(py * PAGE_SIZE + y - PAGE_BORDER, h);
+                            for (int x = 0; x < PADDED_PAGE_SIZE; ++x) {
+                                int sx = Wrap(px * PAGE_SIZE + x - PAGE_BORDER, w);
+                                memcpy(&padded[(size_t(y) * PADDED_PAGE_SIZE + x) * 4], pixels + (size_t(sy) * w + sx) * 4, 4);
+                            }
+                        }
+                        if (compressed) {
+                            EncodeBCImage(padded.data(), PADDED_PAGE_SIZE, PADDED_PAGE_SIZE, true, blocks.data());
+                            out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+                        }
+                        else {
+                            out.write(reinterpret_cast<const char*>(padded.data()), padded.size());
+                        }
+                    }
+                }
+            }
+            if (!out)
+                return false;
+        }
+
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+private:
+    MappedFile file;
+    VirtualTextureHeader header = {};
+    std::vector<size_t> levelStart; // index of the first page of every level
+
+    static int Wrap(int value, int size) { return ((value % size) + size) % size; }
+};
+
+/*
+* The physical page cache, the page tables and the feedback pass of every virtual texture
+* All methods except the worker run on the GL thread
+*/
+class VirtualTextureSystem
+{
+public:
+    static const int PHYSICAL_PAGES = 16;               // per side of the physical cache texture
+    static const int FEEDBACK_SCALE = 8;                // the feedback target is this much smaller than the window on each side
+    static const size_t PAGE_UPLOADS_PER_FRAME = 8;
+    static const size_t MAX_PENDING_PAGES = 32;         // requested pages not uploaded yet, more wait for the next feedback
+    static const GLint PAGE_TABLE_UNIT = 1;             // texture units of the pageTable and physicalPages samplers
+    static const GLint PHYSICAL_PAGES_UNIT = 2;
+
+    /*
+    * Creates the physical cache and starts the page loader
+    * @params ring: buffer the pages are staged in, pages stay in client memory when it is full
+    *         compressed: BC3 pages, otherwise RGBA8
+    *         release: frees the images decode functions return, see Add
+    */
+    bool Create(PixelUploadRing* ring, bool compressed, bool srgb, FreeImageFunction release)
+    {
+        uploadRing = ring;
+        compressedPages = compressed;
+        releaseImage = release;
+        if (compressed)
+            physicalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            physicalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+        glGenTextures(1, &physicalTexture);
+        glBindTexture(GL_TEXTURE_2D, physicalTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, physicalFormat, PhysicalSize(), PhysicalSize());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (glGetError() != GL_NO_ERROR) {
+            Destroy();
+            return false;
+        }
+
+        slots.assign(size_t(PHYSICAL_PAGES) * PHYSICAL_PAGES, Slot());
+        stopping = false;
+        worker = std::thread(&VirtualTextureSystem::Work, this);
+        return true;
+    }
+
+    // Stops the page loader and deletes the GL objects, call before the upload ring is destroyed
+    void Destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+        for (LoadedPage& page : loaded) {
+            if (page.ring)
+                page.ring->Release(page.ringOffset, nullptr);
+        }
+        loaded.clear();
+        jobs.clear();
+
+        for (std::unique_ptr<VirtualTexture>& texture : textures) {
+            if (texture->pageTable)
+                glDeleteTextures(1, &texture->pageTable);
+        }
+        textures.clear();
+        DestroyFeedback();
+        if (physicalTexture)
+            glDeleteTextures(1, &physicalTexture);
+        physicalTexture = 0;
+        slots.clear();
+    }
+
+    /*
+    * Adds a virtual texture, built from its source on the page loader when cachePath is missing or stale
+    * @params cachePath: tiled file of the texture
+    *         sourcePath, decode: decode fills image.pixels with RGBA8 from image.path on the page loader thread
+    *         maxLevel: deepest mip level, e.g. where an atlas starts bleeding between its images
+    * @return index of the texture for Bind and BindFeedback, it samples as a placeholder until its file is open
+    */
+    int Add(const std::string& cachePath, const std::string& sourcePath, DecodeImageFunction decode, const MipOptions& mipOptions, int maxLevel = INT_MAX)
+    {
+        std::unique_ptr<VirtualTexture> texture(new VirtualTexture);
+        texture->cachePath = cachePath;
+        texture->sourcePath = sourcePath;
+        texture->decode = decode;
+        texture->mipOptions = mipOptions;
+        texture->maxLevel = maxLevel;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        int index = int(textures.size());
+        textures.push_back(std::move(texture));
+        jobs.push_back({ index, OPEN_JOB, 0, 0, false });
+        wake.notify_one();
+        return index;
+    }
+
+    size_t Count() const { return textures.size(); }
+
+    /*
+    * Samples a virtual texture in the next draws of programId, a shader variant with SHADER_VIRTUAL_TEXTURE
+    * The program must be in use
+    */
+    void Bind(int index, GLuint programId)
+    {
+        const VirtualTexture& texture = *textures[index];
+        glActiveTexture(GL_TEXTURE0 + PAGE_TABLE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, texture.pageTable);
+        glActiveTexture(GL_TEXTURE0 + PHYSICAL_PAGES_UNIT);
+        glBindTexture(GL_TEXTURE_2D, physicalTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        SetLayoutUniforms(texture, programId);
+        glUniform4f(ShaderLibrary::Get().Uniform(programId, "pageLayout"), float(VirtualTextureFile::PAGE_SIZE), float(VirtualTextureFile::PAGE_BORDER),
+            float(VirtualTextureFile::PADDED_PAGE_SIZE), float(PhysicalSize()));
+    }
+
+    /*
+    * Binds the feedback target for the frame, sized from the window's framebuffer
+    * @return false while a resize cannot create the target, skip the feedback draws then
+    */
+    bool BeginFeedback(int width, int height)
+    {
+        int feedbackWidth = std::max(1, width / FEEDBACK_SCALE), feedbackHeight = std::max(1, height / FEEDBACK_SCALE);
+        if (feedbackWidth != feedback.width || feedbackHeight != feedback.height) {
+            DestroyFeedback();
+            if (!CreateFeedback(feedbackWidth, feedbackHeight))
+                return false;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedback.framebuffer);
+        glViewport(0, 0, feedback.width, feedback.height);
+        glDisable(GL_BLEND); // the alpha channel holds the texture index
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        return true;
+    }
+
+    // Sets the uniforms the feedback program needs to name the pages of a virtual texture
+    void BindFeedback(int index, GLuint programId)
+    {
+        SetLayoutUniforms(*textures[index], programId);
+        glUniform1i(ShaderLibrary::Get().Uniform(programId, "virtualTextureIndex"), index);
+        glUniform1f(ShaderLibrary::Get().Uniform(programId, "pageSize"), float(VirtualTextureFile::PAGE_SIZE));
+        glUniform1f(ShaderLibrary::Get().Uniform(programId, "feedbackBias"), std::log2(float(FEEDBACK_SCALE)));
+    }
+
+    // Starts the readback of the feedback target and rebinds the window's framebuffer
+    void EndFeedback(int width, int height)
+    {
+        // Skip the frame when both readbacks are still in flight
+        Readback& readback = feedback.readbacks[feedback.next];
+        if (!readback.fence) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            glReadPixels(0, 0, feedback.width, feedback.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            feedback.next = (feedback.next + 1) % 2;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+    /*
+    * Requests the pages found by finished feedback readbacks, uploads loaded pages
+    * and refreshes the page tables, call once per frame after the draws
+    */
+    void Update()
+    {
+        ReadFeedback();
+        UploadPages();
+        for (std::unique_ptr<VirtualTexture>& texture : textures)
+            UploadPageTable(*texture);
+        ++frame;
+    }
+
+    // Prints how many pages were streamed and how full the physical cache is
+    void Report(std::ostream& out) const
+    {
+        size_t used = 0;
+        for (const Slot& slot : slots)
+            used += slot.texture >= 0;
+        out << "Virtual textures: " << textures.size() << " textures, " << pagesLoaded << " pages loaded, " << pagesEvicted
+            << " evicted, " << used << " of " << slots.size() << " physical pages in use" << std::endl;
+    }
+
+private:
+    static constexpr int OPEN_JOB = -1;   // level of the job that opens or builds a texture file
+    static constexpr int NOT_RESIDENT = -1;
+    static constexpr int REQUESTED = -2;  // queued on the page loader
+
+    struct VirtualTexture {
+        std::string cachePath;
+        std::string sourcePath;
+        DecodeImageFunction decode = nullptr;
+        MipOptions mipOptions;
+        int maxLevel = INT_MAX;
+        VirtualTextureFile file;            // read by the page loader, its layout by the GL thread once ready
+
+        bool ready = false;                 // GL thread: file open and page table created
+        GLuint pageTable = 0;
+        std::vector<std::vector<uint32_t>> entries; // page table texels per level, rows of the pow2 sized table
+        std::vector<bool> dirty;
+        std::vector<std::vector<int>> pages;        // physical slot of every page, NOT_RESIDENT or REQUESTED
+    };
+
+    struct Job {
+        int texture;
+        int level;
+        int x;
+        int y;
+        bool pinned; // page of the coarsest level, never evicted
+    };
+
+    struct LoadedPage {
+        Job job;
+        bool opened = false;               // result of an OPEN_JOB
+        PixelUploadRing* ring = nullptr;   // ring holding the page, null when it is in memory
+        size_t ringOffset = 0;
+        std::vector<unsigned char> memory;
+    };
+
+    struct Slot {
+        int texture = -1; // -1 while free
+        int level = 0;
+        int x = 0;
+        int y = 0;
+        unsigned long long lastUsed = 0; // frame the feedback last asked for the page
+        bool pinned = false;
+    };
+
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+    };
+
+    struct Feedback {
+        GLuint framebuffer = 0;
+        GLuint color = 0;
+        GLuint depth = 0;
+        int width = 0;
+        int height = 0;
+        Readback readbacks[2];
+        int next = 0; // readback the next EndFeedback writes
+    };
+
+    PixelUploadRing* uploadRing = nullptr;
+    FreeImageFunction releaseImage = nullptr;
+    bool compressedPages = false;
+    GLenum physicalFormat = GL_RGBA8;
+    GLuint physicalTexture = 0;
+    std::vector<Slot> slots;
+    std::vector<std::unique_ptr<VirtualTexture>> textures;
+    Feedback feedback;
+    size_t pendingPages = 0;
+    unsigned long long frame = 1;
+    unsigned int pagesLoaded = 0;
+    unsigned int pagesEvicted = 0;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;           // waiting for the page loader
+    std::deque<LoadedPage> loaded;  // waiting for Update
+    bool stopping = false;
+
+    static int PhysicalSize() { return PHYSICAL_PAGES * VirtualTextureFile::PADDED_PAGE_SIZE; }
+
+    static int NextPowerOfTwo(int value)
+    {
+        int power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+
+    void SetLayoutUniforms(const VirtualTexture& texture, GLuint programId)
+    {
+        int levels = texture.ready ? texture.file.Levels() : 0;
+        glUniform2f(ShaderLibrary::Get().Uniform(programId, "virtualSize"), float(texture.ready ? texture.file.Width() : 1), float(texture.ready ? texture.file.Height() : 1));
+        glUniform1i(ShaderLibrary::Get().Uniform(programId, "virtualLevels"), levels);
+    }
+
+    bool CreateFeedback(int width, int height)
+    {
+        feedback.width = width;
+        feedback.height = height;
+        glGenTextures(1, &feedback.color);
+        glBindTexture(GL_TEXTURE_2D, feedback.color);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &feedback.depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedback.depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &feedback.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedback.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback.color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback.depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (Readback& readback : feedback.readbacks) {
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(width) * height * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (!complete)
+            DestroyFeedback();
+        return complete;
+    }
+
+    void DestroyFeedback()
+    {
+        for (Readback& readback : feedback.readbacks) {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            if (readback.buffer)
+                glDeleteBuffers(1, &readback.buffer);
+        }
+        if (feedback.framebuffer)
+            glDeleteFramebuffers(1, &feedback.framebuffer);
+        if (feedback.color)
+            glDeleteTextures(1, &feedback.color);
+        if (feedback.depth)
+            glDeleteRenderbuffers(1, &feedback.depth);
+        feedback = Feedback();
+    }
+
+    // Page of level `to` under the center of page (x, y) of level `from`, on one axis
+    static int Ancestor(int size, int from, int to, int page)
+    {
+        double uv = (page + 0.5) * VirtualTextureFile::PAGE_SIZE / VirtualTextureFile::LevelSize(size, from);
+        int ancestor = int(uv * VirtualTextureFile::LevelSize(size, to) / VirtualTextureFile::PAGE_SIZE);
+        return std::min(ancestor, VirtualTextureFile::PageCount(size, to) - 1);
+    }
+
+    // Reads the oldest finished readback and requests what it saw
+    void ReadFeedback()
+    {
+        Readback& readback = feedback.readbacks[feedback.next];
+        if (!readback.fence)
+            return;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+
+        std::unordered_set<uint32_t> seen;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const unsigned char* pixels = static_cast<const unsigned char*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(feedback.width) * feedback.height * 4, GL_MAP_READ_BIT));
+        if (pixels) {
+            for (size_t i = 0, count = size_t(feedback.width) * feedback.height; i < count; ++i) {
+                const unsigned char* p = pixels + i * 4;
+                if (p[3] != 0)
+                    seen.insert(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3] - 1) << 24));
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // Mark the pages and their ancestors as used, collecting the missing ones
+        std::vector<Job> wanted;
+        for (uint32_t request : seen) {
+            int index = int(request >> 24), level = int((request >> 16) & 0xFF);
+            if (index >= int(textures.size()) || !textures[index]->ready)
+                continue;
+            VirtualTexture& texture = *textures[index];
+            const VirtualTextureFile& file = texture.file;
+            if (level >= file.Levels())
+                continue;
+            int x = std::min(int(request & 0xFF), file.PagesX(level) - 1);
+            int y = std::min(int((request >> 8) & 0xFF), file.PagesY(level) - 1);
+            for (int up = level; up < file.Levels(); ++up) {
+                int ux = Ancestor(file.Width(), level, up, x), uy = Ancestor(file.Height(), level, up, y);
+                int& page = texture.pages[up][size_t(uy) * file.PagesX(up) + ux];
+                if (page >= 0)
+                    slots[page].lastUsed = frame;
+                else if (page == NOT_RESIDENT) {
+                    page = REQUESTED; // only collected once, reset below when it does not fit in this round
+                    wanted.push_back({ index, up, ux, uy, false });
+                }
+            }
+        }
+
+        // Coarse pages first, they cover the most texels
+        std::sort(wanted.begin(), wanted.end(), [](const Job& a, const Job& b) { return a.level > b.level; });
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Job& job : wanted) {
+            if (pendingPages < MAX_PENDING_PAGES) {
+                jobs.push_back(job);
+                ++pendingPages;
+            }
+            else {
+                textures[job.texture]->pages[job.level][size_t(job.y) * textures[job.texture]->file.PagesX(job.level) + job.x] = NOT_RESIDENT;
+            }
+        }
+        if (!wanted.empty())
+            wake.notify_one();
+    }
+
+    // Creates the page table of a texture whose file was opened, and queues its coarsest level
+    void Ready(int index)
+    {
+        VirtualTexture& texture = *textures[index];
+        const VirtualTextureFile& file = texture.file;
+        int levels = file.Levels();
+        int tableWidth = NextPowerOfTwo(file.PagesX(0)), tableHeight = NextPowerOfTwo(file.PagesY(0));
+
+        glGenTextures(1, &texture.pageTable);
+        glBindTexture(GL_TEXTURE_2D, texture.pageTable);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, tableWidth, tableHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        texture.entries.resize(levels);
+        texture.dirty.assign(levels, true);
+        texture.pages.resize(levels);
+        for (int level = 0; level < levels; ++level) {
+            texture.entries[level].assign(size_t(std::max(1, tableWidth >> level)) * std::max(1, tableHeight >> level), 0);
+            texture.pages[level].assign(size_t(file.PagesX(level)) * file.PagesY(level), NOT_RESIDENT);
+        }
+        texture.ready = true;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        int top = levels - 1;
+        for (int y = 0; y < file.PagesY(top); ++y) {
+            for (int x = 0; x < file.PagesX(top); ++x) {
+                texture.pages[top][size_t(y) * file.PagesX(top) + x] = REQUESTED;
+                jobs.push_back({ index, top, x, y, true });
+            }
+        }
+        wake.notify_one();
+    }
+
+    // A free slot, else the least recently used one the last feedback did not ask for, -1 when every slot is in use
+    int FindSlot()
+    {
+        int best = -1;
+        for (int i = 0; i < int(slots.size()); ++i) {
+            const Slot& slot = slots[i];
+            if (slot.texture < 0)
+                return i;
+            if (!slot.pinned && slot.lastUsed < frame && (best < 0 || slot.lastUsed < slots[best].lastUsed))
+                best = i;
+        }
+        return best;
+    }
+
+    void UploadPages()
+    {
+        std::vector<LoadedPage> pages;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!loaded.empty() && pages.size() < PAGE_UPLOADS_PER_FRAME) {
+                pages.push_back(std::move(loaded.front()));
+                loaded.pop_front();
+            }
+        }
+
+        std::vector<size_t> ringOffsets;
+        glBindTexture(GL_TEXTURE_2D, physicalTexture);
+        for (LoadedPage& page : pages) {
+            if (page.opened) {
+                Ready(page.job.texture);
+                continue;
+            }
+            if (!page.job.pinned)
+                --pendingPages;
+
+            VirtualTexture& texture = *textures[page.job.texture];
+            int& resident = texture.pages[page.job.level][size_t(page.job.y) * texture.file.PagesX(page.job.level) + page.job.x];
+            int slot = page.ring || !page.memory.empty() ? FindSlot() : -1;
+            if (slot < 0) {
+                // Failed read or no room, the next feedback asks again
+                resident = NOT_RESIDENT;
+                if (page.ring)
+                    page.ring->Release(page.ringOffset, nullptr);
+                continue;
+            }
+            if (slots[slot].texture >= 0)
+                Evict(slot);
+
+            int x = (slot % PHYSICAL_PAGES) * VirtualTextureFile::PADDED_PAGE_SIZE;
+            int y = (slot / PHYSICAL_PAGES) * VirtualTextureFile::PADDED_PAGE_SIZE;
+            const void* source = page.memory.data();
+            if (page.ring) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, page.ring->Buffer());
+                source = reinterpret_cast<const void*>(uintptr_t(page.ringOffset));
+            }
+            if (compressedPages)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VirtualTextureFile::PADDED_PAGE_SIZE, VirtualTextureFile::PADDED_PAGE_SIZE,
+                    physicalFormat, GLsizei(VirtualTextureFile::PageBytes(true)), source);
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VirtualTextureFile::PADDED_PAGE_SIZE, VirtualTextureFile::PADDED_PAGE_SIZE,
+                    GL_RGBA, GL_UNSIGNED_BYTE, source);
+            if (page.ring) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                page.ring->Release(page.ringOffset, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+            }
+
+            slots[slot] = { page.job.texture, page.job.level, page.job.x, page.job.y, frame, page.job.pinned };
+            resident = slot;
+            Remap(texture, page.job.level, page.job.x, page.job.y);
+            ++pagesLoaded;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void Evict(int slot)
+    {
+        Slot old = slots[slot];
+        VirtualTexture& texture = *textures[old.texture];
+        texture.pages[old.level][size_t(old.y) * texture.file.PagesX(old.level) + old.x] = NOT_RESIDENT;
+        slots[slot] = Slot();
+        Remap(texture, old.level, old.x, old.y);
+        ++pagesEvicted;
+    }
+
+    // Entry of a page: the physical page of the page itself or of its closest resident ancestor
+    uint32_t Resolve(const VirtualTexture& texture, int level, int x, int y) const
+    {
+        const VirtualTextureFile& file = texture.file;
+        for (int up = level; up < file.Levels(); ++up) {
+            int ux = Ancestor(file.Width(), level, up, x), uy = Ancestor(file.Height(), level, up, y);
+            int slot = texture.pages[up][size_t(uy) * file.PagesX(up) + ux];
+            if (slot >= 0)
+                return uint32_t(slot % PHYSICAL_PAGES) | (uint32_t(slot / PHYSICAL_PAGES) << 8) | (uint32_t(up) << 16) | 0xFF000000u;
+        }
+        return 0;
+    }
+
+    // Recomputes the entries of a page and of every finer page under it
+    void Remap(VirtualTexture& texture, int level, int x, int y)
+    {
+        const VirtualTextureFile& file = texture.file;
+        int tableWidth = NextPowerOfTwo(file.PagesX(0));
+        for (int down = level; down >= 0; --down) {
+            // Pages of this level whose center lies under the page, with one page of slack for rounding
+            int scale = 1 << (level - down);
+            int x0 = std::max(0, x * scale - 1), x1 = std::min(file.PagesX(down) - 1, (x + 1) * scale);
+            int y0 = std::max(0, y * scale - 1), y1 = std::min(file.PagesY(down) - 1, (y + 1) * scale);
+            int rowLength = std::max(1, tableWidth >> down);
+            for (int py = y0; py <= y1; ++py) {
+                for (int px = x0; px <= x1; ++px) {
+                    if (Ancestor(file.Width(), down, level, px) != x || Ancestor(file.Height(), down, level, py) != y)
+                        continue;
+                    texture.entries[down][size_t(py) * rowLength + px] = Resolve(texture, down, px, py);
+                }
+            }
+            texture.dirty[down] = true;
+        }
+    }
+
+    void UploadPageTable(VirtualTexture& texture)
+    {
+        if (!texture.ready)
+            return;
+        int tableWidth = NextPowerOfTwo(texture.file.PagesX(0)), tableHeight = NextPowerOfTwo(texture.file.PagesY(0));
+        glBindTexture(GL_TEXTURE_2D, texture.pageTable);
+        for (int level = 0; level < texture.file.Levels(); ++level) {
+            if (!texture.dirty[level])
+                continue;
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, std::max(1, tableWidth >> level), std::max(1, tableHeight >> level),
+                GL_RGBA, GL_UNSIGNED_BYTE, texture.entries[level].data());
+            texture.dirty[level] = false;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Opens the file of a texture, building it from the source first when it is missing or stale
+    bool Open(VirtualTexture& texture)
+    {
+        if (texture.file.Open(texture.cachePath, compressedPages))
+            return true;
+
+        DecodedImage image;
+        image.path = texture.sourcePath;
+        if (!texture.decode(image)) {
+            std::cerr << "Failed to build virtual texture from " << texture.sourcePath << std::endl;
+            return false;
+        }
+        bool built = VirtualTextureFile::Build(texture.cachePath, image.pixels, image.width, image.height, texture.maxLevel, compressedPages, texture.mipOptions);
+        releaseImage(image);
+        return built && texture.file.Open(texture.cachePath, compressedPages);
+    }
+
+    // Page loader: opens texture files and copies requested pages out of them
+    void Work()
+    {
+        for (;;) {
+            Job job;
+            VirtualTexture* texture;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+                texture = textures[job.texture].get();
+            }
+
+            LoadedPage page;
+            page.job = job;
+            if (job.level == OPEN_JOB) {
+                // Failed textures never become ready and keep sampling as a placeholder
+                if (!Open(*texture))
+                    continue;
+                page.opened = true;
+            }
+            else {
+                const unsigned char* data = texture->file.Page(job.level, job.x, job.y);
+                size_t bytes = VirtualTextureFile::PageBytes(compressedPages);
+                if (uploadRing && uploadRing->Allocate(bytes, page.ringOffset)) {
+                    page.ring = uploadRing;
+                    memcpy(uploadRing->Data(page.ringOffset), data, bytes);
+                }
+                else {
+                    page.memory.assign(data, data + bytes);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(std::move(page));
+        }
+    }
+};
+
+#endif